@@ -0,0 +1,353 @@
+/*
+ *  example/bench.c
+ *
+ *  2015 - 2026 (c) Sun Dro (f4tb0y@protonmail.com)
+ *
+ *  This source file is a part of the "slog" project
+ *  Read LICENSE file for more details about copyright
+ *
+ * Performance measurements of SLog library
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <slog.h>
+
+#define BENCH_FILTERED_CALLS 10000000
+#define BENCH_LINE_CALLS     200000
+#define BENCH_THREADS_MAX    64
+
+typedef enum {
+    BENCH_OUT_SCREEN = 0,
+    BENCH_OUT_FILE,
+    BENCH_OUT_CALLBACK
+} bench_output_t;
+
+typedef struct {
+    const char *pName;
+    bench_output_t eOutput;
+    uint8_t nUseHeap;
+    uint8_t nGrowBuffer;
+    uint8_t nFlush;
+    uint8_t nKeepOpen;
+    int nThreads;
+} bench_case_t;
+
+typedef struct {
+    pthread_t thread;
+    uint32_t *pLatency;
+    size_t nCalls;
+    int nId;
+} bench_worker_t;
+
+static int g_nSideEffects = 0;
+static size_t g_nCalls = BENCH_LINE_CALLS;
+
+static uint64_t bench_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int bench_side_effect(void)
+{
+    return ++g_nSideEffects;
+}
+
+static int bench_compare(const void *pA, const void *pB)
+{
+    uint32_t nA = *(const uint32_t*)pA;
+    uint32_t nB = *(const uint32_t*)pB;
+    return (nA > nB) - (nA < nB);
+}
+
+static uint32_t bench_percentile(const uint32_t *pSorted, size_t nCount, double fRank)
+{
+    size_t nIndex = (size_t)(fRank * (double)(nCount - 1) + 0.5);
+    return pSorted[nIndex];
+}
+
+static void bench_header(const char *pTitle)
+{
+    printf("\n%-44s %10s %12s %8s %8s %8s\n", pTitle, "ns/call", "calls/s", "p50", "p99", "p999");
+}
+
+static void bench_report(const char *pName, uint64_t nElapsed, uint64_t nCalls)
+{
+    double fNsPerCall = (double)nElapsed / (double)nCalls;
+    double fPerSec = (double)nCalls * 1e9 / (double)nElapsed;
+    printf("%-44s %10.2f %12.0f %8s %8s %8s\n", pName, fNsPerCall, fPerSec, "-", "-", "-");
+}
+
+/* Mean and percentiles come from the per-call samples, the rate from the wall clock */
+static void bench_report_latency(const char *pName, uint64_t nElapsed, uint32_t *pLatency, size_t nCount)
+{
+    uint64_t nTotal = 0;
+    size_t i;
+
+    for (i = 0; i < nCount; i++) nTotal += pLatency[i];
+    qsort(pLatency, nCount, sizeof(uint32_t), bench_compare);
+
+    printf("%-44s %10.2f %12.0f %8u %8u %8u\n", pName,
+        (double)nTotal / (double)nCount,
+        (double)nCount * 1e9 / (double)nElapsed,
+        bench_percentile(pLatency, nCount, 0.5),
+        bench_percentile(pLatency, nCount, 0.99),
+        bench_percentile(pLatency, nCount, 0.999));
+}
+
+static void bench_filtered(const char *pName, uint16_t nFlags, uint8_t nTdSafe, uint8_t nToScreen)
+{
+    int i;
+
+    slog_init("bench", nFlags, nTdSafe);
+    slog_screen_set(nToScreen);
+
+    uint64_t nStart = bench_time_ns();
+    for (i = 0; i < BENCH_FILTERED_CALLS; i++)
+        slog_debug("Filtered message %d %s %d", i, "string", bench_side_effect());
+
+    bench_report(pName, bench_time_ns() - nStart, BENCH_FILTERED_CALLS);
+    slog_destroy();
+}
+
+static void bench_filtered_display(const char *pName, uint8_t nTdSafe)
+{
+    int i;
+
+    slog_init("bench", SLOG_ERROR, nTdSafe);
+
+    uint64_t nStart = bench_time_ns();
+    for (i = 0; i < BENCH_FILTERED_CALLS; i++)
+        slog_display(SLOG_DEBUG, 1, "Filtered message %d %s", i, "string");
+
+    bench_report(pName, bench_time_ns() - nStart, BENCH_FILTERED_CALLS);
+    slog_destroy();
+}
+
+static int bench_callback(const char *pLog, size_t nLength, slog_flag_t eFlag, void *pCtx)
+{
+    (void)pLog;
+    (void)nLength;
+    (void)eFlag;
+    (void)pCtx;
+    return 0;
+}
+
+/* Calls dropped by the call site limits, nothing is formatted and the lock is not taken */
+static void bench_limited(const char *pName, uint8_t nRate)
+{
+    int i;
+
+    slog_init("bench", SLOG_FLAGS_ALL, 1);
+    slog_screen_set(0);
+    slog_callback_set(bench_callback, NULL);
+
+    uint64_t nStart = bench_time_ns();
+    for (i = 0; i < BENCH_FILTERED_CALLS; i++)
+    {
+        if (nRate) slog_error_ratelimited(1, "Limited message %d %s", i, "string");
+        else slog_error_every_n(BENCH_FILTERED_CALLS, "Limited message %d %s", i, "string");
+    }
+
+    bench_report(pName, bench_time_ns() - nStart, BENCH_FILTERED_CALLS);
+    slog_destroy();
+}
+
+/* Sampled out calls, the line is dropped before the configuration snapshot and the formatting */
+static void bench_sampled(const char *pName, uint32_t nEvery, double fRate)
+{
+    int i;
+
+    slog_init("bench", SLOG_FLAGS_ALL, 1);
+    slog_screen_set(0);
+    slog_callback_set(bench_callback, NULL);
+
+    if (nEvery) slog_sample_set(SLOG_DEBUG, nEvery);
+    else slog_sample_rate_set(SLOG_DEBUG, fRate);
+
+    uint64_t nStart = bench_time_ns();
+    for (i = 0; i < BENCH_FILTERED_CALLS; i++)
+        slog_debug("Sampled message %d %s", i, "string");
+
+    bench_report(pName, bench_time_ns() - nStart, BENCH_FILTERED_CALLS);
+    slog_destroy();
+}
+
+static void *bench_worker(void *pArg)
+{
+    bench_worker_t *pWorker = (bench_worker_t*)pArg;
+    size_t i;
+
+    for (i = 0; i < pWorker->nCalls; i++)
+    {
+        uint64_t nStart = bench_time_ns();
+        slog_info("Benchmark line %zu from worker %d: %s", i, pWorker->nId, "payload");
+        uint64_t nLatency = bench_time_ns() - nStart;
+        pWorker->pLatency[i] = nLatency > UINT32_MAX ? UINT32_MAX : (uint32_t)nLatency;
+    }
+
+    return NULL;
+}
+
+static void bench_configure(const bench_case_t *pCase)
+{
+    slog_config_t cfg;
+    slog_config_get(&cfg);
+
+    cfg.nToScreen = pCase->eOutput == BENCH_OUT_SCREEN;
+    cfg.nToFile = pCase->eOutput == BENCH_OUT_FILE;
+    cfg.logCallback = pCase->eOutput == BENCH_OUT_CALLBACK ? bench_callback : NULL;
+    cfg.pCallbackCtx = NULL;
+    cfg.nUseHeap = pCase->nUseHeap;
+    cfg.nGrowBuffer = pCase->nGrowBuffer;
+    cfg.nFlush = pCase->nFlush;
+    cfg.nKeepOpen = pCase->nKeepOpen;
+
+    slog_config_set(&cfg);
+}
+
+static int bench_lines(const bench_case_t *pCase)
+{
+    bench_worker_t workers[BENCH_THREADS_MAX];
+    size_t nTotal = g_nCalls * (size_t)pCase->nThreads;
+    char sPath[SLOG_PATH_MAX];
+    int i, nStdout = -1;
+
+    uint32_t *pLatency = (uint32_t*)malloc(nTotal * sizeof(uint32_t));
+    if (pLatency == NULL)
+    {
+        printf("Failed to allocate latency samples for: %s\n", pCase->pName);
+        return 1;
+    }
+
+    slog_init("slog-bench", SLOG_FLAGS_ALL, 1);
+    bench_configure(pCase);
+
+    /* Screen lines go to /dev/null, the report itself must stay on stdout */
+    if (pCase->eOutput == BENCH_OUT_SCREEN)
+    {
+        int nNull = open("/dev/null", O_WRONLY);
+        fflush(stdout);
+        nStdout = dup(STDOUT_FILENO);
+
+        if (nNull >= 0)
+        {
+            dup2(nNull, STDOUT_FILENO);
+            close(nNull);
+        }
+    }
+
+    uint64_t nStart = bench_time_ns();
+    for (i = 0; i < pCase->nThreads; i++)
+    {
+        workers[i].pLatency = pLatency + (size_t)i * g_nCalls;
+        workers[i].nCalls = g_nCalls;
+        workers[i].nId = i;
+        pthread_create(&workers[i].thread, NULL, bench_worker, &workers[i]);
+    }
+
+    for (i = 0; i < pCase->nThreads; i++)
+        pthread_join(workers[i].thread, NULL);
+
+    slog_flush_sync();
+    uint64_t nElapsed = bench_time_ns() - nStart;
+
+    if (nStdout >= 0)
+    {
+        fflush(stdout);
+        dup2(nStdout, STDOUT_FILENO);
+        close(nStdout);
+    }
+
+    if (pCase->eOutput == BENCH_OUT_FILE && slog_get_full_path(sPath, sizeof(sPath)))
+    {
+        slog_destroy();
+        unlink(sPath);
+    }
+    else slog_destroy();
+
+    bench_report_latency(pCase->pName, nElapsed, pLatency, nTotal);
+    free(pLatency);
+    return 0;
+}
+
+static void bench_usage(const char *pName)
+{
+    printf("Usage: %s [calls per thread] [max threads]\n", pName);
+    printf("Defaults: %d calls, threads up to the number of online CPUs\n", BENCH_LINE_CALLS);
+}
+
+int main(int argc, char *argv[])
+{
+    long nCpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int nMaxThreads = nCpus > 1 ? (int)nCpus : 1;
+    int i, nStatus = 0;
+
+    if (argc > 1 && (!strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")))
+    {
+        bench_usage(argv[0]);
+        return 0;
+    }
+
+    if (argc > 1 && atol(argv[1]) > 0) g_nCalls = (size_t)atol(argv[1]);
+    if (argc > 2 && atoi(argv[2]) > 0) nMaxThreads = atoi(argv[2]);
+    if (nMaxThreads > BENCH_THREADS_MAX) nMaxThreads = BENCH_THREADS_MAX;
+
+    printf("SLog %s benchmark\n", slog_version(0));
+
+    bench_header("Filtered-out calls");
+    bench_filtered("filtered slog_debug()", SLOG_ERROR, 0, 1);
+    bench_filtered("filtered slog_debug() thread safe", SLOG_ERROR, 1, 1);
+    bench_filtered("slog_debug() without outputs", SLOG_FLAGS_ALL, 1, 0);
+    bench_filtered_display("filtered slog_display()", 0);
+    bench_filtered_display("filtered slog_display() thread safe", 1);
+    bench_limited("suppressed slog_error_every_n()", 0);
+    bench_limited("suppressed slog_error_ratelimited()", 1);
+    bench_sampled("slog_debug() sampled 1 of 10000", 10000, 0.0);
+    bench_sampled("slog_debug() sampled at rate 0.0001", 0, 0.0001);
+
+    /* Disabled macros must not evaluate their arguments */
+    if (g_nSideEffects)
+    {
+        printf("\nArguments were evaluated %d times\n", g_nSideEffects);
+        return 1;
+    }
+
+    static const bench_case_t cases[] = {
+        { "callback, stack buffer",             BENCH_OUT_CALLBACK, 0, 0, 0, 1, 1 },
+        { "callback, heap",                     BENCH_OUT_CALLBACK, 1, 0, 0, 1, 1 },
+        { "callback, growable buffer",          BENCH_OUT_CALLBACK, 0, 1, 0, 1, 1 },
+        { "screen (/dev/null)",                 BENCH_OUT_SCREEN,   0, 0, 0, 1, 1 },
+        { "screen (/dev/null), flush",          BENCH_OUT_SCREEN,   0, 0, 1, 1, 1 },
+        { "file",                               BENCH_OUT_FILE,     0, 0, 0, 1, 1 },
+        { "file, flush",                        BENCH_OUT_FILE,     0, 0, 1, 1, 1 },
+        { "file, keep open disabled",           BENCH_OUT_FILE,     0, 0, 0, 0, 1 },
+        { "file, heap",                         BENCH_OUT_FILE,     1, 0, 0, 1, 1 }
+    };
+
+    bench_header("Single thread, enabled lines");
+    for (i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++)
+        nStatus |= bench_lines(&cases[i]);
+
+    bench_header("Thread safe file output");
+    for (i = 1;; i = i * 2 < nMaxThreads ? i * 2 : nMaxThreads)
+    {
+        char sName[64];
+        snprintf(sName, sizeof(sName), "file, %d thread%s", i, i > 1 ? "s" : "");
+
+        bench_case_t threaded = { sName, BENCH_OUT_FILE, 0, 0, 0, 1, i };
+        nStatus |= bench_lines(&threaded);
+        if (i >= nMaxThreads) break;
+    }
+
+    printf("\nLatency percentiles are in nanoseconds and include the clock reads\n");
+    return nStatus;
+}
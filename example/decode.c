@@ -0,0 +1,40 @@
+/*
+ *  example/decode.c
+ *
+ *  2015 - 2026 (c) Sun Dro (f4tb0y@protonmail.com)
+ *
+ *  This source file is a part of the "slog" project
+ *  Read LICENSE file for more details about copyright
+ *
+ * Convert binary logs recorded with slog_bin() to text
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <slog.h>
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: %s <binary-log> [output-file]\n", argv[0]);
+        return 1;
+    }
+
+    FILE *pOutput = stdout;
+    if (argc > 2)
+    {
+        pOutput = fopen(argv[2], "w");
+        if (pOutput == NULL)
+        {
+            printf("Failed to open output file: %s (%s)\n", argv[2], strerror(errno));
+            return 1;
+        }
+    }
+
+    int nLines = slog_binary_decode(argv[1], pOutput);
+    if (pOutput != stdout) fclose(pOutput);
+
+    return nLines < 0 ? 1 : 0;
+}
@@ -13,7 +13,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <stdint.h>
+#include <stddef.h>
 #include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <signal.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/wait.h>
 #include <slog.h>
 
 #define TEST_PASSED "\033[0;32mPASSED\033[0m"
@@ -92,9 +101,109 @@ int test_heap_logging()
     return 0;
 }
 
+typedef struct {
+    const char *pLast;
+    size_t nLength;
+} heap_test_ctx_t;
+
+int heap_test_callback(const char *pLog, size_t nLength, slog_flag_t eFlag, void *pCtx)
+{
+    (void)eFlag;
+    heap_test_ctx_t *pTest = (heap_test_ctx_t*)pCtx;
+    pTest->pLast = pLog;
+    pTest->nLength = nLength;
+    return 0;
+}
+
+int test_heap_callback()
+{
+    printf("=============> Running test_heap_callback...\n");
+    heap_test_ctx_t ctx = { NULL, 0 };
+    char message[SLOG_MESSAGE_MAX * 2];
+    int failed = 0;
+
+    slog_init("heap_callback_log", SLOG_FLAGS_ALL, 0);
+    slog_use_heap_set(1);
+    slog_callback_set(heap_test_callback, &ctx);
+
+    /* Lines that fit are delivered from the same thread buffer */
+    slog_info("First short line");
+    const char *pFirst = ctx.pLast;
+    slog_info("Second short line");
+    if (pFirst == NULL || ctx.pLast != pFirst) failed = 1;
+
+    /* Larger lines are still delivered whole */
+    memset(message, 'x', sizeof(message) - 1);
+    message[sizeof(message) - 1] = '\0';
+    slog_info("%s", message);
+    if (ctx.nLength <= sizeof(message) - 1) failed = 1;
+
+    slog_destroy();
+    printf("=============> test_heap_callback %s.\n\n", failed ? TEST_FAILED : TEST_PASSED);
+    return failed;
+}
+
+void *grow_test_thread(void *arg)
+{
+    /* Buffer of the exiting thread is released by its destructor */
+    slog_info("%s", (char *)arg);
+    return NULL;
+}
+
+int test_grow_buffer()
+{
+    printf("=============> Running test_grow_buffer...\n");
+    heap_test_ctx_t ctx = { NULL, 0 };
+    size_t nLong = SLOG_MESSAGE_MAX * 2;
+    char *message = (char*)malloc(nLong * 4);
+    int failed = 0;
+
+    if (message == NULL) return 1;
+    memset(message, 'x', nLong * 4 - 1);
+    message[nLong * 4 - 1] = '\0';
+
+    slog_init("grow_buffer_log", SLOG_FLAGS_ALL, 1);
+    slog_date_format_set(SLOG_TIME_DISABLE);
+    slog_color_format_set(SLOG_COLORING_DISABLE);
+    slog_grow_buffer_set(1);
+    slog_callback_set(heap_test_callback, &ctx);
+    slog_screen_set(0);
+
+    /* Short lines do not grow the buffer */
+    slog_info("Short line %d", 1);
+    if (slog_buffer_grown() != 0) failed = 1;
+
+    /* Long line grows it once and is not truncated */
+    slog_info("%.*s", (int)nLong, message);
+    const char *pGrown = ctx.pLast;
+    if (ctx.nLength < nLong || slog_buffer_grown() != 1) failed = 1;
+
+    /* Same and shorter lines reuse the grown buffer */
+    slog_info("%.*s", (int)nLong, message);
+    if (ctx.pLast != pGrown || ctx.nLength < nLong) failed = 1;
+    slog_info("Short line %d", 2);
+    if (ctx.pLast != pGrown || slog_buffer_grown() != 1) failed = 1;
+
+    /* Even longer line grows it again */
+    slog_info("%s", message);
+    if (ctx.nLength < nLong * 4 - 1 || slog_buffer_grown() != 2) failed = 1;
+
+    pthread_t thread;
+    message[nLong] = '\0';
+    if (pthread_create(&thread, NULL, grow_test_thread, message) ||
+        pthread_join(thread, NULL)) failed = 1;
+    if (slog_buffer_grown() != 3) failed = 1;
+
+    slog_destroy();
+    free(message);
+
+    printf("=============> test_grow_buffer %s.\n\n", failed ? TEST_FAILED : TEST_PASSED);
+    return failed;
+}
+
 void *slog_test_thread(void *arg)
 {
-    slog_info((char *)arg);
+    slog_info("%s", (char *)arg);
     return NULL;
 }
 
@@ -128,6 +237,1297 @@ int test_thread_safe_logging()
     return 0;
 }
 
+#define ASYNC_TEST_THREADS 4
+#define ASYNC_TEST_LINES 1000
+
+int async_test_callback(const char *pLog, size_t nLength, slog_flag_t eFlag, void *pCtx)
+{
+    (void)pLog; (void)nLength; (void)eFlag;
+    (*(size_t*)pCtx)++; // Called only from the writer thread
+    return 0;
+}
+
+void *async_test_thread(void *arg)
+{
+    (void)arg;
+    int i;
+
+    for (i = 0; i < ASYNC_TEST_LINES; i++)
+        slog_info("Async message number %d", i);
+
+    return NULL;
+}
+
+int run_async_logging(size_t nQueueSize, slog_overflow_t eOverflow)
+{
+    pthread_t threads[ASYNC_TEST_THREADS];
+    size_t nReceived = 0;
+    int i;
+
+    slog_init_async("async_test_log", SLOG_FLAGS_ALL, nQueueSize, eOverflow);
+    slog_screen_set(0);
+    slog_callback_set(async_test_callback, &nReceived);
+
+    for (i = 0; i < ASYNC_TEST_THREADS; i++)
+        pthread_create(&threads[i], NULL, async_test_thread, NULL);
+
+    for (i = 0; i < ASYNC_TEST_THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    slog_flush_sync();
+    size_t nTotal = nReceived + slog_async_dropped();
+    slog_destroy();
+
+    return nTotal == ASYNC_TEST_THREADS * ASYNC_TEST_LINES ? 0 : 1;
+}
+
+static int g_nRestartDone = 0;
+
+void *async_restart_thread(void *arg)
+{
+    (void)arg;
+    int i = 0;
+
+    while (!__atomic_load_n(&g_nRestartDone, __ATOMIC_ACQUIRE)) slog_info("Restart message number %d", i++);
+    return NULL;
+}
+
+/* Switching the mode while other threads are logging must not touch a freed queue */
+int run_async_restart(void)
+{
+    pthread_t threads[ASYNC_TEST_THREADS];
+    int nNull = open("/dev/null", O_WRONLY);
+    int nStdout = dup(STDOUT_FILENO);
+    int i;
+
+    if (nNull < 0 || nStdout < 0) return 1;
+    fflush(stdout);
+    dup2(nNull, STDOUT_FILENO);
+
+    __atomic_store_n(&g_nRestartDone, 0, __ATOMIC_RELEASE);
+    slog_init_async("async_test_log", SLOG_FLAGS_ALL, 4, SLOG_OVERFLOW_BLOCK);
+
+    for (i = 0; i < ASYNC_TEST_THREADS; i++)
+        pthread_create(&threads[i], NULL, async_restart_thread, NULL);
+
+    for (i = 0; i < 20; i++)
+    {
+        usleep(1000);
+        if (i % 2) slog_init("async_test_log", SLOG_FLAGS_ALL, 1);
+        else slog_init_async("async_test_log", SLOG_FLAGS_ALL, 4, SLOG_OVERFLOW_DROP_OLDEST);
+    }
+
+    __atomic_store_n(&g_nRestartDone, 1, __ATOMIC_RELEASE);
+    for (i = 0; i < ASYNC_TEST_THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    slog_destroy();
+    fflush(stdout);
+    dup2(nStdout, STDOUT_FILENO);
+    close(nStdout);
+    close(nNull);
+    return 0;
+}
+
+int test_async_logging()
+{
+    printf("=============> Running test_async_logging...\n");
+    int failed = 0;
+
+    failed += run_async_logging(SLOG_ASYNC_QUEUE_SIZE, SLOG_OVERFLOW_BLOCK);
+    failed += run_async_logging(4, SLOG_OVERFLOW_DROP_NEWEST);
+    failed += run_async_logging(4, SLOG_OVERFLOW_DROP_OLDEST);
+    failed += run_async_restart();
+
+    printf("=============> test_async_logging %s.\n\n", failed ? TEST_FAILED : TEST_PASSED);
+    return failed ? 1 : 0;
+}
+
+long test_file_size(const char *pPath)
+{
+    struct stat st;
+    if (stat(pPath, &st) < 0) return -1;
+    return (long)st.st_size;
+}
+
+int test_buffered_file_logging()
+{
+    printf("=============> Running test_buffered_file_logging...\n");
+    slog_init("buffer_test_log", SLOG_FLAGS_ALL, 1);
+
+    char file_path[PATH_MAX];
+    int failed = 0;
+
+    slog_screen_set(0);
+    slog_file_set(1);
+    slog_file_buffer_set(SLOG_FILE_BUFFER_SIZE);
+    slog_flush_delay_set(50);
+
+    slog_info("Buffered line");
+    slog_get_full_path(file_path, sizeof(file_path));
+    long nStart = test_file_size(file_path);
+
+    /* Line must stay in the buffer until the deadline expires */
+    slog_info("Another buffered line");
+    if (test_file_size(file_path) != nStart) failed = 1;
+
+    usleep(300 * 1000);
+    long nFlushed = test_file_size(file_path);
+    if (nFlushed <= nStart) failed = 1;
+
+    /* Fatal lines are written immediately */
+    slog_flush_delay_set(60 * 1000);
+    slog_fatal("Fatal line");
+    if (test_file_size(file_path) <= nFlushed) failed = 1;
+
+    slog_destroy();
+    printf("=============> test_buffered_file_logging %s.\n\n", failed ? TEST_FAILED : TEST_PASSED);
+    return failed;
+}
+
+int run_mmap_logging(char *pPath, size_t nSize)
+{
+    slog_init("mmap_test_log", SLOG_FLAGS_ALL, 0);
+    slog_date_format_set(SLOG_TIME_DISABLE);
+    slog_color_format_set(SLOG_COLORING_DISABLE);
+    slog_screen_set(0);
+    slog_file_set(1);
+    slog_map_file_set(1);
+
+    slog("Mapped line %d", 1);
+    slog("Mapped line %d", 2);
+
+    slog_get_full_path(pPath, nSize);
+    slog_destroy();
+    return 0;
+}
+
+int test_mmap_logging()
+{
+    printf("=============> Running test_mmap_logging...\n");
+    char file_path[PATH_MAX];
+    char contents[128];
+    int failed = 0;
+
+    /* Second run appends to the file trimmed to its real length by the first one */
+    run_mmap_logging(file_path, sizeof(file_path));
+    remove(file_path);
+    run_mmap_logging(file_path, sizeof(file_path));
+    run_mmap_logging(file_path, sizeof(file_path));
+
+    const char *pExpected = "Mapped line 1\nMapped line 2\nMapped line 1\nMapped line 2\n";
+    FILE *log_file = fopen(file_path, "r");
+    if (log_file == NULL) failed = 1;
+    else
+    {
+        size_t nRead = fread(contents, 1, sizeof(contents) - 1, log_file);
+        contents[nRead] = '\0';
+        if (strcmp(contents, pExpected)) failed = 1;
+        fclose(log_file);
+    }
+
+    printf("=============> test_mmap_logging %s.\n\n", failed ? TEST_FAILED : TEST_PASSED);
+    return failed;
+}
+
+int instance_test_callback(const char *pLog, size_t nLength, slog_flag_t eFlag, void *pCtx)
+{
+    (void)pLog; (void)nLength; (void)eFlag;
+    (*(int*)pCtx)++;
+    return 0;
+}
+
+int test_multiple_instances()
+{
+    printf("=============> Running test_multiple_instances...\n");
+    int nFirst = 0, nSecond = 0, nThird = 0;
+    int failed = 0;
+
+    slog_t *pFirst = slog_create("first_test_log", SLOG_FLAGS_ALL, 1);
+    slog_t *pSecond = slog_create("second_test_log", SLOG_ERROR, 1);
+    if (pFirst == NULL || pSecond == NULL) return 1;
+
+    slog_screen_set_ex(pFirst, 0);
+    slog_screen_set_ex(pSecond, 0);
+    slog_callback_set_ex(pFirst, instance_test_callback, &nFirst);
+    slog_callback_set_ex(pSecond, instance_test_callback, &nSecond);
+
+    slog_info_ex(pFirst, "Info line");
+    slog_info_ex(pSecond, "Filtered info line");
+    slog_error_ex(pFirst, "Error line");
+    slog_error_ex(pSecond, "Error line");
+    if (nFirst != 2 || nSecond != 1) failed = 1;
+
+    /* Configuration changes must not leak between the instances */
+    slog_disable_ex(pFirst, SLOG_FLAGS_ALL);
+    slog_info_ex(pFirst, "Disabled line");
+    slog_error_ex(pSecond, "Error line");
+    if (nFirst != 2 || nSecond != 2) failed = 1;
+
+    /* A new instance may reuse the address of the freed one */
+    slog_free(pFirst);
+    pFirst = slog_create("first_test_log", SLOG_FLAGS_ALL, 1);
+    slog_screen_set_ex(pFirst, 0);
+    slog_callback_set_ex(pFirst, instance_test_callback, &nThird);
+    slog_info_ex(pFirst, "Info line");
+    if (nFirst != 2 || nThird != 1) failed = 1;
+
+    slog_free(pFirst);
+    slog_free(pSecond);
+
+    printf("=============> test_multiple_instances %s.\n\n", failed ? TEST_FAILED : TEST_PASSED);
+    return failed;
+}
+
+int test_sink_logging()
+{
+    printf("=============> Running test_sink_logging...\n");
+    char contents[256];
+    int nErrors = 0;
+    int failed = 0;
+    int fds[2];
+
+    if (pipe(fds) < 0) return 1;
+    slog_init("sink_test_log", SLOG_FLAGS_ALL, 1);
+    slog_date_format_set(SLOG_TIME_DISABLE);
+    slog_screen_set(0);
+
+    slog_sink_t ring = { SLOG_SINK_RING, SLOG_FLAGS_ALL, 0, 0, NULL, -1, NULL, NULL, 40 };
+    slog_sink_t errors = { SLOG_SINK_CALLBACK, SLOG_ERROR, 1, 0, NULL, -1, instance_test_callback, &nErrors, 0 };
+    slog_sink_t pipe_out = { SLOG_SINK_FD, SLOG_INFO, 1, 0, NULL, fds[1], NULL, NULL, 0 };
+
+    int nRing = slog_sink_add(&ring);
+    if (nRing < 0 || slog_sink_add(&errors) < 0 || slog_sink_add(&pipe_out) < 0) failed = 1;
+
+    slog_info("Info line");
+    slog_error("Error line");
+    slog_note("Note line");
+
+    /* Ring keeps the latest complete lines without color sequences */
+    slog_sink_read(nRing, contents, sizeof(contents));
+    if (strcmp(contents, "<error> Error line\n<note> Note line\n")) failed = 1;
+    if (nErrors != 1) failed = 1;
+
+    ssize_t nRead = read(fds[0], contents, sizeof(contents) - 1);
+    contents[nRead > 0 ? nRead : 0] = '\0';
+    if (strstr(contents, "Info line") == NULL || strstr(contents, "Error line") != NULL) failed = 1;
+
+    /* Global flags still apply to every sink */
+    slog_disable(SLOG_ERROR);
+    slog_error("Disabled error line");
+    if (nErrors != 1) failed = 1;
+
+    slog_destroy();
+    close(fds[0]);
+    close(fds[1]);
+
+    printf("=============> test_sink_logging %s.\n\n", failed ? TEST_FAILED : TEST_PASSED);
+    return failed;
+}
+
+int binary_test_callback(const char *pLog, size_t nLength, slog_flag_t eFlag, void *pCtx)
+{
+    (void)eFlag;
+    strncat((char*)pCtx, pLog, nLength);
+    return 0;
+}
+
+void log_binary_lines(void)
+{
+    int i;
+    for (i = 0; i < 3; i++)
+    {
+        slog_bin(SLOG_INFO, "Line %d: %s %5.2f %-*d|%.*s| %zu %lld %c %x %%", i, "text",
+            3.14159 * i, 6, -i, 3, "truncated", (size_t)i * 1000, -1234567890123LL, 'a' + i, 255);
+        slog_bin(SLOG_WARN, "No arguments");
+    }
+}
+
+int test_binary_logging()
+{
+    printf("=============> Running test_binary_logging...\n");
+    char expected[2048] = { 0 };
+    char decoded[2048] = { 0 };
+    const char *pBinPath = "binary_test_log.bin";
+    const char *pTextPath = "binary_test_log.txt";
+    int failed = 0;
+
+    remove(pBinPath);
+    slog_init("binary_test_log", SLOG_FLAGS_ALL, 1);
+    slog_date_format_set(SLOG_TIME_DISABLE);
+    slog_screen_set(0);
+
+    /* Without the binary file the lines are formatted as usual */
+    slog_callback_set(binary_test_callback, expected);
+    log_binary_lines();
+    slog_callback_set(NULL, NULL);
+
+    /* Binary lines are counted and the recorded levels reach the ring as text */
+    slog_stats_t stats;
+    slog_stats_get(&stats);
+    uint64_t nInfoLines = stats.nLines[2];
+
+    remove("binary_test_log.dump");
+    if (!slog_binary_open(pBinPath) || !slog_recorder_set(SLOG_INFO, 4096, "binary_test_log.dump")) failed = 1;
+    log_binary_lines();
+    slog_stats_get(&stats);
+    if (stats.nLines[2] - nInfoLines != 3 || !slog_dump_recent(NULL)) failed = 1;
+    slog_destroy();
+
+    char dump[1024] = { 0 };
+    FILE *pDump = fopen("binary_test_log.dump", "r");
+    if (pDump == NULL) failed = 1;
+    else
+    {
+        size_t nRead = fread(dump, 1, sizeof(dump) - 1, pDump);
+        dump[nRead] = '\0';
+        fclose(pDump);
+    }
+
+    if (!strstr(dump, "Line 2: text  6.28") || strstr(dump, "No arguments")) failed = 1;
+
+    FILE *pOutput = fopen(pTextPath, "w");
+    if (pOutput == NULL || slog_binary_decode(pBinPath, pOutput) != 6) failed = 1;
+    if (pOutput != NULL) fclose(pOutput);
+
+    FILE *pInput = fopen(pTextPath, "r");
+    if (pInput == NULL) failed = 1;
+    else
+    {
+        size_t nRead = fread(decoded, 1, sizeof(decoded) - 1, pInput);
+        decoded[nRead] = '\0';
+        fclose(pInput);
+    }
+
+    if (strcmp(expected, decoded)) failed = 1;
+    printf("=============> test_binary_logging %s.\n\n", failed ? TEST_FAILED : TEST_PASSED);
+    return failed;
+}
+
+int test_structured_logging()
+{
+    printf("=============> Running test_structured_logging...\n");
+    char output[1024] = { 0 };
+    int failed = 0;
+
+    slog_init("struct_test_log", SLOG_FLAGS_ALL, 0);
+    slog_date_format_set(SLOG_TIME_DISABLE);
+    slog_callback_set(binary_test_callback, output);
+    slog_screen_set(0);
+
+    slog_format_set(SLOG_FORMAT_JSON);
+    slog_info("Quote \" and\ttab");
+    if (strcmp(output, "{\"level\":\"info\",\"msg\":\"Quote \\\" and\\ttab\"}\n")) failed = 1;
+
+    output[0] = '\0';
+    slog_format_set(SLOG_FORMAT_LOGFMT);
+    SLOG_KV(SLOG_WARN, "Done", slog_kv_str("user", "John Doe"), slog_kv_int("code", -7), slog_kv_bool("ok", 1));
+    if (strstr(output, "level=warn file=") != output ||
+        strstr(output, " msg=Done user=\"John Doe\" code=-7 ok=true\n") == NULL) failed = 1;
+
+    /* Keys which would break the pair are sanitized */
+    output[0] = '\0';
+    SLOG_KV(SLOG_WARN, "Keys", slog_kv_str("a b", "x y"), slog_kv_str("q=", "v"), slog_kv_int("\"k\"", 1));
+    if (strstr(output, " msg=Keys a_b=\"x y\" q_=v _k_=1\n") == NULL) failed = 1;
+
+    /* Timestamps carry the UTC offset of the local time (RFC 3339) */
+    char zone[32];
+    time_t nNow = time(NULL);
+    struct tm tm;
+
+    output[0] = '\0';
+    localtime_r(&nNow, &tm);
+    slog_date_format_set(SLOG_TIME_ONLY);
+    slog_format_set(SLOG_FORMAT_JSON);
+    slog_info("Zoned");
+    slog_date_format_set(SLOG_TIME_DISABLE);
+
+    long nOffset = tm.tm_gmtoff / 60;
+    if (!nOffset) snprintf(zone, sizeof(zone), "Z\"");
+    else snprintf(zone, sizeof(zone), "%c%02ld:%02ld\"", nOffset < 0 ? '-' : '+', labs(nOffset) / 60, labs(nOffset) % 60);
+    if (strncmp(output, "{\"time\":\"", 9) || output[19] != 'T' ||
+        strncmp(output + 32, zone, strlen(zone))) failed = 1;
+
+    output[0] = '\0';
+    slog_format_set(SLOG_FORMAT_TEXT);
+    slog_color_format_set(SLOG_COLORING_DISABLE);
+    slog_kv(SLOG_INFO, "Done", slog_kv_uint("bytes", 1024), slog_kv_float("ms", 1.5));
+    if (strcmp(output, "<info> Done bytes=1024 ms=1.5\n")) failed = 1;
+
+    slog_destroy();
+    printf("=============> test_structured_logging %s.\n\n", failed ? TEST_FAILED : TEST_PASSED);
+    return failed;
+}
+
+/* Remove the active file and every archive of the log, counts would include older runs */
+static void size_test_cleanup(const char *pName)
+{
+    char sPrefix[64];
+    struct dirent *pEntry;
+
+    snprintf(sPrefix, sizeof(sPrefix), "%s.log", pName);
+    remove(sPrefix);
+    snprintf(sPrefix, sizeof(sPrefix), "%s-", pName);
+
+    DIR *pDir = opendir(".");
+    if (pDir == NULL) return;
+
+    while ((pEntry = readdir(pDir)) != NULL)
+        if (!strncmp(pEntry->d_name, sPrefix, strlen(sPrefix))) remove(pEntry->d_name);
+
+    closedir(pDir);
+}
+
+int test_size_rotation()
+{
+    printf("=============> Running test_size_rotation...\n");
+    unsigned int nYear, nMonth, nDay, nSegment, nMin = UINT_MAX, nMax = 0;
+    int failed = 0, nArchives = 0, i;
+    struct stat statBuf;
+    struct dirent *pEntry;
+    char sSuffix[32];
+
+    size_test_cleanup("size_test_log");
+    size_test_cleanup("burst_test_log");
+    slog_init("size_test_log", SLOG_FLAGS_ALL, 1);
+    slog_date_format_set(SLOG_TIME_DISABLE);
+    slog_max_file_size_set(100);
+    slog_max_archives_set(3);
+    slog_screen_set(0);
+    slog_file_set(1);
+
+    for (i = 0; i < 20; i++) slog_info("Size rotation line %02d", i);
+    slog_destroy(); /* Waits for the archiver */
+
+    DIR *pDir = opendir(".");
+    if (pDir == NULL) failed = 1;
+
+    while (pDir != NULL && (pEntry = readdir(pDir)) != NULL)
+    {
+        if (sscanf(pEntry->d_name, "size_test_log-%4u-%2u-%2u.%u%31s",
+            &nYear, &nMonth, &nDay, &nSegment, sSuffix) != 5 || strcmp(sSuffix, ".log")) continue;
+
+        if (stat(pEntry->d_name, &statBuf) < 0 || statBuf.st_size < 100) failed = 1;
+        if (nSegment < nMin) nMin = nSegment;
+        if (nSegment > nMax) nMax = nSegment;
+        nArchives++;
+    }
+
+    if (pDir != NULL) closedir(pDir);
+
+    /* Only the three newest segments are kept and the active file is below the limit */
+    if (nArchives != 3 || nMax - nMin != 2 || nMax < 4) failed = 1;
+    if (stat("size_test_log.log", &statBuf) < 0 || statBuf.st_size >= 100) failed = 1;
+
+    /* Burst of rotations, every segment is compressed even if the archiver falls behind */
+    if (system("gzip --version > /dev/null 2>&1") == 0)
+    {
+        int nPlain = 0, nCompressed = 0;
+
+        slog_init("burst_test_log", SLOG_FLAGS_ALL, 1);
+        slog_date_format_set(SLOG_TIME_DISABLE);
+        slog_max_file_size_set(100);
+        slog_compress_set(SLOG_COMPRESS_GZIP);
+        slog_screen_set(0);
+        slog_file_set(1);
+
+        for (i = 0; i < 100; i++) slog_info("Burst rotation line %02d", i);
+        slog_destroy();
+
+        pDir = opendir(".");
+        while (pDir != NULL && (pEntry = readdir(pDir)) != NULL)
+        {
+            if (sscanf(pEntry->d_name, "burst_test_log-%4u-%2u-%2u.%u%31s",
+                &nYear, &nMonth, &nDay, &nSegment, sSuffix) != 5) continue;
+
+            if (!strcmp(sSuffix, ".log")) nPlain++;
+            else if (!strcmp(sSuffix, ".log.gz")) nCompressed++;
+        }
+
+        if (pDir != NULL) closedir(pDir);
+        if (nPlain || nCompressed < 20) failed = 1;
+    }
+
+    size_test_cleanup("size_test_log");
+    size_test_cleanup("burst_test_log");
+
+    printf("=============> test_size_rotation %s.\n\n", failed ? TEST_FAILED : TEST_PASSED);
+    return failed;
+}
+
+int test_external_rotation()
+{
+    printf("=============> Running test_external_rotation...\n");
+    char moved[256] = { 0 };
+    char active[256] = { 0 };
+    int failed = 0;
+
+    /* Files of a previous run would be appended to */
+    remove("reopen_test_log.log");
+    remove("reopen_test_log.moved");
+    slog_init("reopen_test_log", SLOG_FLAGS_ALL, 1);
+    slog_date_format_set(SLOG_TIME_DISABLE);
+    slog_screen_set(0);
+
+    slog_config_t config;
+    slog_config_get(&config);
+    config.nKeepOpen = 0;
+    config.nToFile = 1;
+    slog_config_set(&config);
+
+    /* Simulate logrotate, the next path check must follow the new file */
+    slog_info("Before rotation");
+    if (rename("reopen_test_log.log", "reopen_test_log.moved") < 0) failed = 1;
+    usleep(1100 * 1000);
+    slog_info("After rotation");
+
+    FILE *pFile = fopen("reopen_test_log.moved", "r");
+    if (pFile == NULL) failed = 1;
+    else
+    {
+        if (fread(moved, 1, sizeof(moved) - 1, pFile) == 0) failed = 1;
+        fclose(pFile);
+    }
+
+    /* Without keep open the line is in the file before the destroy */
+    pFile = fopen("reopen_test_log.log", "r");
+    if (pFile == NULL) failed = 1;
+    else
+    {
+        if (fread(active, 1, sizeof(active) - 1, pFile) == 0) failed = 1;
+        fclose(pFile);
+    }
+
+    slog_destroy();
+
+    if (strstr(moved, "Before rotation") == NULL || strstr(moved, "After rotation") != NULL) failed = 1;
+    if (strstr(active, "After rotation") == NULL || strstr(active, "Before rotation") != NULL) failed = 1;
+
+    remove("reopen_test_log.log");
+    remove("reopen_test_log.moved");
+
+    printf("=============> test_external_rotation %s.\n\n", failed ? TEST_FAILED : TEST_PASSED);
+    return failed;
+}
+
+static void reopen_test_handler(int nSignal)
+{
+    (void)nSignal;
+    slog_reopen();
+}
+
+static int reopen_test_read(const char *pPath, char *pOutput, size_t nSize)
+{
+    FILE *pFile = fopen(pPath, "r");
+    if (pFile == NULL) return 0;
+
+    size_t nRead = fread(pOutput, 1, nSize - 1, pFile);
+    pOutput[nRead] = '\0';
+    fclose(pFile);
+    return 1;
+}
+
+int test_reopen_logging()
+{
+    printf("=============> Running test_reopen_logging...\n");
+    char signaled[256] = { 0 };
+    char checked[256] = { 0 };
+    char active[256] = { 0 };
+    int failed = 0;
+
+    remove("hup_test_log.log");
+    slog_init("hup_test_log", SLOG_FLAGS_ALL, 1);
+    slog_date_format_set(SLOG_TIME_DISABLE);
+    slog_color_format_set(SLOG_COLORING_DISABLE);
+    slog_screen_set(0);
+    slog_file_set(1);
+
+    /* Rotation by logrotate with a SIGHUP in postrotate */
+    signal(SIGHUP, reopen_test_handler);
+    slog_info("Before signal");
+    if (rename("hup_test_log.log", "hup_test_log.signaled") < 0) failed = 1;
+    raise(SIGHUP);
+    slog_info("After signal");
+    signal(SIGHUP, SIG_DFL);
+
+    /* Rotation noticed by the periodic inode check */
+    slog_reopen_check_set(10);
+    if (rename("hup_test_log.log", "hup_test_log.checked") < 0) failed = 1;
+    usleep(20 * 1000);
+    slog_info("After check");
+    slog_destroy();
+
+    if (!reopen_test_read("hup_test_log.signaled", signaled, sizeof(signaled)) ||
+        !reopen_test_read("hup_test_log.checked", checked, sizeof(checked)) ||
+        !reopen_test_read("hup_test_log.log", active, sizeof(active))) failed = 1;
+
+    if (strcmp(signaled, "<info> Before signal\n") ||
+        strcmp(checked, "<info> After signal\n") ||
+        strcmp(active, "<info> After check\n")) failed = 1;
+
+    printf("=============> test_reopen_logging %s.\n\n", failed ? TEST_FAILED : TEST_PASSED);
+    return failed;
+}
+
+int test_thread_name()
+{
+    printf("=============> Running test_thread_name...\n");
+    char output[256] = { 0 };
+    char expected[64];
+    int failed = 0;
+
+    slog_init("thread_test_log", SLOG_FLAGS_ALL, 0);
+    slog_date_format_set(SLOG_TIME_DISABLE);
+    slog_color_format_set(SLOG_COLORING_DISABLE);
+    slog_callback_set(binary_test_callback, output);
+    slog_trace_tid_set(1);
+    slog_screen_set(0);
+
+    slog_thread_name_set("main-loop");
+    slog_info("Named");
+    if (strcmp(output, "(main-loop) <info> Named\n")) failed = 1;
+
+    output[0] = '\0';
+    slog_thread_name_set(NULL);
+    slog_info("Unnamed");
+    if (output[0] != '(' || output[1] < '1' || output[1] > '9') failed = 1;
+
+#ifdef __linux__
+    /* Child of fork must not reuse the cached id of the parent thread */
+    int nPipe[2];
+    if (pipe(nPipe) < 0) failed = 1;
+
+    pid_t nPid = fork();
+    if (nPid == 0)
+    {
+        output[0] = '\0';
+        slog_info("Child");
+        ssize_t nWritten = write(nPipe[1], output, strlen(output));
+        _exit(nWritten > 0 ? 0 : 1);
+    }
+
+    memset(output, 0, sizeof(output));
+    waitpid(nPid, NULL, 0);
+    if (read(nPipe[0], output, sizeof(output) - 1) <= 0) failed = 1;
+    close(nPipe[0]);
+    close(nPipe[1]);
+
+    snprintf(expected, sizeof(expected), "(%d) <info> Child\n", (int)nPid);
+    if (strcmp(output, expected)) failed = 1;
+#else
+    (void)expected;
+#endif
+
+    slog_destroy();
+    printf("=============> test_thread_name %s.\n\n", failed ? TEST_FAILED : TEST_PASSED);
+    return failed;
+}
+
+static size_t count_lines(const char *pText, const char *pNeedle)
+{
+    size_t nCount = 0;
+    const char *pPos = pText;
+
+    while ((pPos = strstr(pPos, pNeedle)) != NULL)
+    {
+        pPos += strlen(pNeedle);
+        nCount++;
+    }
+
+    return nCount;
+}
+
+static void *repeat_test_thread(void *pArg)
+{
+    int i;
+    (void)pArg;
+
+    for (i = 0; i < 3; i++)
+    {
+        slog_error("Deadline line");
+        usleep(10 * 1000);
+    }
+
+    return NULL;
+}
+
+static uint64_t repeat_test_lines(void)
+{
+    slog_stats_t stats;
+    uint64_t nLines = 0;
+    int i;
+
+    slog_stats_get(&stats);
+    for (i = 0; i < SLOG_LEVEL_COUNT; i++) nLines += stats.nLines[i];
+    return nLines;
+}
+
+int test_rate_limiting()
+{
+    printf("=============> Running test_rate_limiting...\n");
+    char *output = (char*)calloc(1, SLOG_MESSAGE_MAX * 4);
+    int failed = 0, i;
+
+    if (output == NULL) return 1;
+    slog_init("rate_limit_log", SLOG_FLAGS_ALL, 1);
+    slog_color_format_set(SLOG_COLORING_DISABLE);
+    slog_callback_set(binary_test_callback, output);
+    slog_screen_set(0);
+
+    /* Every 10th call of the site */
+    for (i = 0; i < 100; i++) slog_info_every_n(10, "every n %d", i);
+    if (count_lines(output, "every n") != 10 || !strstr(output, "every n 0\n") ||
+        !strstr(output, "every n 90\n") || strstr(output, "every n 5\n")) failed = 1;
+
+    /* Burst of 5, then one line per 200 ms with the number of dropped ones */
+    output[0] = '\0';
+    for (i = 0; i <= 1000; i++)
+    {
+        if (i == 1000)
+        {
+            if (count_lines(output, "limited") != 5) failed = 1;
+            output[0] = '\0';
+            usleep(250 * 1000);
+        }
+
+        slog_warn_ratelimited(5, "limited %d", i);
+    }
+
+    if (!strstr(output, "Suppressed 995 messages from") || count_lines(output, "limited 1000\n") != 1) failed = 1;
+
+    /* Repeated lines collapse even if their timestamps differ */
+    output[0] = '\0';
+    slog_collapse_set(1);
+    for (i = 0; i < 5; i++)
+    {
+        slog_error("Connection refused");
+        usleep(2000);
+    }
+    slog_error("Connection restored");
+    slog_error("Connection restored");
+    if (count_lines(output, "Connection refused") != 1 ||
+        count_lines(output, "Last message repeated 4 times") != 1 ||
+        count_lines(output, "Connection restored") != 1) failed = 1;
+
+    /* Flush reports the pending repeats */
+    slog_flush_sync();
+    if (count_lines(output, "Last message repeated 1 times") != 1) failed = 1;
+
+    /* Level is a part of the compared line */
+    output[0] = '\0';
+    slog_info("Same text");
+    slog_warn("Same text");
+    if (count_lines(output, "Same text") != 2) failed = 1;
+
+    /* Structured lines too */
+    output[0] = '\0';
+    slog_format_set(SLOG_FORMAT_JSON);
+    slog_info("json line");
+    slog_info("json line");
+    slog_info("json other");
+    if (count_lines(output, "json line") != 1 ||
+        count_lines(output, "\"msg\":\"Last message repeated 1 times\"") != 1) failed = 1;
+
+    /* Without another line the repeats are displayed after the deadline,
+     * with the thread and the time of the last repeat, not of the flusher */
+    output[0] = '\0';
+    slog_format_set(SLOG_FORMAT_TEXT);
+    slog_date_format_set(SLOG_TIME_ONLY);
+    slog_trace_tid_set(1);
+
+    pthread_t thread;
+    uint64_t nLines = repeat_test_lines();
+    if (pthread_create(&thread, NULL, repeat_test_thread, NULL) || pthread_join(thread, NULL)) failed = 1;
+    usleep((SLOG_REPEAT_DELAY + 500) * 1000);
+
+    size_t nTid = 0, nNoticeTid = 1;
+    unsigned int nHour, nMin, nSec, nMsec, nTime = 0, nNoticeTime = 0;
+    const char *pNotice = strstr(output, "\n");
+
+    if (repeat_test_lines() - nLines != 2 || pNotice == NULL ||
+        !strstr(pNotice, "Last message repeated 2 times")) failed = 1;
+    if (sscanf(output, "(%zu) %u:%u:%u.%u", &nTid, &nHour, &nMin, &nSec, &nMsec) == 5)
+        nTime = ((nHour * 60 + nMin) * 60 + nSec) * 1000 + nMsec;
+    if (pNotice != NULL && sscanf(pNotice + 1, "(%zu) %u:%u:%u.%u", &nNoticeTid, &nHour, &nMin, &nSec, &nMsec) == 5)
+        nNoticeTime = ((nHour * 60 + nMin) * 60 + nSec) * 1000 + nMsec;
+    if (nTid != nNoticeTid || (nNoticeTime + 86400000 - nTime) % 86400000 > 500) failed = 1;
+
+    slog_destroy();
+    free(output);
+
+    printf("=============> test_rate_limiting %s.\n\n", failed ? TEST_FAILED : TEST_PASSED);
+    return failed;
+}
+
+/* Number of received lines per level, the context holds one counter per flag bit */
+int count_test_callback(const char *pLog, size_t nLength, slog_flag_t eFlag, void *pCtx)
+{
+    size_t *pCounts = (size_t*)pCtx;
+    int i;
+
+    (void)pLog;
+    (void)nLength;
+
+    for (i = 0; i < SLOG_LEVEL_COUNT; i++)
+        if (eFlag == (slog_flag_t)(1 << i)) pCounts[i]++;
+
+    return 0;
+}
+
+static size_t count_test_lines(const size_t *pCounts, slog_flag_t eFlag)
+{
+    int i;
+
+    for (i = 0; i < SLOG_LEVEL_COUNT; i++)
+        if (eFlag == (slog_flag_t)(1 << i)) return pCounts[i];
+
+    return 0;
+}
+
+int test_sampling()
+{
+    printf("=============> Running test_sampling...\n");
+    size_t output[SLOG_LEVEL_COUNT] = { 0 };
+    int failed = 0, i;
+
+    slog_init("sampling_log", SLOG_FLAGS_ALL, 1);
+    slog_callback_set(count_test_callback, output);
+    slog_screen_set(0);
+
+    /* Exactly one of 10 debug lines, other levels are not affected */
+    slog_sample_set(SLOG_DEBUG, 10);
+    for (i = 0; i < 1000; i++) slog_debug("sampled %d", i);
+    for (i = 0; i < 100; i++) slog_info("not sampled %d", i);
+
+    if (count_test_lines(output, SLOG_DEBUG) != 100 || slog_sampled_out(SLOG_DEBUG) != 900 ||
+        count_test_lines(output, SLOG_INFO) != 100 || slog_sampled_out(SLOG_INFO) != 0) failed = 1;
+
+    /* Probabilistic rate, kept and dropped lines add up to the total */
+    slog_sample_rate_set(SLOG_TRACE | SLOG_NOTE, 0.25);
+    for (i = 0; i < 40000; i++) slog_trace("random %d", i);
+
+    size_t nKept = count_test_lines(output, SLOG_TRACE);
+    if (nKept < 9000 || nKept > 11000 || nKept + slog_sampled_out(SLOG_TRACE) != 40000) failed = 1;
+
+    /* Zero rate drops everything, zero interval disables the sampling */
+    slog_sample_rate_set(SLOG_NOTE, 0.0);
+    for (i = 0; i < 10; i++) slog_note("dropped %d", i);
+    slog_sample_set(SLOG_DEBUG, 0);
+    for (i = 0; i < 10; i++) slog_debug("kept %d", i);
+
+    if (count_test_lines(output, SLOG_NOTE) != 0 || slog_sampled_out(SLOG_NOTE) != 10 ||
+        count_test_lines(output, SLOG_DEBUG) != 110) failed = 1;
+    if (slog_sampled_out(SLOG_FLAGS_ALL) != 900 + 40000 - nKept + 10) failed = 1;
+    slog_destroy();
+
+    /* Instances logging alternately from one thread keep their own counters */
+    size_t first[SLOG_LEVEL_COUNT] = { 0 }, second[SLOG_LEVEL_COUNT] = { 0 };
+    slog_t *pFirst = slog_create("sampling_first", SLOG_FLAGS_ALL, 1);
+    slog_t *pSecond = slog_create("sampling_second", SLOG_FLAGS_ALL, 1);
+    if (pFirst == NULL || pSecond == NULL) return 1;
+
+    slog_callback_set_ex(pFirst, count_test_callback, first);
+    slog_callback_set_ex(pSecond, count_test_callback, second);
+    slog_screen_set_ex(pFirst, 0);
+    slog_screen_set_ex(pSecond, 0);
+    slog_sample_set_ex(pFirst, SLOG_DEBUG, 2);
+    slog_sample_set_ex(pSecond, SLOG_DEBUG, 2);
+
+    for (i = 0; i < 1000; i++)
+    {
+        slog_debug_ex(pFirst, "first %d", i);
+        slog_debug_ex(pSecond, "second %d", i);
+    }
+
+    if (count_test_lines(first, SLOG_DEBUG) != 500 || count_test_lines(second, SLOG_DEBUG) != 500) failed = 1;
+    slog_free(pFirst);
+    slog_free(pSecond);
+
+    printf("=============> test_sampling %s.\n\n", failed ? TEST_FAILED : TEST_PASSED);
+    return failed;
+}
+
+int test_flight_recorder()
+{
+    printf("=============> Running test_flight_recorder...\n");
+    size_t output[SLOG_LEVEL_COUNT] = { 0 };
+    char dump[16384];
+    int failed = 0, i, status = 0;
+
+    remove("recorder.dump");
+    remove("recorder_wrap.dump");
+    remove("recorder_crash.dump");
+
+    slog_init("recorder_log", SLOG_WARN | SLOG_ERROR | SLOG_FATAL, 1);
+    slog_callback_set(count_test_callback, output);
+    slog_screen_set(0);
+
+    /* Filtered levels are recorded but not displayed */
+    if (!slog_recorder_set(SLOG_FLAGS_ALL, 4096, "recorder.dump")) failed = 1;
+    if (!slog_is_enabled(SLOG_DEBUG)) failed = 1;
+    for (i = 0; i < 5; i++) slog_debug("recorded %d", i);
+    slog_warn("displayed and recorded");
+
+    if (count_test_lines(output, SLOG_DEBUG) != 0 || count_test_lines(output, SLOG_WARN) != 1) failed = 1;
+    if (!slog_dump_recent(NULL) || !reopen_test_read("recorder.dump", dump, sizeof(dump))) failed = 1;
+    if (!strstr(dump, "(request)") || count_lines(dump, "recorded ") != 5 ||
+        !strstr(dump, "displayed and recorded") || strchr(dump, '\x1B') != NULL) failed = 1;
+
+    /* Only the newest lines are kept, the partly overwritten one is skipped */
+    for (i = 0; i < 1000; i++) slog_trace("wrapped %04d", i);
+    if (!slog_dump_recent("recorder_wrap.dump") || !reopen_test_read("recorder_wrap.dump", dump, sizeof(dump))) failed = 1;
+
+    const char *pFirst = strchr(dump, '\n');
+    if (!strstr(dump, "wrapped 0999") || strstr(dump, "wrapped 0000") ||
+        strstr(dump, "recorded ") || pFirst == NULL || pFirst[1] < '0' || pFirst[1] > '9') failed = 1;
+
+    /* Fatal line is followed by the dump */
+    slog_fatal("fatal line");
+    if (!reopen_test_read("recorder.dump", dump, sizeof(dump)) ||
+        !strstr(dump, "(fatal)") || !strstr(strstr(dump, "(fatal)"), "fatal line")) failed = 1;
+
+    /* Resizing without a path keeps the dump path */
+    if (!slog_recorder_set(SLOG_FLAGS_ALL, 8192, NULL)) failed = 1;
+    slog_debug("resized ring");
+    if (!slog_dump_recent(NULL) || !reopen_test_read("recorder.dump", dump, sizeof(dump)) ||
+        !strstr(dump, "resized ring")) failed = 1;
+
+    /* Crash handler dumps the ring and lets the signal kill the process */
+    pid_t nPid = fork();
+    if (nPid == 0)
+    {
+        signal(SIGABRT, SIG_DFL);
+        slog_recorder_set(SLOG_FLAGS_ALL, 4096, "recorder_crash.dump");
+        slog_crash_handler_set(1);
+        slog_debug("before crash");
+        raise(SIGABRT);
+        _exit(0);
+    }
+
+    if (nPid < 0 || waitpid(nPid, &status, 0) != nPid ||
+        !WIFSIGNALED(status) || WTERMSIG(status) != SIGABRT) failed = 1;
+    if (!reopen_test_read("recorder_crash.dump", dump, sizeof(dump)) ||
+        !strstr(dump, "(signal)") || !strstr(dump, "before crash")) failed = 1;
+
+    /* Disabled recorder does not keep the filtered levels enabled */
+    slog_recorder_set(0, 0, NULL);
+    if (slog_is_enabled(SLOG_DEBUG) || slog_dump_recent("recorder_wrap.dump")) failed = 1;
+
+    slog_destroy();
+    printf("=============> test_flight_recorder %s.\n\n", failed ? TEST_FAILED : TEST_PASSED);
+    return failed;
+}
+
+static int reject_test_callback(const char *pLog, size_t nLength, slog_flag_t eFlag, void *pCtx)
+{
+    (void)pLog;
+    (void)nLength;
+    (void)eFlag;
+    (void)pCtx;
+    return -1;
+}
+
+int test_stats()
+{
+    printf("=============> Running test_stats...\n");
+    size_t output[SLOG_LEVEL_COUNT] = { 0 };
+    char message[SLOG_MESSAGE_MAX + 16];
+    slog_stats_t stats;
+    uint64_t nWaits = 0;
+    int failed = 0, i;
+
+    remove("stats_log.log");
+    slog_init("stats_log", SLOG_INFO | SLOG_ERROR, 1);
+    slog_callback_set(count_test_callback, output);
+    slog_screen_set(0);
+    slog_stats_filtered_set(1);
+
+    slog_sink_t ring = { SLOG_SINK_RING, SLOG_ERROR, 0, 0, NULL, -1, NULL, NULL, 4096 };
+    int nSink = slog_sink_add(&ring);
+
+    /* Filtered calls are counted through the macros and the direct calls */
+    for (i = 0; i < 10; i++) slog_info("stats %d", i);
+    for (i = 0; i < 3; i++) slog_error("error %d", i);
+    for (i = 0; i < 5; i++) slog_debug("filtered %d", i);
+    slog_display(SLOG_TRACE, 1, "filtered directly");
+    slog_display(SLOG_TRACE, 1, "filtered directly");
+
+    memset(message, 'x', sizeof(message) - 1);
+    message[sizeof(message) - 1] = '\0';
+    slog_info("%s", message);
+
+    /* File output, collapsed repeats (their notice is an error line too) and rejected lines */
+    slog_file_set(1);
+    slog_info("to file");
+    slog_file_set(0);
+
+    slog_collapse_set(1);
+    for (i = 0; i < 5; i++) slog_error("same line");
+    slog_collapse_set(0);
+
+    slog_callback_set(reject_test_callback, NULL);
+    slog_info("rejected");
+
+    slog_stats_get(&stats);
+    for (i = 0; i < SLOG_STATS_BUCKETS; i++) nWaits += stats.nLockWaits[i];
+
+    if (stats.nLines[2] != 13 || stats.nLines[6] != 5 || stats.nFiltered[4] != 5 ||
+        stats.nFiltered[5] != 2 || stats.nFiltered[2] != 0 || stats.nTruncated != 1) failed = 1;
+    if (nSink < 0 || stats.nSinkBytes[nSink] == 0 || stats.nFileOpens != 1 ||
+        stats.nFileBytes == 0 || stats.nScreenBytes != 0 || stats.nWriteErrors != 0) failed = 1;
+    if (stats.nCollapsed != 4 || stats.nRejected != 1 || nWaits == 0) failed = 1;
+
+    slog_destroy();
+    printf("=============> test_stats %s.\n\n", failed ? TEST_FAILED : TEST_PASSED);
+    return failed;
+}
+
+int test_profile()
+{
+    printf("=============> Running test_profile...\n");
+    size_t output[SLOG_LEVEL_COUNT] = { 0 };
+    char dump[65536];
+    int failed = 0, i;
+
+    FILE *pOutput = tmpfile();
+    if (pOutput == NULL) return 1;
+
+    slog_init("profile_log", SLOG_FLAGS_ALL, 1);
+    slog_callback_set(count_test_callback, output);
+    slog_screen_set(0);
+
+    /* Histograms are filled only by the profiling build */
+    slog_profile_reset();
+    for (i = 0; i < 100; i++) slog_info("profiled %d", i);
+    uint8_t nProfiled = slog_profile_dump(pOutput);
+
+    rewind(pOutput);
+    size_t nRead = fread(dump, 1, sizeof(dump) - 1, pOutput);
+    dump[nRead] = '\0';
+    fclose(pOutput);
+
+#ifdef SLOG_PROFILE
+    if (!nProfiled || count_lines(dump, "Total count = 100]") < 3 ||
+        !strstr(dump, "# format (ns)") || !strstr(dump, "# lock hold (ns)") ||
+        !strstr(dump, "# callback (ns)") || !strstr(dump, "1/(1-Percentile)")) failed = 1;
+#else
+    if (nProfiled || nRead) failed = 1;
+#endif
+
+    slog_destroy();
+    printf("=============> test_profile %s.\n\n", failed ? TEST_FAILED : TEST_PASSED);
+    return failed;
+}
+
+#define FORMAT_CHECK(...) do { \
+        output[0] = '\0'; \
+        snprintf(expected, sizeof(expected), __VA_ARGS__); \
+        slog_display(SLOG_NOTAG, 0, __VA_ARGS__); \
+        if (strcmp(output, expected)) { \
+            if (failed++ < 5) printf("Mismatch: \"%s\" expected \"%s\" got \"%s\"\n", format, expected, output); \
+        } \
+    } while (0)
+
+static long long random_value(void)
+{
+    static const long long edges[] = { 0, 1, -1, 9, 10, 99, 100, INT_MAX, INT_MIN, UINT_MAX, LLONG_MAX, LLONG_MIN };
+    if (rand() % 4 == 0) return edges[rand() % (sizeof(edges) / sizeof(edges[0]))];
+
+    unsigned long long nBits = ((unsigned long long)rand() << 33) ^ ((unsigned long long)rand() << 11) ^ (unsigned)rand();
+    long long nValue = (long long)nBits;
+    return nValue >> (rand() % 63);
+}
+
+/* Random specification of the conversion class, returns the number of '*' used (bit 0 width, bit 1 precision) */
+static int random_spec(char *pOut, size_t nSize, const char *pLength, const char *pConvs)
+{
+    static const char *flags[] = { "", "", "-", "0", "+", " ", "-0", "+0", "- ", "#", "'" };
+    char sWidth[16] = "", sPrec[16] = "";
+    int nStars = 0;
+
+    switch (rand() % 4)
+    {
+        case 1: snprintf(sWidth, sizeof(sWidth), "%d", rand() % 25); break;
+        case 2: snprintf(sWidth, sizeof(sWidth), "*"); nStars |= 1; break;
+        default: break;
+    }
+
+    switch (rand() % 5)
+    {
+        case 1: snprintf(sPrec, sizeof(sPrec), "."); break;
+        case 2: snprintf(sPrec, sizeof(sPrec), ".%d", rand() % 25); break;
+        case 3: snprintf(sPrec, sizeof(sPrec), ".*"); nStars |= 2; break;
+        default: break;
+    }
+
+    snprintf(pOut, nSize, "<%%%s%s%s%s%c>", flags[rand() % (sizeof(flags) / sizeof(flags[0]))],
+        sWidth, sPrec, pLength, pConvs[rand() % strlen(pConvs)]);
+
+    return nStars;
+}
+
+static int run_format_corpus(char *output)
+{
+    static const char *strings[] = { "", "a", "text", "longer text with spaces", "%d not a spec" };
+    char expected[SLOG_MESSAGE_MAX];
+    char format[256];
+    int failed = 0, i;
+
+    for (i = 0; i < 20000; i++)
+    {
+        int nWidth = rand() % 40 - 10;
+        int nPrec = rand() % 40 - 10;
+        long long nValue = random_value();
+        const char *pString = strings[rand() % (sizeof(strings) / sizeof(strings[0]))];
+        void *pPointer = rand() % 5 ? (void*)(size_t)nValue : NULL;
+        double fValue = (double)nValue / 7.0;
+        int nStars = 0;
+
+        switch (rand() % 12)
+        {
+            case 0: nStars = random_spec(format, sizeof(format), "", "diuxXoc"); break;
+            case 1: nStars = random_spec(format, sizeof(format), "hh", "diuxXo"); break;
+            case 2: nStars = random_spec(format, sizeof(format), "h", "diuxXo"); break;
+            case 3: nStars = random_spec(format, sizeof(format), "l", "diuxXo"); break;
+            case 4: nStars = random_spec(format, sizeof(format), "ll", "diuxXo"); break;
+            case 5: nStars = random_spec(format, sizeof(format), "z", "diuxXo"); break;
+            case 6: nStars = random_spec(format, sizeof(format), "j", "diuxXo"); break;
+            case 7: nStars = random_spec(format, sizeof(format), "t", "diuxXo"); break;
+            case 8: nStars = random_spec(format, sizeof(format), "", "s"); break;
+            case 9: nStars = random_spec(format, sizeof(format), "", "p"); break;
+            case 10: nStars = random_spec(format, sizeof(format), "", "feg"); break;
+            default:
+                FORMAT_CHECK("%d items, %s: %lu/%zu %x %%", (int)nValue, pString, (unsigned long)nValue, (size_t)nValue, (unsigned)nValue);
+                continue;
+        }
+
+#define CHECK_VALUE(value) \
+        switch (nStars) { \
+            case 0: FORMAT_CHECK(format, value); break; \
+            case 1: FORMAT_CHECK(format, nWidth, value); break; \
+            case 2: FORMAT_CHECK(format, nPrec, value); break; \
+            default: FORMAT_CHECK(format, nWidth, nPrec, value); break; \
+        }
+
+        if (strstr(format, "ll") != NULL) { CHECK_VALUE(nValue); }
+        else if (strchr(format, 'l') != NULL) { CHECK_VALUE((long)nValue); }
+        else if (strchr(format, 'z') != NULL) { CHECK_VALUE((size_t)nValue); }
+        else if (strchr(format, 'j') != NULL) { CHECK_VALUE((intmax_t)nValue); }
+        else if (strchr(format, 't') != NULL) { CHECK_VALUE((ptrdiff_t)nValue); }
+        else if (strchr(format, 's') != NULL) { CHECK_VALUE(pString); }
+        else if (strchr(format, 'p') != NULL) { CHECK_VALUE(pPointer); }
+        else if (strpbrk(format, "feg") != NULL) { CHECK_VALUE(fValue); }
+        else { CHECK_VALUE((int)nValue); }
+#undef CHECK_VALUE
+    }
+
+    /* Long message is truncated (stack) or kept whole (heap) */
+    char *pLong = (char*)malloc(SLOG_MESSAGE_MAX * 2);
+    if (pLong == NULL) return failed + 1;
+
+    memset(pLong, 'x', SLOG_MESSAGE_MAX * 2 - 1);
+    pLong[SLOG_MESSAGE_MAX * 2 - 1] = '\0';
+    snprintf(format, sizeof(format), "%%d %%s");
+
+    output[0] = '\0';
+    slog_display(SLOG_NOTAG, 0, format, 42, pLong);
+    if (strncmp(output, "42 ", 3) || strspn(output + 3, "x") != strlen(output + 3) ||
+        strlen(output) < SLOG_MESSAGE_MAX - 1) failed++;
+
+    free(pLong);
+    return failed;
+}
+
+int test_fast_format()
+{
+    printf("=============> Running test_fast_format...\n");
+    char *output = (char*)calloc(1, SLOG_MESSAGE_MAX * 4);
+    int failed = 0;
+
+    if (output == NULL) return 1;
+    srand(1234);
+
+    slog_init("format_test_log", SLOG_FLAGS_ALL, 0);
+    slog_date_format_set(SLOG_TIME_DISABLE);
+    slog_color_format_set(SLOG_COLORING_DISABLE);
+    slog_callback_set(binary_test_callback, output);
+    slog_screen_set(0);
+
+    /* Stack and heap modes use the formatter differently */
+    failed += run_format_corpus(output);
+    slog_use_heap_set(1);
+    failed += run_format_corpus(output);
+
+    slog_destroy();
+    free(output);
+
+    printf("=============> test_fast_format %s.\n\n", failed ? TEST_FAILED : TEST_PASSED);
+    return failed ? 1 : 0;
+}
+
+/* Prefix of the coarse clock time in the SLOG_DATE_FULL format */
+static void time_cache_prefix(char *pOut, size_t nSize)
+{
+    struct timespec ts;
+    struct tm tm;
+
+#ifdef CLOCK_REALTIME_COARSE
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+#else
+    clock_gettime(CLOCK_REALTIME, &ts);
+#endif
+    localtime_r(&ts.tv_sec, &tm);
+
+    /* Fields are clamped to their ranges, so the prefix always fits its 24 bytes */
+    snprintf(pOut, nSize, "%04u.%02u.%02u-%02u:%02u:%02u.%03u",
+        (unsigned int)(tm.tm_year + 1900) % 10000, (unsigned int)(tm.tm_mon + 1) % 100,
+        (unsigned int)tm.tm_mday % 100, (unsigned int)tm.tm_hour % 100,
+        (unsigned int)tm.tm_min % 100, (unsigned int)tm.tm_sec % 100,
+        (unsigned int)(ts.tv_nsec / 1000000) % 1000);
+}
+
+int test_time_cache()
+{
+    printf("=============> Running test_time_cache...\n");
+    char output[256], before[32], after[32], last[32] = { 0 };
+    int failed = 0, nSeconds = 0, i;
+
+    slog_init("time_cache_log", SLOG_FLAGS_ALL, 1);
+    slog_color_format_set(SLOG_COLORING_DISABLE);
+    slog_date_format_set(SLOG_DATE_FULL);
+    slog_callback_set(binary_test_callback, output);
+    slog_coarse_time_set(1);
+    slog_screen_set(0);
+
+    /* Every line lies between the clock reads around it, across at least two second changes */
+    for (i = 0; i < 200 && nSeconds < 2; i++)
+    {
+        output[0] = '\0';
+        time_cache_prefix(before, sizeof(before));
+        slog_info("Time cache line %d", i);
+        time_cache_prefix(after, sizeof(after));
+
+        if (strlen(output) < 23 || output[23] != ' ' ||
+            strncmp(output, before, 23) < 0 || strncmp(output, after, 23) > 0)
+        {
+            failed = 1;
+            break;
+        }
+
+        /* Milliseconds never go back within the cached second */
+        if (last[0] && strncmp(output, last, 23) < 0) failed = 1;
+        if (last[0] && strncmp(output, last, 19)) nSeconds++;
+        snprintf(last, sizeof(last), "%.23s", output);
+        usleep(25 * 1000);
+    }
+
+    if (nSeconds < 2) failed = 1;
+    slog_destroy();
+
+    printf("=============> test_time_cache %s.\n\n", failed ? TEST_FAILED : TEST_PASSED);
+    return failed;
+}
+
 int main()
 {
     int failed = 0;
@@ -136,7 +1536,27 @@ int main()
     failed += test_slog_file_logging();
     failed += test_slog_formatting();
     failed += test_heap_logging();
+    failed += test_heap_callback();
+    failed += test_grow_buffer();
     failed += test_thread_safe_logging();
+    failed += test_async_logging();
+    failed += test_buffered_file_logging();
+    failed += test_mmap_logging();
+    failed += test_multiple_instances();
+    failed += test_sink_logging();
+    failed += test_binary_logging();
+    failed += test_structured_logging();
+    failed += test_size_rotation();
+    failed += test_external_rotation();
+    failed += test_reopen_logging();
+    failed += test_thread_name();
+    failed += test_fast_format();
+    failed += test_time_cache();
+    failed += test_rate_limiting();
+    failed += test_sampling();
+    failed += test_flight_recorder();
+    failed += test_stats();
+    failed += test_profile();
 
     if (failed > 0)
     {
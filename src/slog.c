@@ -33,6 +33,7 @@
 #include <limits.h>
 #include <errno.h>
 #include <time.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include "slog.h"
@@ -43,11 +44,20 @@
 
 #ifndef _WIN32
 #include <pthread.h>
+#include <sched.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/time.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <spawn.h>
+extern char **environ;
 #else
 #include <windows.h>
 #include <share.h>
+#include <fcntl.h>
+#include <io.h>
 #endif
 
 #ifndef PTHREAD_MUTEX_RECURSIVE
@@ -55,35 +65,389 @@
 #endif
 
 #define SLOG_FILE_PATH_MAX (SLOG_PATH_MAX + SLOG_NAME_MAX + SLOG_DATE_MAX)
+#define SLOG_LINE_MAX (SLOG_INFO_MAX + SLOG_NAME_MAX + SLOG_MESSAGE_MAX + SLOG_COLOR_MAX)
 #define SLOG_ASSERT_RET(x) if (!(x)) return
 
+#define SLOG_SNAPSHOT_MAX       4
+#define SLOG_BINARY_MAGIC       "SLOGBIN1"
+#define SLOG_BINARY_ORDER       0x01020304
+#define SLOG_RECORD_HEADER      5
+#define SLOG_STRUCT_RESERVE     8
+#define SLOG_ASYNC_BATCH        64
+#define SLOG_ASYNC_IDLE_MS      100
+#define SLOG_RECORDER_HEAD      "==== Recent lines ("
+#define SLOG_RECORDER_TAIL      ") ====\n"
+#define SLOG_STATS_STRIPES      16
+
+#ifdef SLOG_PROFILE
+/* Log-linear buckets like HdrHistogram, 16 sub-buckets per power of two (~6% precision) */
+#define SLOG_PROFILE_SUB_BITS   4
+#define SLOG_PROFILE_BUCKETS    ((64 - SLOG_PROFILE_SUB_BITS + 1) << SLOG_PROFILE_SUB_BITS)
+#define SLOG_PROFILE_START(var) uint64_t var = slog_time_ns()
+#define SLOG_PROFILE_END(slog, phase, var) slog_profile_add(slog, phase, slog_time_ns() - (var))
+#else
+#define SLOG_PROFILE_START(var)
+#define SLOG_PROFILE_END(slog, phase, var)
+#endif
+#define SLOG_ASYNC_WAIT_MS      10
+#define SLOG_REOPEN_CHECK_MS    1000
+
+/* Local day packed as YYYYMMDD, compared once per line by the rotation check */
+#define SLOG_DATE_KEY(d) ((uint32_t)(d)->nYear * 10000 + (uint32_t)(d)->nMonth * 100 + (d)->nDay)
+
+#ifdef _MSC_VER
+#define SLOG_THREAD_LOCAL __declspec(thread)
+#else
+#define SLOG_THREAD_LOCAL __thread
+#endif
+
+#ifdef _WIN32
+typedef HANDLE slog_thread_t;
+typedef DWORD slog_thread_ret_t;
+typedef CRITICAL_SECTION slog_mutex_t;
+typedef CONDITION_VARIABLE slog_cond_t;
+#define SLOG_THREAD_API WINAPI
+#else
+typedef pthread_t slog_thread_t;
+typedef void* slog_thread_ret_t;
+typedef pthread_mutex_t slog_mutex_t;
+typedef pthread_cond_t slog_cond_t;
+#define SLOG_THREAD_API
+#endif
+
+typedef slog_thread_ret_t(SLOG_THREAD_API *slog_thread_cb_t)(void *pArg);
+typedef volatile size_t slog_atomic_t;
+
 #define SLOG_STRFY_RAW(x) #x
 #define SLOG_STRFY(x) SLOG_STRFY_RAW(x)
 
+/* Background thread compressing the rotated segments and applying the retention */
+typedef struct slog_archiver {
+    slog_atomic_t nStop;
+    slog_thread_t thread;
+    slog_mutex_t mutex;
+    slog_cond_t cond;
+
+    /* Policy of the latest rotation, it applies to all archives of the file */
+    slog_compress_t eCompress;
+    uint32_t nMaxArchives;
+    uint64_t nMaxTotalSize;
+    char sDirectory[SLOG_PATH_MAX];
+    char sName[SLOG_NAME_MAX];
+
+    /* Set by every rotation, one scan covers all segments rotated since the last one */
+    uint8_t nPending;
+} slog_archiver_t;
+
+/* Archive found in the log directory, nOrder sorts them from the oldest */
+typedef struct slog_archive {
+    char sName[SLOG_NAME_MAX + SLOG_DATE_MAX];
+    uint64_t nOrder;
+    uint64_t nSize;
+} slog_archive_t;
+
+typedef struct slog_archives {
+    slog_archive_t *pItems;
+    size_t nCapacity;
+    size_t nCount;
+    uint64_t nTotal;
+} slog_archives_t;
+
 typedef struct slog_file {
     char sFilePath[SLOG_FILE_PATH_MAX];
-    uint16_t nCurrYear;
-    uint8_t nCurrMonth;
-    uint8_t nCurrDay;
+    uint32_t nCurrDate;
     FILE *pHandle;
+
+    /* Identity of the open file and the next time its path is checked */
+    slog_atomic_t nReopen;
+    uint64_t nCheckAt;
+    uint64_t nDevice;
+    uint64_t nInode;
+
+    /* User-space buffer of the file output, written with a single call */
+    uint64_t nDeadline;
+    size_t nBufferSize;
+    size_t nBufferUsed;
+    char *pBuffer;
+
+    /* Memory mapped window at the end of the file */
+    uint64_t nMapOffset;
+    uint64_t nFileSize;
+    size_t nMapSize;
+    char *pMap;
+
+    /* Last numbered segment of the size rotation and the day it belongs to */
+    uint32_t nSegmentDate;
+    uint32_t nSegment;
+    slog_archiver_t *pArchiver;
+
+    /* Statistics of the file output */
+    uint64_t nOpens;
+    uint64_t nRotations;
+    uint64_t nWritten;
+    uint64_t nErrors;
 } slog_file_t;
 
-typedef struct slog {
+/* Background thread flushing the file buffer and the pending repeats when their deadline expires */
+typedef struct slog_flusher {
+    slog_atomic_t nStop;
+    slog_thread_t thread;
+    slog_mutex_t mutex;
+    slog_cond_t cond;
+} slog_flusher_t;
+
+/* Queue slot of the async mode, holds one fully formatted line */
+typedef struct slog_slot {
+    slog_atomic_t nSequence;
+    slog_flag_t eFlag;
+    slog_date_t date;
+    size_t nTid;
+    size_t nLength;
+    size_t nBodyOff;
+    char *pHeap;
+    char sLine[SLOG_LINE_MAX];
+} slog_slot_t;
+
+/* Bounded multi-producer queue drained by a single writer thread */
+typedef struct slog_async {
+    slog_overflow_t eOverflow;
+    slog_t *pSlog;
+    slog_slot_t *pSlots;
+    size_t nMask;
+
+    slog_atomic_t nEnqueuePos;
+    slog_atomic_t nDequeuePos;
+    slog_atomic_t nProcessed;
+    slog_atomic_t nDropped;
+    slog_atomic_t nSleeping;
+    slog_atomic_t nWaiting;
+    slog_atomic_t nStop;
+
+    slog_cond_t writerCond;
+    slog_cond_t waiterCond;
+    slog_mutex_t mutex;
+    slog_thread_t thread;
+} slog_async_t;
+
+/* Record types of the binary file */
+typedef enum {
+    SLOG_RECORD_SESSION = 1,
+    SLOG_RECORD_CONFIG,
+    SLOG_RECORD_FORMAT,
+    SLOG_RECORD_LINE
+} slog_record_t;
+
+/* Argument types of the recorded conversion specifications */
+typedef enum {
+    SLOG_ARG_PERCENT = 0,
+    SLOG_ARG_INT,
+    SLOG_ARG_LONG,
+    SLOG_ARG_LLONG,
+    SLOG_ARG_SIZE,
+    SLOG_ARG_INTMAX,
+    SLOG_ARG_PTRDIFF,
+    SLOG_ARG_DOUBLE,
+    SLOG_ARG_LDOUBLE,
+    SLOG_ARG_PTR,
+    SLOG_ARG_STR,
+    SLOG_ARG_INVALID
+} slog_arg_t;
+
+typedef struct slog_spec {
+    slog_arg_t eType;
+    uint8_t nWidthArg;
+    uint8_t nPrecArg;
+} slog_spec_t;
+
+/* Binary output, a format is defined in the file before its first line */
+typedef struct slog_binary {
+    FILE *pHandle;
+    uint8_t *pDefined;
+    size_t nDefined;
+    size_t nGeneration;
+} slog_binary_t;
+
+/* Registered sink with the state of its ring buffer */
+typedef struct slog_sink_slot {
+    slog_sink_t sink;
+    uint8_t nUsed;
+    uint64_t nRingTotal;
+    size_t nRingPos;
+    char *pRing;
+    uint64_t nBytes;
+    uint64_t nErrors;
+} slog_sink_slot_t;
+
+/* Level dependent parts of the text header */
+typedef struct slog_prefix {
+    const char *pLevel;
+    size_t nColorLen;
+    size_t nTagLen;
+    char sColor[SLOG_COLOR_MAX];
+    char sTag[SLOG_TAG_MAX];
+} slog_prefix_t;
+
+/* Rendered once per configuration change, the last level is used for unknown flags */
+typedef struct slog_prefixes {
+    slog_prefix_t levels[SLOG_LEVEL_COUNT + 1];
+    size_t nSeparatorLen;
+    size_t nResetLen;
+    char sReset[SLOG_COLOR_MAX];
+} slog_prefixes_t;
+
+/* Last line of the collapsing mode, its repeats are only counted */
+typedef struct slog_repeat {
+    slog_flag_t eFlag;
+    slog_date_t date;                   // Time and thread of the last repeat, used by the notice
+    size_t nTid;
+    uint64_t nDeadline;                 // Repeats are displayed after SLOG_REPEAT_DELAY at most
+    size_t nCount;
+    size_t nLength;
+    size_t nSize;
+    char *pBody;
+} slog_repeat_t;
+
+/* Sampling of one level, read without the lock before the line is formatted */
+typedef struct slog_sample {
+    slog_atomic_t nEvery;               // Keep one of N lines (0 - disabled)
+    slog_atomic_t nRate;                // Keep if the random number is below nRate - 1 (0 - disabled)
+    slog_atomic_t nDropped;             // Lines sampled out
+} slog_sample_t;
+
+/* Counters updated with the lock held */
+typedef struct slog_counters {
+    uint64_t nLines[SLOG_LEVEL_COUNT];
+    uint64_t nScreenBytes;
+    uint64_t nRejected;
+    uint64_t nCollapsed;
+    uint64_t nLockWaitNs;
+    uint64_t nLockWaits[SLOG_STATS_BUCKETS];
+} slog_counters_t;
+
+/* Counters updated without the lock, every thread adds to its own stripe */
+typedef struct slog_stripe {
+    slog_atomic_t nFiltered[SLOG_LEVEL_COUNT];
+    slog_atomic_t nTruncated;
+    slog_atomic_t nPadding[7];          // Keeps the stripes on separate cache lines
+} slog_stripe_t;
+
+#ifdef SLOG_PROFILE
+typedef enum {
+    SLOG_PHASE_TOTAL = 0,               // Whole display call of the logging thread
+    SLOG_PHASE_FORMAT,                  // Formatting of the line
+    SLOG_PHASE_WAIT,                    // Waiting for the logger lock
+    SLOG_PHASE_HOLD,                    // Holding the logger lock
+    SLOG_PHASE_OUTPUT,                  // Screen, file and sinks
+    SLOG_PHASE_CALLBACK,                // User callback
+    SLOG_PHASE_COUNT
+} slog_phase_t;
+
+/* Updated from every logging thread, so all fields are atomic */
+typedef struct slog_histogram {
+    slog_atomic_t nCount;
+    slog_atomic_t nMax;
+    slog_atomic_t buckets[SLOG_PROFILE_BUCKETS];
+} slog_histogram_t;
+#endif
+
+/* Flight recorder, recent lines of every recorded level kept in memory until a dump */
+typedef struct slog_recorder {
+    slog_mutex_t mutex;
+    slog_atomic_t nFlags;               // Recorded levels, including the ones filtered from the outputs
+    uint64_t nTotal;
+    size_t nSize;
+    size_t nPos;
+    char *pRing;
+    char sPath[SLOG_PATH_MAX];          // Dump file of the fatal lines and the crash handler
+} slog_recorder_t;
+
+struct slog {
 #ifdef _WIN32
     CRITICAL_SECTION mutex;
 #else
     pthread_mutex_t mutex;
 #endif
     slog_config_t config;
+    slog_prefixes_t prefixes;
     slog_file_t logFile;
+    slog_sink_slot_t sinks[SLOG_SINKS_MAX];
+    uint8_t nSinkCount;
+    slog_repeat_t repeat;
+    slog_sample_t samples[SLOG_LEVEL_COUNT];
+    slog_atomic_t nSampling;
+    slog_recorder_t recorder;
+    slog_counters_t counters;
+    slog_stripe_t stripes[SLOG_STATS_STRIPES];
+    slog_atomic_t nCountFiltered;
+    slog_atomic_t nSuppressed;
+#ifdef SLOG_PROFILE
+    slog_histogram_t profile[SLOG_PHASE_COUNT];
+    uint64_t nProfileCallback;
+    uint64_t nLockStart;
+    uint32_t nLockDepth;
+#endif
+    slog_flusher_t *pFlusher;
+    slog_binary_t *pBinary;
+    slog_atomic_t nAsync;               // Queue of the async mode (slog_async_t*), 0 if synchronous
+    slog_atomic_t nAsyncUsers;          // Callers holding the queue, the stop waits for them
+    slog_atomic_t nGeneration;
+    slog_atomic_t nActive;
+    slog_atomic_t nOutputs;
+    slog_atomic_t nGrowths;
     uint8_t nTdSafe;
-} slog_t;
+    uint8_t nInit;
+};
+
+/* Per-thread 1-in-N counters of one instance, a thread keeps them for a few instances */
+typedef struct slog_sample_counts {
+    const slog_t *pOwner;
+    uint32_t counts[SLOG_LEVEL_COUNT];
+} slog_sample_counts_t;
+
+/* Per-thread copy of the configuration, refreshed when the generation changes */
+typedef struct slog_snapshot {
+    const slog_t *pOwner;
+    size_t nGeneration;
+    slog_config_t config;
+    slog_prefixes_t prefixes;
+} slog_snapshot_t;
+
+/* Per-thread time cache, the prefixes are rendered only when the second changes */
+typedef struct slog_clock {
+    uint64_t nSecond;
+    slog_date_t date;
+    size_t nTimeLen;
+    size_t nDateLen;
+    char sTime[SLOG_DATE_MAX];
+    char sDate[SLOG_DATE_MAX];
+} slog_clock_t;
+
+/* Source location and typed fields of the key-value calls */
+typedef struct slog_fields {
+    const char *pFile;
+    int nLine;
+    const slog_kv_t *pList;
+    size_t nCount;
+} slog_fields_t;
+
+/* Per-thread id and its rendered prefix, refreshed in the child after fork */
+typedef struct slog_thread {
+    size_t nForks;
+    size_t nTid;
+    size_t nPrefixLen;
+    char sName[SLOG_THREAD_NAME_MAX];
+    char sPrefix[SLOG_THREAD_NAME_MAX + SLOG_TAG_MAX];
+} slog_thread_info_t;
 
 typedef struct slog_context {
+    const slog_prefixes_t *pPrefixes;
+    const slog_fields_t *pFields;
+    const slog_clock_t *pClock;
     const char *pFormat;
     slog_flag_t eFlag;
     slog_date_t date;
     uint8_t nNewLine;
+    size_t nTid;
 } slog_context_t;
 
 static const char g_slogVerShort[] =
@@ -97,8 +461,101 @@ static const char g_slogVerLong[] =
     SLOG_STRFY(SLOG_BUILD_NUMBER)
     " (" SLOG_RELEASE_DATE ")";
 
-static volatile int g_nSlogInit = 0;
+static slog_atomic_t g_nSlogGeneration = 0;
+static slog_atomic_t g_nSlogSiteId = 0;
+static slog_atomic_t g_nSlogForks = 0;
+static slog_atomic_t g_nSlogStripes = 0;
 static slog_t g_slog;
+static slog_t *g_pSlogCrash = NULL;
+
+static SLOG_THREAD_LOCAL slog_snapshot_t g_slogSnapshots[SLOG_SNAPSHOT_MAX];
+static SLOG_THREAD_LOCAL uint8_t g_nSlogSnapshotNext = 0;
+static SLOG_THREAD_LOCAL slog_clock_t g_slogClock;
+static SLOG_THREAD_LOCAL slog_thread_info_t g_slogThread;
+static SLOG_THREAD_LOCAL uint8_t g_nSlogWriter = 0;
+static SLOG_THREAD_LOCAL uint8_t g_nSlogLineBusy = 0;
+static SLOG_THREAD_LOCAL char g_slogLine[SLOG_LINE_MAX];
+static SLOG_THREAD_LOCAL char *g_pSlogGrowLine = NULL;
+static SLOG_THREAD_LOCAL size_t g_nSlogGrowSize = 0;
+
+static SLOG_THREAD_LOCAL slog_sample_counts_t g_slogSampleCounts[SLOG_SNAPSHOT_MAX];
+static SLOG_THREAD_LOCAL uint8_t g_nSlogSampleNext = 0;
+static SLOG_THREAD_LOCAL uint64_t g_nSlogRandom = 0;
+
+/* Offset of the part following the timestamp in the last line built by this thread */
+static SLOG_THREAD_LOCAL size_t g_nSlogBodyOff = 0;
+
+/* Stripe of the statistics counters (index + 1) and the truncation of the last line */
+static SLOG_THREAD_LOCAL uint8_t g_nSlogStripe = 0;
+static SLOG_THREAD_LOCAL uint8_t g_nSlogTruncated = 0;
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#ifdef _WIN64
+#define SLOG_INTERLOCKED_CAS(p, n, o) (size_t)InterlockedCompareExchange64((volatile LONG64*)(p), (LONG64)(n), (LONG64)(o))
+#define SLOG_INTERLOCKED_ADD(p, v) (size_t)InterlockedExchangeAdd64((volatile LONG64*)(p), (LONG64)(v))
+#define SLOG_INTERLOCKED_SET(p, v) InterlockedExchange64((volatile LONG64*)(p), (LONG64)(v))
+#else
+#define SLOG_INTERLOCKED_CAS(p, n, o) (size_t)InterlockedCompareExchange((volatile LONG*)(p), (LONG)(n), (LONG)(o))
+#define SLOG_INTERLOCKED_ADD(p, v) (size_t)InterlockedExchangeAdd((volatile LONG*)(p), (LONG)(v))
+#define SLOG_INTERLOCKED_SET(p, v) InterlockedExchange((volatile LONG*)(p), (LONG)(v))
+#endif
+#define SLOG_MSVC_ATOMICS
+#endif
+
+static size_t slog_atomic_get(slog_atomic_t *pValue)
+{
+#ifdef SLOG_MSVC_ATOMICS
+    return SLOG_INTERLOCKED_CAS(pValue, 0, 0);
+#else
+    return __atomic_load_n(pValue, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static size_t slog_atomic_peek(slog_atomic_t *pValue)
+{
+#ifdef SLOG_MSVC_ATOMICS
+    return *pValue;
+#else
+    return __atomic_load_n(pValue, __ATOMIC_RELAXED);
+#endif
+}
+
+static void slog_atomic_set(slog_atomic_t *pValue, size_t nValue)
+{
+#ifdef SLOG_MSVC_ATOMICS
+    SLOG_INTERLOCKED_SET(pValue, nValue);
+#else
+    __atomic_store_n(pValue, nValue, __ATOMIC_RELEASE);
+#endif
+}
+
+static size_t slog_atomic_add(slog_atomic_t *pValue, size_t nValue)
+{
+#ifdef SLOG_MSVC_ATOMICS
+    return SLOG_INTERLOCKED_ADD(pValue, nValue);
+#else
+    return __atomic_fetch_add(pValue, nValue, __ATOMIC_ACQ_REL);
+#endif
+}
+
+static uint8_t slog_atomic_cas(slog_atomic_t *pValue, size_t nOld, size_t nNew)
+{
+#ifdef SLOG_MSVC_ATOMICS
+    return SLOG_INTERLOCKED_CAS(pValue, nNew, nOld) == nOld ? 1 : 0;
+#else
+    return __atomic_compare_exchange_n(pValue, &nOld, nNew, 0,
+        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) ? 1 : 0;
+#endif
+}
+
+static void slog_atomic_fence(void)
+{
+#ifdef SLOG_MSVC_ATOMICS
+    MemoryBarrier();
+#else
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+}
 
 static void slog_sync_init(slog_t *pSlog)
 {
@@ -134,20 +591,111 @@ static void slog_sync_destroy(slog_t *pSlog)
     pSlog->nTdSafe = 0;
 }
 
+static uint64_t slog_time_ns(void);
+
+/* Bucket 1 counts the waits under a microsecond, every next one doubles the limit */
+static void slog_sync_waited(slog_t *pSlog, uint64_t nWaitNs)
+{
+    uint64_t nWaitUs = nWaitNs / 1000;
+    uint8_t nBucket = 1;
+
+    while (nWaitUs && nBucket < SLOG_STATS_BUCKETS - 1)
+    {
+        nWaitUs >>= 1;
+        nBucket++;
+    }
+
+    pSlog->counters.nLockWaits[nBucket]++;
+    pSlog->counters.nLockWaitNs += nWaitNs;
+}
+
+#ifdef SLOG_PROFILE
+static uint32_t slog_profile_bucket(uint64_t nValue)
+{
+    if (nValue < (1 << SLOG_PROFILE_SUB_BITS)) return (uint32_t)nValue;
+
+    uint32_t nMsb = 0;
+    while (nValue >> (nMsb + 1)) nMsb++;
+
+    uint32_t nShift = nMsb - SLOG_PROFILE_SUB_BITS;
+    uint32_t nSub = (uint32_t)(nValue >> nShift) & ((1 << SLOG_PROFILE_SUB_BITS) - 1);
+    return ((nShift + 1) << SLOG_PROFILE_SUB_BITS) | nSub;
+}
+
+/* Highest value counted by the bucket, reported like the equivalent values of HdrHistogram */
+static uint64_t slog_profile_value(uint32_t nBucket)
+{
+    if (nBucket < (1 << SLOG_PROFILE_SUB_BITS)) return nBucket;
+
+    uint32_t nShift = (nBucket >> SLOG_PROFILE_SUB_BITS) - 1;
+    uint64_t nBase = ((uint64_t)1 << SLOG_PROFILE_SUB_BITS) | (nBucket & ((1 << SLOG_PROFILE_SUB_BITS) - 1));
+    return ((nBase + 1) << nShift) - 1;
+}
+
+static uint64_t slog_profile_add(slog_t *pSlog, slog_phase_t ePhase, uint64_t nValue)
+{
+    slog_histogram_t *pHist = &pSlog->profile[ePhase];
+    size_t nMax = slog_atomic_peek(&pHist->nMax);
+
+    slog_atomic_add(&pHist->buckets[slog_profile_bucket(nValue)], 1);
+    slog_atomic_add(&pHist->nCount, 1);
+
+    while (nValue > nMax && !slog_atomic_cas(&pHist->nMax, nMax, (size_t)nValue))
+        nMax = slog_atomic_peek(&pHist->nMax);
+
+    return nValue;
+}
+
+/* Only the outermost lock of the recursive mutex starts the hold time */
+static void slog_profile_locked(slog_t *pSlog, uint64_t nStart)
+{
+    uint64_t nNow = slog_time_ns();
+    slog_profile_add(pSlog, SLOG_PHASE_WAIT, nNow - nStart);
+    if (!pSlog->nLockDepth++) pSlog->nLockStart = nNow;
+}
+
+static void slog_profile_unlocked(slog_t *pSlog)
+{
+    if (!--pSlog->nLockDepth) slog_profile_add(pSlog, SLOG_PHASE_HOLD, slog_time_ns() - pSlog->nLockStart);
+}
+#endif
+
+/* The wait is timed only when the lock is busy, the uncontended path reads no clock */
 static void slog_sync_lock(slog_t *pSlog)
 {
     SLOG_ASSERT_RET(pSlog->nTdSafe);
+    SLOG_PROFILE_START(nProfile);
+    uint64_t nStart = 0;
+    uint8_t nWaited = 0;
 
 #ifndef _WIN32
-    if (pthread_mutex_lock(&pSlog->mutex))
+    if (pthread_mutex_trylock(&pSlog->mutex))
     {
-        printf("<%s:%d> %s: [ERROR] Can not lock mutex: %d\n",
-            __FILE__, __LINE__, __func__, errno);
+        nStart = slog_time_ns();
+        nWaited = 1;
 
-        exit(EXIT_FAILURE);
+        if (pthread_mutex_lock(&pSlog->mutex))
+        {
+            printf("<%s:%d> %s: [ERROR] Can not lock mutex: %d\n",
+                __FILE__, __LINE__, __func__, errno);
+
+            exit(EXIT_FAILURE);
+        }
     }
 #else
-    EnterCriticalSection(&pSlog->mutex);
+    if (!TryEnterCriticalSection(&pSlog->mutex))
+    {
+        nStart = slog_time_ns();
+        nWaited = 1;
+        EnterCriticalSection(&pSlog->mutex);
+    }
+#endif
+
+    if (nWaited) slog_sync_waited(pSlog, slog_time_ns() - nStart);
+    else pSlog->counters.nLockWaits[0]++;
+
+#ifdef SLOG_PROFILE
+    slog_profile_locked(pSlog, nProfile);
 #endif
 }
 
@@ -155,6 +703,10 @@ static void slog_sync_unlock(slog_t *pSlog)
 {
     SLOG_ASSERT_RET(pSlog->nTdSafe);
 
+#ifdef SLOG_PROFILE
+    slog_profile_unlocked(pSlog);
+#endif
+
 #ifndef _WIN32
     if (pthread_mutex_unlock(&pSlog->mutex))
     {
@@ -168,6 +720,183 @@ static void slog_sync_unlock(slog_t *pSlog)
 #endif
 }
 
+static void slog_mutex_init(slog_mutex_t *pMutex)
+{
+#ifndef _WIN32
+    pthread_mutex_init(pMutex, NULL);
+#else
+    InitializeCriticalSection(pMutex);
+#endif
+}
+
+static void slog_mutex_destroy(slog_mutex_t *pMutex)
+{
+#ifndef _WIN32
+    pthread_mutex_destroy(pMutex);
+#else
+    DeleteCriticalSection(pMutex);
+#endif
+}
+
+static void slog_mutex_lock(slog_mutex_t *pMutex)
+{
+#ifndef _WIN32
+    pthread_mutex_lock(pMutex);
+#else
+    EnterCriticalSection(pMutex);
+#endif
+}
+
+static void slog_mutex_unlock(slog_mutex_t *pMutex)
+{
+#ifndef _WIN32
+    pthread_mutex_unlock(pMutex);
+#else
+    LeaveCriticalSection(pMutex);
+#endif
+}
+
+static void slog_cond_init(slog_cond_t *pCond)
+{
+#ifndef _WIN32
+    pthread_cond_init(pCond, NULL);
+#else
+    InitializeConditionVariable(pCond);
+#endif
+}
+
+static void slog_cond_destroy(slog_cond_t *pCond)
+{
+#ifndef _WIN32
+    pthread_cond_destroy(pCond);
+#else
+    (void)pCond; /* Windows condition variables do not need to be destroyed */
+#endif
+}
+
+static void slog_cond_signal(slog_cond_t *pCond, uint8_t nBroadcast)
+{
+#ifndef _WIN32
+    if (nBroadcast) pthread_cond_broadcast(pCond);
+    else pthread_cond_signal(pCond);
+#else
+    if (nBroadcast) WakeAllConditionVariable(pCond);
+    else WakeConditionVariable(pCond);
+#endif
+}
+
+/* Spurious and timed out wakeups are expected, callers always re-check their state */
+static void slog_cond_wait(slog_cond_t *pCond, slog_mutex_t *pMutex, uint32_t nTimeoutMs)
+{
+#ifndef _WIN32
+    struct timespec ts;
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    ts.tv_sec = tv.tv_sec + nTimeoutMs / 1000;
+    ts.tv_nsec = tv.tv_usec * 1000 + (long)(nTimeoutMs % 1000) * 1000000;
+
+    if (ts.tv_nsec >= 1000000000)
+    {
+        ts.tv_nsec -= 1000000000;
+        ts.tv_sec++;
+    }
+
+    pthread_cond_timedwait(pCond, pMutex, &ts);
+#else
+    SleepConditionVariableCS(pCond, pMutex, nTimeoutMs);
+#endif
+}
+
+static uint8_t slog_thread_create(slog_thread_t *pThread, slog_thread_cb_t callback, void *pArg)
+{
+#ifndef _WIN32
+    return pthread_create(pThread, NULL, callback, pArg) ? 0 : 1;
+#else
+    *pThread = CreateThread(NULL, 0, callback, pArg, 0, NULL);
+    return *pThread != NULL ? 1 : 0;
+#endif
+}
+
+static void slog_thread_join(slog_thread_t *pThread)
+{
+#ifndef _WIN32
+    pthread_join(*pThread, NULL);
+#else
+    WaitForSingleObject(*pThread, INFINITE);
+    CloseHandle(*pThread);
+#endif
+}
+
+static void slog_thread_yield(void)
+{
+#ifndef _WIN32
+    sched_yield();
+#else
+    SwitchToThread();
+#endif
+}
+
+static void slog_build_prefixes(slog_prefixes_t *pPrefixes, const slog_config_t *pCfg);
+
+/* Must be called with the lock held by every function that modifies the configuration */
+static void slog_config_update(slog_t *pSlog)
+{
+    slog_config_t *pCfg = &pSlog->config;
+    slog_build_prefixes(&pSlog->prefixes, pCfg);
+    uint8_t nOutput = (pCfg->logCallback || pCfg->nToScreen ||
+                       pCfg->nToFile || pSlog->nSinkCount ||
+                       pSlog->pBinary != NULL) ? 1 : 0;
+
+    /* Flags allowed to pass the lock-free check at the beginning of the log call,
+     * the recorded levels pass it even when they are not displayed anywhere */
+    size_t nOutputs = nOutput ? pCfg->nFlags : 0;
+    slog_atomic_set(&pSlog->nOutputs, nOutputs);
+    slog_atomic_set(&pSlog->nActive, nOutputs | slog_atomic_peek(&pSlog->recorder.nFlags));
+
+    /* Generations are unique across instances, so a snapshot of a freed
+     * instance never matches a new instance allocated at the same address */
+    size_t nGeneration = slog_atomic_add(&g_nSlogGeneration, 1) + 1;
+    slog_atomic_set(&pSlog->nGeneration, nGeneration);
+}
+
+static const slog_snapshot_t* slog_config_snapshot(slog_t *pSlog)
+{
+    size_t nGeneration = slog_atomic_get(&pSlog->nGeneration);
+    slog_snapshot_t *pSnapshot = NULL;
+    uint8_t i;
+
+    /* Threads logging to a few instances keep one snapshot per instance */
+    for (i = 0; i < SLOG_SNAPSHOT_MAX; i++)
+    {
+        if (g_slogSnapshots[i].pOwner == pSlog)
+        {
+            pSnapshot = &g_slogSnapshots[i];
+            break;
+        }
+    }
+
+    if (pSnapshot == NULL)
+    {
+        pSnapshot = &g_slogSnapshots[g_nSlogSnapshotNext];
+        g_nSlogSnapshotNext = (g_nSlogSnapshotNext + 1) % SLOG_SNAPSHOT_MAX;
+        pSnapshot->pOwner = NULL;
+    }
+
+    if (pSnapshot->pOwner != pSlog ||
+        pSnapshot->nGeneration != nGeneration)
+    {
+        slog_sync_lock(pSlog);
+        pSnapshot->config = pSlog->config;
+        pSnapshot->prefixes = pSlog->prefixes;
+        pSnapshot->nGeneration = slog_atomic_peek(&pSlog->nGeneration);
+        pSnapshot->pOwner = pSlog;
+        slog_sync_unlock(pSlog);
+    }
+
+    return pSnapshot;
+}
+
 #ifdef _WIN32
 int slog_vasprintf(char **ppStr, const char *pFmt, va_list args)
 {
@@ -209,9 +938,8 @@ int slog_asprintf(char **ppStr, const char *pFmt, ...)
 }
 #endif
 
-static const char *slog_get_indent(slog_flag_t eFlag)
+static const char *slog_get_indent(const slog_config_t *pCfg, slog_flag_t eFlag)
 {
-    slog_config_t *pCfg = &g_slog.config;
     if (!pCfg->nIndent) return SLOG_EMPTY;
 
     switch (eFlag)
@@ -267,7 +995,30 @@ static const char* slog_get_color(slog_flag_t eFlag)
     return SLOG_EMPTY;
 }
 
+/* Minutes east of UTC of a local time, including the daylight saving shift */
+static int16_t slog_utc_offset(const struct tm *pTm)
+{
+#ifdef _WIN32
+    long nZone = 0, nBias = 0;
+    _get_timezone(&nZone);
+    if (pTm->tm_isdst > 0) _get_dstbias(&nBias);
+    return (int16_t)(-(nZone + nBias) / 60);
+#else
+    return (int16_t)(pTm->tm_gmtoff / 60);
+#endif
+}
+
 #ifdef _WIN32
+/* SYSTEMTIME has no zone, the offset comes from the C runtime view of the same moment */
+static int16_t slog_local_offset(void)
+{
+    time_t nNow = time(NULL);
+    struct tm tm_info;
+
+    if (localtime_s(&tm_info, &nNow)) return 0;
+    return slog_utc_offset(&tm_info);
+}
+
 void slog_get_date(slog_date_t *pDate)
 {
     SYSTEMTIME st;
@@ -280,6 +1031,7 @@ void slog_get_date(slog_date_t *pDate)
     pDate->nMin = (uint8_t)st.wMinute;
     pDate->nSec = (uint8_t)st.wSecond;
     pDate->nUsec = (uint16_t)st.wMilliseconds;
+    pDate->nOffset = slog_local_offset();
 }
 #else
 void slog_get_date(slog_date_t *pDate)
@@ -297,6 +1049,7 @@ void slog_get_date(slog_date_t *pDate)
     pDate->nMin = tm_info.tm_min;
     pDate->nSec = tm_info.tm_sec;
     pDate->nUsec = (uint16_t)(tv.tv_usec / 1000);
+    pDate->nOffset = slog_utc_offset(&tm_info);
 }
 #endif
 
@@ -323,592 +1076,5156 @@ static void slog_date_from_epoch(slog_date_t *pDate, time_t nTime)
     pDate->nHour = (uint8_t)tm_info.tm_hour;
     pDate->nMin = (uint8_t)tm_info.tm_min;
     pDate->nSec = (uint8_t)tm_info.tm_sec;
+    pDate->nOffset = slog_utc_offset(&tm_info);
     pDate->nUsec = 0;
 }
 
-static void slog_close_file(slog_file_t *pFile)
+static void slog_clock_render(slog_clock_t *pClock)
 {
-    if (pFile->pHandle != NULL)
-    {
-        fclose(pFile->pHandle);
-        pFile->pHandle = NULL;
-    }
+    const slog_date_t *pDate = &pClock->date;
+    int nLength;
+
+    nLength = snprintf(pClock->sTime, sizeof(pClock->sTime), "%02d:%02d:%02d.",
+        pDate->nHour, pDate->nMin, pDate->nSec);
+
+    pClock->nTimeLen = nLength > 0 ? (size_t)nLength : 0;
+
+    nLength = snprintf(pClock->sDate, sizeof(pClock->sDate), "%04d.%02d.%02d-%02d:%02d:%02d.",
+        pDate->nYear, pDate->nMonth, pDate->nDay, pDate->nHour, pDate->nMin, pDate->nSec);
+
+    pClock->nDateLen = nLength > 0 ? (size_t)nLength : 0;
 }
 
-/* Move the active log file into the dated archive of the day it belongs to */
-static void slog_rotate_file(slog_file_t *pFile, const slog_config_t *pCfg)
+/* Read the current time, the calendar is resolved only once per second */
+static void slog_clock_read(slog_clock_t *pClock, uint8_t nCoarse)
 {
-    struct stat statBuf;
-    slog_close_file(pFile);
+#ifdef _WIN32
+    SYSTEMTIME st;
+    GetLocalTime(&st);
+    (void)nCoarse;
 
-    memset(&statBuf, 0, sizeof(statBuf));
-    if (stat(pFile->sFilePath, &statBuf) < 0) return;
+    uint64_t nSecond = ((((((uint64_t)st.wYear * 13 + st.wMonth) * 32 +
+        st.wDay) * 24 + st.wHour) * 60 + st.wMinute) * 60) + st.wSecond;
 
-    char sRotatedPath[SLOG_FILE_PATH_MAX];
-    int nLength = snprintf(sRotatedPath, sizeof(sRotatedPath), "%s/%s-%04d-%02d-%02d.log",
-        pCfg->sFilePath, pCfg->sFileName, pFile->nCurrYear, pFile->nCurrMonth, pFile->nCurrDay);
+    if (nSecond != pClock->nSecond)
+    {
+        pClock->date.nYear = (uint16_t)st.wYear;
+        pClock->date.nMonth = (uint8_t)st.wMonth;
+        pClock->date.nDay = (uint8_t)st.wDay;
+        pClock->date.nHour = (uint8_t)st.wHour;
+        pClock->date.nMin = (uint8_t)st.wMinute;
+        pClock->date.nSec = (uint8_t)st.wSecond;
+        pClock->date.nOffset = slog_local_offset();
+        pClock->nSecond = nSecond;
+        slog_clock_render(pClock);
+    }
 
-    if (nLength <= 0) return;
+    pClock->date.nUsec = (uint16_t)st.wMilliseconds;
+#else
+    struct timespec ts;
 
-#ifdef _WIN32
-    /* Unlike POSIX, rename() on Windows fails if the destination already exists */
-    remove(sRotatedPath);
+#ifdef CLOCK_REALTIME_COARSE
+    clock_gettime(nCoarse ? CLOCK_REALTIME_COARSE : CLOCK_REALTIME, &ts);
+#else
+    clock_gettime(CLOCK_REALTIME, &ts);
+    (void)nCoarse;
 #endif
 
-    rename(pFile->sFilePath, sRotatedPath);
+    if ((uint64_t)ts.tv_sec != pClock->nSecond)
+    {
+        slog_date_from_epoch(&pClock->date, ts.tv_sec);
+        pClock->nSecond = (uint64_t)ts.tv_sec;
+        slog_clock_render(pClock);
+    }
+
+    pClock->date.nUsec = (uint16_t)(ts.tv_nsec / 1000000);
+#endif
 }
 
-static uint8_t slog_open_file(slog_file_t *pFile, const slog_config_t *pCfg, const slog_date_t *pDate)
+/* Copy the cached prefix and patch only the milliseconds */
+static size_t slog_create_date(const slog_context_t *pCtx, const slog_config_t *pCfg, char *pOut)
 {
-    struct stat statBuf;
-    slog_close_file(pFile);
+    const slog_clock_t *pClock = pCtx->pClock;
+    const char *pPrefix = NULL;
+    size_t nLength = 0;
 
-    if (pFile->sFilePath[0] == SLOG_NUL)
+    if (pCfg->eDateControl == SLOG_TIME_ONLY)
     {
-        snprintf(pFile->sFilePath, sizeof(pFile->sFilePath), "%s/%s.log",
-            pCfg->sFilePath, pCfg->sFileName);
+        pPrefix = pClock->sTime;
+        nLength = pClock->nTimeLen;
     }
-
-    /* Check if the existing log file belongs to a different day and archive it */
-    memset(&statBuf, 0, sizeof(statBuf));
-    if (pCfg->nRotate && stat(pFile->sFilePath, &statBuf) == 0)
+    else if (pCfg->eDateControl == SLOG_DATE_FULL)
     {
-        slog_date_t modDate;
-        slog_date_from_epoch(&modDate, (time_t)statBuf.st_mtime);
+        pPrefix = pClock->sDate;
+        nLength = pClock->nDateLen;
+    }
 
-        if (modDate.nDay != pDate->nDay ||
-            modDate.nMonth != pDate->nMonth ||
-            modDate.nYear != pDate->nYear)
-        {
-            pFile->nCurrYear = modDate.nYear;
-            pFile->nCurrMonth = modDate.nMonth;
-            pFile->nCurrDay = modDate.nDay;
-            slog_rotate_file(pFile, pCfg);
-        }
+    if (pPrefix == NULL)
+    {
+        pOut[0] = SLOG_NUL;
+        return 0;
     }
 
+    uint16_t nMsec = pCtx->date.nUsec;
+    memcpy(pOut, pPrefix, nLength);
+    pOut[nLength++] = (char)('0' + nMsec / 100 % 10);
+    pOut[nLength++] = (char)('0' + nMsec / 10 % 10);
+    pOut[nLength++] = (char)('0' + nMsec % 10);
+    pOut[nLength++] = ' ';
+    pOut[nLength] = SLOG_NUL;
+    return nLength;
+}
+
+static uint64_t slog_time_ms(void)
+{
 #ifdef _WIN32
-    /* Keep the file readable for other processes while the handle is open */
-    pFile->pHandle = _fsopen(pFile->sFilePath, "a", _SH_DENYNO);
+    return (uint64_t)GetTickCount64();
 #else
-    pFile->pHandle = fopen(pFile->sFilePath, "a");
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)(ts.tv_nsec / 1000000);
 #endif
+}
 
-    if (pFile->pHandle == NULL)
-    {
+static uint64_t slog_time_ns(void)
+{
 #ifdef _WIN32
-        char sError[SLOG_INFO_MAX];
-        strerror_s(sError, sizeof(sError), errno);
-        char *pError = sError;
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    if (!frequency.QuadPart) QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)((double)counter.QuadPart * 1000000000.0 / (double)frequency.QuadPart);
 #else
-        char *pError = strerror(errno);
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
 #endif
+}
 
-        printf("<%s:%d> %s: [ERROR] Failed to open file: %s (%s)\n",
-            __FILE__, __LINE__, __func__, pFile->sFilePath, pError);
+/* Resolution of a few milliseconds is enough for the rate limits, the coarse clock is much cheaper */
+static uint64_t slog_time_us(void)
+{
+#ifdef _WIN32
+    return (uint64_t)GetTickCount64() * 1000;
+#else
+    struct timespec ts;
+#ifdef CLOCK_MONOTONIC_COARSE
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)(ts.tv_nsec / 1000);
+#endif
+}
 
-        return 0;
+static void slog_flush_buffer(slog_file_t *pFile)
+{
+    if (pFile->pHandle != NULL && pFile->nBufferUsed)
+    {
+        if (fwrite(pFile->pBuffer, 1, pFile->nBufferUsed, pFile->pHandle) != pFile->nBufferUsed) pFile->nErrors++;
+        fflush(pFile->pHandle);
     }
 
-    pFile->nCurrYear = pDate->nYear;
-    pFile->nCurrMonth = pDate->nMonth;
-    pFile->nCurrDay = pDate->nDay;
+    pFile->nBufferUsed = 0;
+}
 
-    return 1;
+static void slog_free_buffer(slog_file_t *pFile)
+{
+    free(pFile->pBuffer);
+    pFile->pBuffer = NULL;
+    pFile->nBufferSize = 0;
+    pFile->nBufferUsed = 0;
 }
 
-static size_t slog_get_tid()
+#ifndef _WIN32
+static uint8_t slog_allocate_file(int nFd, uint64_t nOffset, size_t nSize)
 {
 #ifdef __linux__
-    return syscall(__NR_gettid);
-#elif _WIN32
-    return (size_t)GetCurrentThreadId();
-#else
-    return (size_t)pthread_self();
+    if (!fallocate(nFd, 0, (off_t)nOffset, (off_t)nSize)) return 1;
 #endif
+
+    struct stat statBuf;
+    if (fstat(nFd, &statBuf) < 0) return 0;
+    if ((uint64_t)statBuf.st_size >= nOffset + nSize) return 1;
+
+    return ftruncate(nFd, (off_t)(nOffset + nSize)) ? 0 : 1;
 }
 
-static void slog_create_tag(char *pOut, size_t nSize, slog_flag_t eFlag, const char *pColor)
+/* Map a window that starts at the page of the current end of the file */
+static uint8_t slog_map_region(slog_file_t *pFile, size_t nMinSize)
 {
-    slog_config_t *pCfg = &g_slog.config;
-    pOut[0] = SLOG_NUL;
+    int nFd = fileno(pFile->pHandle);
+    uint64_t nPageSize = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t nOffset = pFile->nFileSize - pFile->nFileSize % nPageSize;
 
-    const char *pIndent = slog_get_indent(eFlag);
-    const char *pTag = slog_get_tag(eFlag);
+    size_t nNeeded = (size_t)(pFile->nFileSize - nOffset) + nMinSize;
+    size_t nSize = SLOG_MMAP_CHUNK;
+    while (nSize < nNeeded) nSize <<= 1;
 
-    if (pTag == NULL)
+    if (!slog_allocate_file(nFd, nOffset, nSize)) return 0;
+    void *pMap = mmap(NULL, nSize, PROT_READ | PROT_WRITE, MAP_SHARED, nFd, (off_t)nOffset);
+    if (pMap == MAP_FAILED) return 0;
+
+    pFile->pMap = (char*)pMap;
+    pFile->nMapOffset = nOffset;
+    pFile->nMapSize = nSize;
+    return 1;
+}
+
+/* Cut the preallocated part of the file down to the length actually written */
+static void slog_trim_file(slog_file_t *pFile)
+{
+    if (ftruncate(fileno(pFile->pHandle), (off_t)pFile->nFileSize) < 0)
     {
-        snprintf(pOut, nSize, "%s", pIndent);
-        return;
+        printf("<%s:%d> %s: [ERROR] Failed to truncate file: %s (%d)\n",
+            __FILE__, __LINE__, __func__, pFile->sFilePath, errno);
     }
-
-    if (pCfg->eColorFormat != SLOG_COLORING_TAG) snprintf(pOut, nSize, "<%s>%s", pTag, pIndent);
-    else snprintf(pOut, nSize, "%s<%s>%s%s", pColor, pTag, SLOG_COLOR_RESET, pIndent);
 }
 
-static void slog_create_tid(char *pOut, int nSize, uint8_t nTraceTid)
+static void slog_unmap_file(slog_file_t *pFile)
 {
-    if (!nTraceTid) pOut[0] = SLOG_NUL;
-    else snprintf(pOut, nSize, "(%zu) ", slog_get_tid());
+    if (pFile->pMap == NULL) return;
+    munmap(pFile->pMap, pFile->nMapSize);
+    slog_trim_file(pFile);
+
+    pFile->pMap = NULL;
+    pFile->nMapSize = 0;
 }
 
-static void slog_display_message(const slog_context_t *pCtx, const char *pInfo, int nInfoLen, const char *pInput)
+/* A crash leaves the zero filled tail of the last window, find where the data ends */
+static uint64_t slog_map_length(int nFd, uint64_t nFileSize)
 {
-    slog_config_t *pCfg = &g_slog.config;
-    slog_file_t *pFile = &g_slog.logFile;
-    int nCbVal = 1;
+    uint64_t nPageSize = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t nStart = nFileSize > SLOG_MMAP_CHUNK ? nFileSize - SLOG_MMAP_CHUNK : 0;
+    nStart -= nStart % nPageSize;
 
-    uint8_t nFullColor = pCfg->eColorFormat == SLOG_COLORING_FULL ? 1 : 0;
-    const char *pSeparator = nInfoLen > 0 ? pCfg->sSeparator : SLOG_EMPTY;
-    const char *pNewLine = pCtx->nNewLine ? SLOG_NEWLINE : SLOG_EMPTY;
-    const char *pMessage = pInput != NULL ? pInput : SLOG_EMPTY;
-    const char *pReset = nFullColor ? SLOG_COLOR_RESET : SLOG_EMPTY;
+    size_t nSize = (size_t)(nFileSize - nStart);
+    if (!nSize) return nFileSize;
 
-    if (pCfg->logCallback != NULL)
-    {
-        int nLength = 0;
-        char *pLog = NULL;
+    char *pData = (char*)mmap(NULL, nSize, PROT_READ, MAP_SHARED, nFd, (off_t)nStart);
+    if (pData == (char*)MAP_FAILED) return nFileSize;
 
-#ifdef _WIN32
-        nLength = slog_asprintf(&pLog, "%s%s%s%s%s", pInfo,
-            pSeparator, pMessage, pReset, pNewLine);
-#else
-        nLength = asprintf(&pLog, "%s%s%s%s%s", pInfo,
-            pSeparator, pMessage, pReset, pNewLine);
-#endif
+    while (nSize > 0 && pData[nSize - 1] == SLOG_NUL) nSize--;
+    munmap(pData, (size_t)(nFileSize - nStart));
 
-        if (pLog != NULL && nLength > 0)
-        {
-            nCbVal = pCfg->logCallback (
-                pLog,
-                (size_t)nLength,
-                pCtx->eFlag,
-                pCfg->pCallbackCtx
-            );
+    return nStart + nSize;
+}
 
-            free(pLog);
-        }
-    }
+static void slog_map_open(slog_file_t *pFile)
+{
+    struct stat statBuf;
+    int nFd = fileno(pFile->pHandle);
+    if (fstat(nFd, &statBuf) < 0) return;
 
-    if (pCfg->nToScreen && nCbVal > 0)
-    {
-        printf("%s%s%s%s%s", pInfo, pSeparator, pMessage, pReset, pNewLine);
-        if (pCfg->nFlush) fflush(stdout);
-    }
+    pFile->nFileSize = slog_map_length(nFd, (uint64_t)statBuf.st_size);
+    if (slog_map_region(pFile, 0)) return;
 
-    if (!pCfg->nToFile || nCbVal < 0) return;
-    const slog_date_t *pDate = &pCtx->date;
+    printf("<%s:%d> %s: [ERROR] Failed to map file: %s (%d)\n",
+        __FILE__, __LINE__, __func__, pFile->sFilePath, errno);
+
+    /* Fall back to the regular writes after the real end of the file */
+    slog_trim_file(pFile);
+}
+
+/* Copy the line into the mapping, returns 0 if it has to be written in the regular way */
+static uint8_t slog_map_line(slog_file_t *pFile, const char *pLine, size_t nLength)
+{
+    size_t nPosition = (size_t)(pFile->nFileSize - pFile->nMapOffset);
 
-    if (pCfg->nRotate &&
-       (pFile->nCurrDay != pDate->nDay ||
-        pFile->nCurrMonth != pDate->nMonth ||
-        pFile->nCurrYear != pDate->nYear))
+    if (nPosition + nLength > pFile->nMapSize)
     {
-        /* Zero day means we did not open the log file yet, nothing to archive */
-        if (!pFile->nCurrDay) slog_close_file(pFile);
-        else slog_rotate_file(pFile, pCfg);
-    }
+        munmap(pFile->pMap, pFile->nMapSize);
+        pFile->pMap = NULL;
 
-    if (pFile->pHandle == NULL && !slog_open_file(pFile, pCfg, pDate)) return;
+        if (!slog_map_region(pFile, nLength))
+        {
+            slog_trim_file(pFile);
+            return 0;
+        }
 
-    fprintf(pFile->pHandle, "%s%s%s%s%s", pInfo,
-        pSeparator, pMessage, pReset, pNewLine);
+        nPosition = (size_t)(pFile->nFileSize - pFile->nMapOffset);
+    }
 
-    if (pCfg->nFlush) fflush(pFile->pHandle);
-    if (!pCfg->nKeepOpen) slog_close_file(pFile);
+    memcpy(pFile->pMap + nPosition, pLine, nLength);
+    pFile->nFileSize += nLength;
+    return 1;
 }
+#endif
 
-static int slog_create_info(const slog_context_t *pCtx, char* pOut, size_t nSize)
+/* Returns 1 if the entry is an archive of the log named pName and sets its order */
+static uint8_t slog_parse_archive(const char *pEntry, const char *pName, uint64_t *pOrder)
 {
-    slog_config_t *pCfg = &g_slog.config;
-    const slog_date_t *pDate = &pCtx->date;
+    size_t nNameLen = strlen(pName);
+    if (strncmp(pEntry, pName, nNameLen) || pEntry[nNameLen] != '-') return 0;
 
-    char sDate[SLOG_DATE_MAX + SLOG_NAME_MAX];
-    sDate[0] = SLOG_NUL;
+    const char *pDate = pEntry + nNameLen + 1;
+    unsigned int nYear, nMonth, nDay, nSegment = 0;
+    int nUsed = 0;
 
-    if (pCfg->eDateControl == SLOG_TIME_ONLY)
-    {
-        snprintf(sDate, sizeof(sDate), "%02d:%02d:%02d.%03d ",
-            pDate->nHour, pDate->nMin, pDate->nSec, pDate->nUsec);
-    }
-    else if (pCfg->eDateControl == SLOG_DATE_FULL)
+    if (sscanf(pDate, "%4u-%2u-%2u%n", &nYear, &nMonth, &nDay, &nUsed) != 3 || nUsed != 10) return 0;
+    const char *pSuffix = pDate + nUsed;
+
+    if (pSuffix[0] == '.' && pSuffix[1] >= '0' && pSuffix[1] <= '9')
     {
-        snprintf(sDate, sizeof(sDate), "%04d.%02d.%02d-%02d:%02d:%02d.%03d ",
-            pDate->nYear, pDate->nMonth, pDate->nDay, pDate->nHour,
-            pDate->nMin, pDate->nSec, pDate->nUsec);
+        char *pEnd = NULL;
+        nSegment = (unsigned int)strtoul(pSuffix + 1, &pEnd, 10);
+        pSuffix = pEnd;
     }
 
-    char sTid[SLOG_TAG_MAX], sTag[SLOG_TAG_MAX];
-    uint8_t nFullColor = pCfg->eColorFormat == SLOG_COLORING_FULL ? 1 : 0;
-
-    const char *pColorCode = slog_get_color(pCtx->eFlag);
-    const char *pColor = nFullColor ? pColorCode : SLOG_EMPTY;
+    if (strcmp(pSuffix, ".log") &&
+        strcmp(pSuffix, ".log.gz") &&
+        strcmp(pSuffix, ".log.zst")) return 0;
 
-    slog_create_tid(sTid, sizeof(sTid), pCfg->nTraceTid);
-    slog_create_tag(sTag, sizeof(sTag), pCtx->eFlag, pColorCode);
-    return snprintf(pOut, nSize, "%s%s%s%s", pColor, sTid, sDate, sTag);
+    *pOrder = ((uint64_t)(nYear * 10000 + nMonth * 100 + nDay) << 32) | nSegment;
+    return 1;
 }
 
-static void slog_display_heap(const slog_context_t *pCtx, va_list args)
+static void slog_add_archive(slog_archives_t *pArchives, const char *pEntry, const char *pName, uint64_t nSize)
 {
-    int nBytes = 0;
-    char *pMessage = NULL;
-    char sLogInfo[SLOG_INFO_MAX];
-
-#ifdef _WIN32
-    nBytes = slog_vasprintf(&pMessage, pCtx->pFormat, args);
-#else
-    nBytes = vasprintf(&pMessage, pCtx->pFormat, args);
-#endif
-
-    /* Note: args is closed by the caller, closing it twice is undefined */
-    (void)nBytes;
+    uint64_t nOrder = 0;
+    if (!slog_parse_archive(pEntry, pName, &nOrder)) return;
 
-    if (pMessage == NULL)
+    if (pArchives->nCount == pArchives->nCapacity)
     {
-        printf("<%s:%d> %s<error>%s %s: Can not allocate memory for input: errno(%d)\n", 
-            __FILE__, __LINE__, SLOG_COLOR_RED, SLOG_COLOR_RESET, __func__, errno);
+        size_t nCapacity = pArchives->nCapacity ? pArchives->nCapacity * 2 : 16;
+        slog_archive_t *pItems = (slog_archive_t*)realloc(pArchives->pItems, nCapacity * sizeof(slog_archive_t));
+        if (pItems == NULL) return;
 
-        return;
+        pArchives->pItems = pItems;
+        pArchives->nCapacity = nCapacity;
     }
 
-    int nLength = slog_create_info(pCtx, sLogInfo, sizeof(sLogInfo));
-    slog_display_message(pCtx, sLogInfo, nLength, pMessage);
-    if (pMessage != NULL) free(pMessage);
+    slog_archive_t *pArchive = &pArchives->pItems[pArchives->nCount++];
+    snprintf(pArchive->sName, sizeof(pArchive->sName), "%s", pEntry);
+    pArchive->nOrder = nOrder;
+    pArchive->nSize = nSize;
+    pArchives->nTotal += nSize;
 }
 
-static void slog_display_stack(const slog_context_t *pCtx, va_list args)
+static int slog_compare_archives(const void *pFirst, const void *pSecond)
 {
-    char sMessage[SLOG_MESSAGE_MAX];
-    char sLogInfo[SLOG_INFO_MAX];
-
-    vsnprintf(sMessage, sizeof(sMessage), pCtx->pFormat, args);
-    int nLength = slog_create_info(pCtx, sLogInfo, sizeof(sLogInfo));
-    slog_display_message(pCtx, sLogInfo, nLength, sMessage);
+    uint64_t nFirst = ((const slog_archive_t*)pFirst)->nOrder;
+    uint64_t nSecond = ((const slog_archive_t*)pSecond)->nOrder;
+    return nFirst < nSecond ? -1 : (nFirst > nSecond ? 1 : 0);
 }
 
-void slog_display(slog_flag_t eFlag, uint8_t nNewLine, const char *pFormat, ...)
+/* Collect the archives of the log named pName, sorted from the oldest */
+static void slog_scan_archives(const char *pDirectory, const char *pName, slog_archives_t *pArchives)
 {
-    slog_sync_lock(&g_slog);
-    slog_config_t *pCfg = &g_slog.config;
-
-    if ((SLOG_FLAGS_CHECK(g_slog.config.nFlags, eFlag)) &&
-        (g_slog.config.logCallback ||
-         g_slog.config.nToScreen ||
-         g_slog.config.nToFile))
-    {
-        slog_context_t ctx;
-        slog_get_date(&ctx.date);
+    char sPath[SLOG_FILE_PATH_MAX];
+    memset(pArchives, 0, sizeof(slog_archives_t));
 
-        ctx.eFlag = eFlag;
-        ctx.pFormat = pFormat;
-        ctx.nNewLine = nNewLine;
+#ifdef _WIN32
+    WIN32_FIND_DATAA findData;
+    snprintf(sPath, sizeof(sPath), "%s/%s-*", pDirectory, pName);
 
-        void(*slog_display_args)(const slog_context_t *pCtx, va_list args);
-        slog_display_args = pCfg->nUseHeap ? slog_display_heap : slog_display_stack;
+    HANDLE hFind = FindFirstFileA(sPath, &findData);
+    if (hFind == INVALID_HANDLE_VALUE) return;
 
-        va_list args;
-        va_start(args, pFormat);
-        slog_display_args(&ctx, args);
-        va_end(args);
+    do
+    {
+        uint64_t nSize = ((uint64_t)findData.nFileSizeHigh << 32) | findData.nFileSizeLow;
+        slog_add_archive(pArchives, findData.cFileName, pName, nSize);
     }
+    while (FindNextFileA(hFind, &findData));
+    FindClose(hFind);
+#else
+    DIR *pDir = opendir(pDirectory);
+    if (pDir == NULL) return;
 
-    slog_sync_unlock(&g_slog);
-}
+    struct dirent *pEntry;
+    while ((pEntry = readdir(pDir)) != NULL)
+    {
+        struct stat statBuf;
+        snprintf(sPath, sizeof(sPath), "%s/%s", pDirectory, pEntry->d_name);
+        if (stat(sPath, &statBuf) < 0 || !S_ISREG(statBuf.st_mode)) continue;
+        slog_add_archive(pArchives, pEntry->d_name, pName, (uint64_t)statBuf.st_size);
+    }
 
-uint8_t slog_is_init(void)
-{
-    return g_nSlogInit ? 1 : 0;
-}
+    closedir(pDir);
+#endif
 
-const char* slog_version(uint8_t nShort)
-{
-    return nShort ? g_slogVerShort : g_slogVerLong;
+    if (pArchives->nCount > 1)
+        qsort(pArchives->pItems, pArchives->nCount, sizeof(slog_archive_t), slog_compare_archives);
 }
 
-void slog_config_get(slog_config_t *pCfg)
+/* Delete the oldest archives until both limits are satisfied */
+static void slog_apply_retention(const char *pDirectory, const char *pName, uint32_t nMaxArchives, uint64_t nMaxTotalSize)
 {
-    slog_sync_lock(&g_slog);
-    *pCfg = g_slog.config;
-    slog_sync_unlock(&g_slog);
-}
+    char sPath[SLOG_FILE_PATH_MAX];
+    slog_archives_t archives;
+    size_t i;
 
-void slog_config_set(slog_config_t *pCfg)
-{
-    slog_sync_lock(&g_slog);
-    slog_config_t *pOldCfg = &g_slog.config;
-    slog_file_t *pFile = &g_slog.logFile;
+    slog_scan_archives(pDirectory, pName, &archives);
 
-    if (!pCfg->nToFile ||
-        strncmp(pOldCfg->sFilePath, pCfg->sFilePath, sizeof(pOldCfg->sFilePath)) ||
-        strncmp(pOldCfg->sFileName, pCfg->sFileName, sizeof(pOldCfg->sFileName)))
+    for (i = 0; i < archives.nCount; i++)
     {
-        slog_close_file(pFile); /* Log function will open it again if required */
-        pFile->sFilePath[0] = SLOG_NUL;
+        size_t nLeft = archives.nCount - i;
+        if ((!nMaxArchives || nLeft <= nMaxArchives) &&
+            (!nMaxTotalSize || archives.nTotal <= nMaxTotalSize)) break;
+
+        snprintf(sPath, sizeof(sPath), "%s/%s", pDirectory, archives.pItems[i].sName);
+        if (remove(sPath) == 0) archives.nTotal -= archives.pItems[i].nSize;
     }
 
-    g_slog.config = *pCfg;
-    slog_sync_unlock(&g_slog);
+    free(archives.pItems);
 }
 
-void slog_enable(slog_flag_t eFlag)
+/* Compress the segment with the external gzip or zstd tool, it replaces the file */
+static void slog_compress_file(const char *pPath, slog_compress_t eCompress)
 {
-    slog_sync_lock(&g_slog);
-    slog_config_t *pCfg = &g_slog.config;
+#ifndef _WIN32
+    char *pArgs[6];
+    int nArgs = 0;
+    pid_t nPid;
 
-    if (eFlag == SLOG_FLAGS_ALL) pCfg->nFlags = SLOG_FLAGS_ALL;
-    else if (!SLOG_FLAGS_CHECK(pCfg->nFlags, eFlag)) pCfg->nFlags |= eFlag;
+    if (eCompress == SLOG_COMPRESS_GZIP)
+    {
+        pArgs[nArgs++] = (char*)"gzip";
+        pArgs[nArgs++] = (char*)"-f";
+    }
+    else
+    {
+        pArgs[nArgs++] = (char*)"zstd";
+        pArgs[nArgs++] = (char*)"-q";
+        pArgs[nArgs++] = (char*)"-f";
+        pArgs[nArgs++] = (char*)"--rm";
+    }
 
-    slog_sync_unlock(&g_slog);
-}
+    pArgs[nArgs++] = (char*)pPath;
+    pArgs[nArgs] = NULL;
 
-void slog_disable(slog_flag_t eFlag)
-{
-    slog_sync_lock(&g_slog);
-    slog_config_t *pCfg = &g_slog.config;
+    int nStatus = posix_spawnp(&nPid, pArgs[0], NULL, NULL, pArgs, environ);
+    if (nStatus != 0)
+    {
+        printf("<%s:%d> %s: [ERROR] Failed to start %s: %s\n",
+            __FILE__, __LINE__, __func__, pArgs[0], strerror(nStatus));
+        return;
+    }
 
-    if (eFlag == SLOG_FLAGS_ALL) pCfg->nFlags = 0;
-    else if (SLOG_FLAGS_CHECK(pCfg->nFlags, eFlag)) pCfg->nFlags &= ~eFlag;
+    while (waitpid(nPid, &nStatus, 0) < 0 && errno == EINTR);
 
-    slog_sync_unlock(&g_slog);
+    if (!WIFEXITED(nStatus) || WEXITSTATUS(nStatus))
+    {
+        printf("<%s:%d> %s: [ERROR] Failed to compress file: %s\n",
+            __FILE__, __LINE__, __func__, pPath);
+    }
+#else
+    /* There is no compressor we can rely on, the segments are kept as they are */
+    (void)pPath;
+    (void)eCompress;
+#endif
 }
 
-void slog_separator_set(const char *pFormat, ...)
+/* Compress every rotated segment which is still plain, oldest first */
+static void slog_compress_pending(const char *pDirectory, const char *pName, slog_compress_t eCompress)
 {
-    slog_sync_lock(&g_slog);
-    slog_config_t *pCfg = &g_slog.config;
+    char sPath[SLOG_FILE_PATH_MAX];
+    slog_archives_t archives;
+    size_t i;
 
-    va_list args;
-    va_start(args, pFormat);
+    slog_scan_archives(pDirectory, pName, &archives);
 
-    if (vsnprintf(pCfg->sSeparator, sizeof(pCfg->sSeparator), pFormat, args) <= 0)
+    for (i = 0; i < archives.nCount; i++)
     {
-        pCfg->sSeparator[0] = ' ';
-        pCfg->sSeparator[1] = '\0';
-    }
+        size_t nLength = strlen(archives.pItems[i].sName);
+        if (nLength < 4 || strcmp(archives.pItems[i].sName + nLength - 4, ".log")) continue;
 
-    va_end(args);
-    slog_sync_unlock(&g_slog);
-}
+        snprintf(sPath, sizeof(sPath), "%s/%s", pDirectory, archives.pItems[i].sName);
+        slog_compress_file(sPath, eCompress);
+    }
 
-void slog_callback_set(slog_cb_t callback, void *pContext)
-{
-    slog_sync_lock(&g_slog);
-    slog_config_t *pCfg = &g_slog.config;
-    pCfg->pCallbackCtx = pContext;
-    pCfg->logCallback = callback;
-    slog_sync_unlock(&g_slog);
+    free(archives.pItems);
 }
 
-size_t slog_get_full_path(char *pFilePath, size_t nSize)
+static slog_thread_ret_t SLOG_THREAD_API slog_archiver_worker(void *pArg)
 {
-    if (pFilePath == NULL || !nSize) return 0;
-    slog_sync_lock(&g_slog);
+    slog_archiver_t *pArchiver = (slog_archiver_t*)pArg;
+    char sDirectory[SLOG_PATH_MAX];
+    char sName[SLOG_NAME_MAX];
 
-    slog_file_t *pFile = &g_slog.logFile;
-    int nLength = snprintf(pFilePath, nSize, "%s", pFile->sFilePath);
+    for (;;)
+    {
+        slog_mutex_lock(&pArchiver->mutex);
 
-    /* snprintf() returns the length it wanted to write, clamp it to the buffer */
-    if (nLength < 0) nLength = 0;
-    else if ((size_t)nLength >= nSize) nLength = (int)nSize - 1;
-    pFilePath[nLength] = SLOG_NUL;
+        while (!pArchiver->nPending && !slog_atomic_get(&pArchiver->nStop))
+            slog_cond_wait(&pArchiver->cond, &pArchiver->mutex, SLOG_ASYNC_IDLE_MS);
 
-    slog_sync_unlock(&g_slog);
-    return (size_t)nLength;
-}
+        /* Stop only when the last rotation is processed */
+        if (!pArchiver->nPending)
+        {
+            slog_mutex_unlock(&pArchiver->mutex);
+            break;
+        }
 
-size_t slog_path_set(const char *pPath)
-{
-    if (pPath == NULL) return 0;
-    slog_sync_lock(&g_slog);
+        memcpy(sDirectory, pArchiver->sDirectory, sizeof(sDirectory));
+        memcpy(sName, pArchiver->sName, sizeof(sName));
+        slog_compress_t eCompress = pArchiver->eCompress;
+        uint32_t nMaxArchives = pArchiver->nMaxArchives;
+        uint64_t nMaxTotalSize = pArchiver->nMaxTotalSize;
 
-    slog_config_t *pCfg = &g_slog.config;
-    slog_file_t *pFile = &g_slog.logFile;
+        pArchiver->nPending = 0;
+        slog_mutex_unlock(&pArchiver->mutex);
 
-    if (strncmp(pCfg->sFilePath, pPath, sizeof(pCfg->sFilePath)))
-    {
-        slog_close_file(pFile); /* Log function will open it again if required */
-        pFile->sFilePath[0] = SLOG_NUL;
+        /* Segments rotated during the scan set nPending again and get the next one */
+        if (eCompress != SLOG_COMPRESS_NONE) slog_compress_pending(sDirectory, sName, eCompress);
+        if (nMaxArchives || nMaxTotalSize) slog_apply_retention(sDirectory, sName, nMaxArchives, nMaxTotalSize);
     }
 
-    int nLength = snprintf(pCfg->sFilePath, sizeof(pCfg->sFilePath), "%s", pPath);
-    if (nLength < 0) nLength = 0;
-    else if ((size_t)nLength >= sizeof(pCfg->sFilePath)) nLength = (int)sizeof(pCfg->sFilePath) - 1;
-
-    slog_sync_unlock(&g_slog);
-    return (size_t)nLength;
+    return (slog_thread_ret_t)0;
 }
 
-size_t slog_name_set(const char *pName)
+static void slog_archiver_start(slog_file_t *pFile)
 {
-    if (pName == NULL) return 0;
-    slog_sync_lock(&g_slog);
+    slog_archiver_t *pArchiver = (slog_archiver_t*)calloc(1, sizeof(slog_archiver_t));
+    if (pArchiver == NULL) return;
 
-    slog_config_t *pCfg = &g_slog.config;
-    slog_file_t *pFile = &g_slog.logFile;
+    slog_mutex_init(&pArchiver->mutex);
+    slog_cond_init(&pArchiver->cond);
 
-    if (strncmp(pCfg->sFileName, pName, sizeof(pCfg->sFileName)))
+    if (!slog_thread_create(&pArchiver->thread, slog_archiver_worker, pArchiver))
     {
-        slog_close_file(pFile); /* Log function will open it again if required */
-        pFile->sFilePath[0] = SLOG_NUL;
-    }
+        printf("<%s:%d> %s: [ERROR] Can not start archiver thread: %d\n",
+            __FILE__, __LINE__, __func__, errno);
 
-    int nLength = snprintf(pCfg->sFileName, sizeof(pCfg->sFileName), "%s", pName);
-    if (nLength < 0) nLength = 0;
-    else if ((size_t)nLength >= sizeof(pCfg->sFileName)) nLength = (int)sizeof(pCfg->sFileName) - 1;
+        slog_cond_destroy(&pArchiver->cond);
+        slog_mutex_destroy(&pArchiver->mutex);
+        free(pArchiver);
+        return;
+    }
 
-    slog_sync_unlock(&g_slog);
-    return (size_t)nLength;
+    pFile->pArchiver = pArchiver;
 }
 
-void slog_color_format_set(slog_coloring_t eFmt)
+/* Waits until the pending segments are processed, the thread never takes the logger lock */
+static void slog_archiver_stop(slog_file_t *pFile)
 {
-    slog_sync_lock(&g_slog);
-    g_slog.config.eColorFormat = eFmt;
-    slog_sync_unlock(&g_slog);
+    slog_archiver_t *pArchiver = pFile->pArchiver;
+    if (pArchiver == NULL) return;
+
+    slog_mutex_lock(&pArchiver->mutex);
+    slog_atomic_set(&pArchiver->nStop, 1);
+    slog_cond_signal(&pArchiver->cond, 0);
+    slog_mutex_unlock(&pArchiver->mutex);
+
+    slog_thread_join(&pArchiver->thread);
+    slog_cond_destroy(&pArchiver->cond);
+    slog_mutex_destroy(&pArchiver->mutex);
+    pFile->pArchiver = NULL;
+    free(pArchiver);
 }
 
-void slog_date_format_set(slog_date_ctrl_t eFmt)
+/* Wake the archiver after a rotation, the logging thread never waits for it */
+static void slog_archive_file(slog_file_t *pFile, const slog_config_t *pCfg)
 {
-    slog_sync_lock(&g_slog);
-    g_slog.config.eDateControl = eFmt;
-    slog_sync_unlock(&g_slog);
-}
+    if (pCfg->eCompress == SLOG_COMPRESS_NONE &&
+        !pCfg->nMaxArchives && !pCfg->nMaxTotalSize) return;
 
-void slog_screen_set(uint8_t nEnable)
-{
-    slog_sync_lock(&g_slog);
-    g_slog.config.nToScreen = nEnable;
-    slog_sync_unlock(&g_slog);
-}
+    if (pFile->pArchiver == NULL) slog_archiver_start(pFile);
+    slog_archiver_t *pArchiver = pFile->pArchiver;
+    if (pArchiver == NULL) return;
 
-void slog_file_set(uint8_t nEnable)
-{
-    slog_sync_lock(&g_slog);
+    slog_mutex_lock(&pArchiver->mutex);
 
-    if (!nEnable) slog_close_file(&g_slog.logFile);
-    g_slog.config.nToFile = nEnable;
+    pArchiver->eCompress = pCfg->eCompress;
+    pArchiver->nMaxArchives = pCfg->nMaxArchives;
+    pArchiver->nMaxTotalSize = pCfg->nMaxTotalSize;
+    snprintf(pArchiver->sDirectory, sizeof(pArchiver->sDirectory), "%s", pCfg->sFilePath);
+    snprintf(pArchiver->sName, sizeof(pArchiver->sName), "%s", pCfg->sFileName);
 
-    slog_sync_unlock(&g_slog);
+    pArchiver->nPending = 1;
+    slog_cond_signal(&pArchiver->cond, 0);
+    slog_mutex_unlock(&pArchiver->mutex);
 }
 
-void slog_flush_set(uint8_t nEnable)
+/* Returns 1 if the segment exists in any of its compressed or plain forms */
+static uint8_t slog_segment_exists(const char *pBase, uint32_t nSegment)
 {
-    slog_sync_lock(&g_slog);
-    g_slog.config.nFlush = nEnable;
-    slog_sync_unlock(&g_slog);
-}
+    static const char *pSuffixes[] = { ".log", ".log.gz", ".log.zst" };
+    char sPath[SLOG_FILE_PATH_MAX + SLOG_TAG_MAX];
+    struct stat statBuf;
+    size_t i;
 
-void slog_indent_set(uint8_t nEnable)
-{
-    slog_sync_lock(&g_slog);
-    g_slog.config.nIndent = nEnable;
-    slog_sync_unlock(&g_slog);
-}
+    for (i = 0; i < sizeof(pSuffixes) / sizeof(pSuffixes[0]); i++)
+    {
+        snprintf(sPath, sizeof(sPath), "%s.%u%s", pBase, nSegment, pSuffixes[i]);
+        if (stat(sPath, &statBuf) == 0) return 1;
+    }
 
-void slog_trace_tid_set(uint8_t nEnable)
-{
-    slog_sync_lock(&g_slog);
-    g_slog.config.nTraceTid = nEnable;
-    slog_sync_unlock(&g_slog);
+    return 0;
 }
 
-void slog_use_heap_set(uint8_t nEnable)
+static void slog_close_file(slog_file_t *pFile)
 {
-    slog_sync_lock(&g_slog);
-    g_slog.config.nUseHeap = nEnable;
-    slog_sync_unlock(&g_slog);
+    if (pFile->pHandle != NULL)
+    {
+        slog_flush_buffer(pFile);
+#ifndef _WIN32
+        slog_unmap_file(pFile);
+#endif
+        fclose(pFile->pHandle);
+        pFile->pHandle = NULL;
+    }
 }
 
-void slog_flags_set(uint16_t nFlags)
+/* Move the active log file into the dated archive of the day it belongs to,
+ * with size rotation enabled every archive is a numbered segment of the day */
+static void slog_rotate_file(slog_file_t *pFile, const slog_config_t *pCfg)
 {
-    slog_sync_lock(&g_slog);
-    g_slog.config.nFlags = nFlags;
-    slog_sync_unlock(&g_slog);
-}
+    struct stat statBuf;
+    slog_close_file(pFile);
 
-uint16_t slog_flags_get(void)
-{
-    slog_sync_lock(&g_slog);
-    uint16_t nFlags = g_slog.config.nFlags;
-    slog_sync_unlock(&g_slog);
-    return nFlags;
-}
+    memset(&statBuf, 0, sizeof(statBuf));
+    if (stat(pFile->sFilePath, &statBuf) < 0) return;
 
-void slog_init(const char* pName, uint16_t nFlags, uint8_t nTdSafe)
-{
-    /* Re-initializing a live mutex is undefined behaviour, so recreate
-     * the lock only if this is the first init or the mode has changed */
-    if (!g_nSlogInit || g_slog.nTdSafe != nTdSafe)
+    char sBase[SLOG_FILE_PATH_MAX];
+    char sRotatedPath[SLOG_FILE_PATH_MAX + SLOG_TAG_MAX];
+    int nLength = snprintf(sBase, sizeof(sBase), "%s/%s-%04u-%02u-%02u",
+        pCfg->sFilePath, pCfg->sFileName, pFile->nCurrDate / 10000,
+        pFile->nCurrDate / 100 % 100, pFile->nCurrDate % 100);
+
+    if (nLength <= 0) return;
+
+    if (!pCfg->nMaxFileSize)
     {
-        if (g_nSlogInit) slog_sync_destroy(&g_slog);
-        g_slog.nTdSafe = nTdSafe;
-        slog_sync_init(&g_slog);
+        snprintf(sRotatedPath, sizeof(sRotatedPath), "%s.log", sBase);
     }
+    else
+    {
+        if (pFile->nSegmentDate != pFile->nCurrDate)
+        {
+            pFile->nSegmentDate = pFile->nCurrDate;
+            pFile->nSegment = 0;
+        }
 
-    slog_sync_lock(&g_slog);
+        /* Segments of a previous run may exist, the probe starts from the last known one */
+        do pFile->nSegment++;
+        while (slog_segment_exists(sBase, pFile->nSegment));
 
-    slog_config_t *pCfg = &g_slog.config;
-    slog_file_t *pFile = &g_slog.logFile;
+        snprintf(sRotatedPath, sizeof(sRotatedPath), "%s.%u.log", sBase, pFile->nSegment);
+    }
 
-    /* Set up default values */
-    pCfg->eColorFormat = SLOG_COLORING_TAG;
-    pCfg->eDateControl = SLOG_TIME_ONLY;
-    pCfg->pCallbackCtx = NULL;
-    pCfg->logCallback = NULL;
-    pCfg->sSeparator[0] = ' ';
-    pCfg->sSeparator[1] = '\0';
-    pCfg->sFilePath[0] = '.';
-    pCfg->sFilePath[1] = '\0';
-    pCfg->nKeepOpen = 1;
-    pCfg->nToScreen = 1;
-    pCfg->nTraceTid = 0;
-    pCfg->nUseHeap = 0;
-    pCfg->nToFile = 0;
-    pCfg->nIndent = 0;
-    pCfg->nRotate = 1;
-    pCfg->nFlush = 0;
-    pCfg->nFlags = nFlags;
+#ifdef _WIN32
+    /* Unlike POSIX, rename() on Windows fails if the destination already exists */
+    remove(sRotatedPath);
+#endif
 
-    const char *pFileName = (pName != NULL) ? pName : SLOG_NAME_DEFAULT;
-    snprintf(pCfg->sFileName, sizeof(pCfg->sFileName), "%s", pFileName);
+    if (rename(pFile->sFilePath, sRotatedPath) == 0)
+    {
+        slog_archive_file(pFile, pCfg);
+        pFile->nRotations++;
+    }
+}
 
-    /* Do not leak the handle if we are re-initialized */
-    slog_close_file(pFile);
+/* Path check interval, without keep open it is always enabled */
+static uint32_t slog_check_interval(const slog_config_t *pCfg)
+{
+    if (pCfg->nReopenCheck) return pCfg->nReopenCheck;
+    return pCfg->nKeepOpen ? 0 : SLOG_REOPEN_CHECK_MS;
+}
 
-    pFile->sFilePath[0] = SLOG_NUL;
-    pFile->nCurrYear = 0;
-    pFile->nCurrMonth = 0;
-    pFile->nCurrDay = 0;
+static uint8_t slog_open_handle(slog_file_t *pFile, const slog_config_t *pCfg)
+{
+#ifdef _WIN32
+    /* Keep the file readable for other processes while the handle is open */
+    pFile->pHandle = _fsopen(pFile->sFilePath, "a", _SH_DENYNO);
+#else
+    /* Shared mapping requires a handle opened for reading too */
+    pFile->pHandle = fopen(pFile->sFilePath, pCfg->nMapFile ? "a+" : "a");
+#endif
 
+    if (pFile->pHandle == NULL)
+    {
 #ifdef _WIN32
-    /* Enable color support */
-    DWORD dwMode = 0;
-    HANDLE hOutput = GetStdHandle(STD_OUTPUT_HANDLE);
-    GetConsoleMode(hOutput, &dwMode);
-    dwMode |= ENABLE_PROCESSED_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING;
-    SetConsoleMode(hOutput, dwMode);
+        char sError[SLOG_INFO_MAX];
+        strerror_s(sError, sizeof(sError), errno);
+        char *pError = sError;
+#else
+        char *pError = strerror(errno);
+#endif
+
+        printf("<%s:%d> %s: [ERROR] Failed to open file: %s (%s)\n",
+            __FILE__, __LINE__, __func__, pFile->sFilePath, pError);
+
+        return 0;
+    }
+
+    /* Buffered lines are coalesced by us and without keep open every line must
+     * reach the file before we return, stdio would only copy them again */
+    if (pCfg->nFileBuffer || !pCfg->nKeepOpen) setvbuf(pFile->pHandle, NULL, _IONBF, 0);
+
+    pFile->nOpens++;
+    return 1;
+}
+
+/* Read the size and identity of the open file, returns its modification time */
+static time_t slog_stat_file(slog_file_t *pFile)
+{
+#ifdef _WIN32
+    struct _stat64 statBuf;
+    if (_fstat64(_fileno(pFile->pHandle), &statBuf) < 0) return 0;
+#else
+    struct stat statBuf;
+    if (fstat(fileno(pFile->pHandle), &statBuf) < 0) return 0;
+#endif
+
+    pFile->nFileSize = (uint64_t)statBuf.st_size;
+    pFile->nDevice = (uint64_t)statBuf.st_dev;
+    pFile->nInode = (uint64_t)statBuf.st_ino;
+    return (time_t)statBuf.st_mtime;
+}
+
+static uint8_t slog_open_file(slog_file_t *pFile, const slog_config_t *pCfg, const slog_date_t *pDate)
+{
+    uint8_t nFirstOpen = pFile->sFilePath[0] == SLOG_NUL;
+    slog_close_file(pFile);
+
+    if (nFirstOpen)
+    {
+        snprintf(pFile->sFilePath, sizeof(pFile->sFilePath), "%s/%s.log",
+            pCfg->sFilePath, pCfg->sFileName);
+    }
+
+    if (!slog_open_handle(pFile, pCfg)) return 0;
+    time_t nModTime = slog_stat_file(pFile);
+
+    /* Later opens follow our own rotation, only the file left behind
+     * by a previous run can belong to a different day */
+    if (nFirstOpen && pCfg->nRotate && nModTime)
+    {
+        slog_date_t modDate;
+        slog_date_from_epoch(&modDate, nModTime);
+
+        if (SLOG_DATE_KEY(&modDate) != SLOG_DATE_KEY(pDate))
+        {
+            pFile->nCurrDate = SLOG_DATE_KEY(&modDate);
+            slog_rotate_file(pFile, pCfg);
+
+            if (!slog_open_handle(pFile, pCfg)) return 0;
+            slog_stat_file(pFile);
+        }
+    }
+
+#ifndef _WIN32
+    if (pCfg->nMapFile) slog_map_open(pFile);
+    uint32_t nInterval = slog_check_interval(pCfg);
+    if (nInterval) pFile->nCheckAt = slog_time_ms() + nInterval;
+#endif
+
+    pFile->nCurrDate = SLOG_DATE_KEY(pDate);
+    return 1;
+}
+
+#ifndef _WIN32
+/* Close the cached handle if the path was moved, removed or replaced by an external
+ * rotation, the file may also be truncated in place so the size is refreshed too */
+static void slog_check_path(slog_file_t *pFile, uint32_t nInterval)
+{
+    uint64_t nNow = slog_time_ms();
+    if (nNow < pFile->nCheckAt) return;
+
+    struct stat statBuf;
+    pFile->nCheckAt = nNow + nInterval;
+
+    if (stat(pFile->sFilePath, &statBuf) == 0 &&
+        (uint64_t)statBuf.st_dev == pFile->nDevice &&
+        (uint64_t)statBuf.st_ino == pFile->nInode)
+    {
+        if (pFile->pMap == NULL) pFile->nFileSize = (uint64_t)statBuf.st_size + pFile->nBufferUsed;
+        return;
+    }
+
+    slog_close_file(pFile);
+}
+#endif
+
+static size_t slog_get_tid()
+{
+#ifdef __linux__
+    return syscall(__NR_gettid);
+#elif _WIN32
+    return (size_t)GetCurrentThreadId();
+#else
+    return (size_t)pthread_self();
+#endif
+}
+
+static void slog_create_tag(const slog_config_t *pCfg, char *pOut, size_t nSize, slog_flag_t eFlag, const char *pColor)
+{
+    pOut[0] = SLOG_NUL;
+
+    const char *pIndent = slog_get_indent(pCfg, eFlag);
+    const char *pTag = slog_get_tag(eFlag);
+
+    if (pTag == NULL)
+    {
+        snprintf(pOut, nSize, "%s", pIndent);
+        return;
+    }
+
+    if (pCfg->eColorFormat != SLOG_COLORING_TAG) snprintf(pOut, nSize, "<%s>%s", pTag, pIndent);
+    else snprintf(pOut, nSize, "%s<%s>%s%s", pColor, pTag, SLOG_COLOR_RESET, pIndent);
+}
+
+#ifndef _WIN32
+/* The child keeps the TLS of the forking thread, but gets a new thread id */
+static void slog_fork_child(void)
+{
+    slog_atomic_add(&g_nSlogForks, 1);
+}
+
+static void slog_fork_register(void)
+{
+    pthread_atfork(NULL, NULL, slog_fork_child);
+}
+#endif
+
+static void slog_thread_render(slog_thread_info_t *pThread)
+{
+    int nLength;
+
+    if (pThread->sName[0] != SLOG_NUL)
+        nLength = snprintf(pThread->sPrefix, sizeof(pThread->sPrefix), "(%s) ", pThread->sName);
+    else nLength = snprintf(pThread->sPrefix, sizeof(pThread->sPrefix), "(%zu) ", pThread->nTid);
+
+    pThread->nPrefixLen = nLength > 0 ? strlen(pThread->sPrefix) : 0;
+}
+
+/* The system call and the rendering are done only once per thread */
+static const slog_thread_info_t* slog_thread_get(void)
+{
+    slog_thread_info_t *pThread = &g_slogThread;
+    size_t nForks = slog_atomic_peek(&g_nSlogForks);
+    if (pThread->nTid && pThread->nForks == nForks) return pThread;
+
+#ifndef _WIN32
+    static pthread_once_t forkOnce = PTHREAD_ONCE_INIT;
+    pthread_once(&forkOnce, slog_fork_register);
+#endif
+
+    pThread->nTid = slog_get_tid();
+    pThread->nForks = nForks;
+    slog_thread_render(pThread);
+    return pThread;
+}
+
+/* Decoded lines carry the id of the recording thread, others use the cached prefix */
+static size_t slog_create_tid(char *pOut, size_t nTid)
+{
+    if (nTid)
+    {
+        int nLength = snprintf(pOut, SLOG_TAG_MAX, "(%zu) ", nTid);
+        return nLength > 0 ? strlen(pOut) : 0;
+    }
+
+    const slog_thread_info_t *pThread = slog_thread_get();
+    memcpy(pOut, pThread->sPrefix, pThread->nPrefixLen);
+    return pThread->nPrefixLen;
+}
+
+/* Rotate the file if the day has changed and make sure the handle is open */
+static uint8_t slog_check_file(slog_file_t *pFile, const slog_config_t *pCfg, const slog_date_t *pDate)
+{
+    if (pCfg->nRotate && pFile->nCurrDate != SLOG_DATE_KEY(pDate))
+    {
+        /* Zero date means we did not open the log file yet, nothing to archive */
+        if (!pFile->nCurrDate) slog_close_file(pFile);
+        else slog_rotate_file(pFile, pCfg);
+    }
+
+    /* Requested by slog_reopen(), possibly from a signal handler */
+    if (slog_atomic_get(&pFile->nReopen))
+    {
+        slog_atomic_set(&pFile->nReopen, 0);
+        slog_close_file(pFile);
+    }
+
+#ifndef _WIN32
+    /* Without keep open the handle is cached and its path is checked on a timer,
+     * the mapped file stays open regardless of nKeepOpen unless asked explicitly */
+    if (pFile->pHandle != NULL && (pCfg->nReopenCheck || (!pCfg->nKeepOpen && pFile->pMap == NULL)))
+        slog_check_path(pFile, slog_check_interval(pCfg));
 #endif
 
-    g_nSlogInit = 1;
-    slog_sync_unlock(&g_slog);
+    if (pFile->pHandle == NULL && !slog_open_file(pFile, pCfg, pDate)) return 0;
+
+    /* The line which crossed the limit was the last one of the segment */
+    if (pCfg->nMaxFileSize && pFile->nFileSize >= pCfg->nMaxFileSize)
+    {
+        slog_rotate_file(pFile, pCfg);
+        return slog_open_file(pFile, pCfg, pDate);
+    }
+
+    return 1;
+}
+
+static uint8_t slog_level_index(slog_flag_t eFlag)
+{
+    uint32_t nFlag = (uint32_t)eFlag;
+    uint8_t nIndex = 0;
+
+    /* Only a single level flag has its own prefix */
+    if (!nFlag || nFlag > SLOG_FATAL || (nFlag & (nFlag - 1))) return SLOG_LEVEL_COUNT;
+    while (nFlag >>= 1) nIndex++;
+
+    return nIndex;
+}
+
+/* Must be called whenever the configuration changes, the hot path only copies the results */
+static void slog_build_prefixes(slog_prefixes_t *pPrefixes, const slog_config_t *pCfg)
+{
+    uint8_t nFullColor = pCfg->eColorFormat == SLOG_COLORING_FULL ? 1 : 0;
+    uint8_t i;
+
+    for (i = 0; i <= SLOG_LEVEL_COUNT; i++)
+    {
+        slog_prefix_t *pPrefix = &pPrefixes->levels[i];
+        slog_flag_t eFlag = (slog_flag_t)(i < SLOG_LEVEL_COUNT ? 1 << i : 0);
+        const char *pColorCode = slog_get_color(eFlag);
+        const char *pLevel = slog_get_tag(eFlag);
+
+        snprintf(pPrefix->sColor, sizeof(pPrefix->sColor), "%s", nFullColor ? pColorCode : SLOG_EMPTY);
+        slog_create_tag(pCfg, pPrefix->sTag, sizeof(pPrefix->sTag), eFlag, pColorCode);
+
+        pPrefix->pLevel = pLevel != NULL ? pLevel : "none";
+        pPrefix->nColorLen = strlen(pPrefix->sColor);
+        pPrefix->nTagLen = strlen(pPrefix->sTag);
+    }
+
+    snprintf(pPrefixes->sReset, sizeof(pPrefixes->sReset), "%s", nFullColor ? SLOG_COLOR_RESET : SLOG_EMPTY);
+    pPrefixes->nResetLen = strlen(pPrefixes->sReset);
+    pPrefixes->nSeparatorLen = strnlen(pCfg->sSeparator, sizeof(pCfg->sSeparator) - 1);
+}
+
+/* The output must hold SLOG_INFO_MAX + SLOG_NAME_MAX bytes, more than all parts together */
+static size_t slog_create_head(const slog_context_t *pCtx, const slog_config_t *pCfg, char *pOut)
+{
+    const slog_prefixes_t *pPrefixes = pCtx->pPrefixes;
+    const slog_prefix_t *pPrefix = &pPrefixes->levels[slog_level_index(pCtx->eFlag)];
+    size_t nLength = pPrefix->nColorLen;
+
+    memcpy(pOut, pPrefix->sColor, nLength);
+    if (pCfg->nTraceTid) nLength += slog_create_tid(pOut + nLength, pCtx->nTid);
+    nLength += slog_create_date(pCtx, pCfg, pOut + nLength);
+
+    memcpy(pOut + nLength, pPrefix->sTag, pPrefix->nTagLen);
+    nLength += pPrefix->nTagLen;
+
+    /* Separator follows only a non-empty header */
+    if (nLength)
+    {
+        memcpy(pOut + nLength, pCfg->sSeparator, pPrefixes->nSeparatorLen);
+        nLength += pPrefixes->nSeparatorLen;
+    }
+
+    pOut[nLength] = SLOG_NUL;
+    g_nSlogBodyOff = nLength;
+    return nLength;
+}
+
+/* The output must hold SLOG_COLOR_MAX bytes */
+static size_t slog_create_tail(const slog_context_t *pCtx, char *pOut)
+{
+    const slog_prefixes_t *pPrefixes = pCtx->pPrefixes;
+    size_t nLength = pPrefixes->nResetLen;
+
+    memcpy(pOut, pPrefixes->sReset, nLength);
+    if (pCtx->nNewLine) pOut[nLength++] = '\n';
+
+    pOut[nLength] = SLOG_NUL;
+    return nLength;
+}
+
+/* 0 - copied as is, 'u' - written as \u00XX, other - two character escape */
+static const char g_slogEscape[256] = {
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    0, 0, '"', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\\', 0, 0, 0
+};
+
+/* Bounded output of the structured lines, only the closing characters may go past nSize */
+typedef struct slog_writer {
+    char *pOut;
+    size_t nSize;
+    size_t nLimit;
+    size_t nLength;
+    uint8_t nFull;
+} slog_writer_t;
+
+/* Plain text may be cut, tokens are written whole or not at all */
+static void slog_write_raw(slog_writer_t *pWriter, const char *pData, size_t nLength)
+{
+    size_t nAvail = pWriter->nSize - pWriter->nLength;
+    if (nLength > nAvail)
+    {
+        nLength = nAvail;
+        pWriter->nFull = 1;
+    }
+
+    memcpy(pWriter->pOut + pWriter->nLength, pData, nLength);
+    pWriter->nLength += nLength;
+}
+
+static void slog_write_token(slog_writer_t *pWriter, const char *pData, size_t nLength)
+{
+    if (pWriter->nFull || pWriter->nLength + nLength > pWriter->nSize) pWriter->nFull = 1;
+    else slog_write_raw(pWriter, pData, nLength);
+}
+
+static void slog_write_close(slog_writer_t *pWriter, const char *pData, size_t nLength)
+{
+    if (pWriter->nLength + nLength > pWriter->nLimit) return;
+    memcpy(pWriter->pOut + pWriter->nLength, pData, nLength);
+    pWriter->nLength += nLength;
+}
+
+static void slog_write_escaped(slog_writer_t *pWriter, const char *pData, size_t nLength)
+{
+    static const char sHex[] = "0123456789abcdef";
+    const char *pEnd = pData + nLength;
+
+    while (pData < pEnd && !pWriter->nFull)
+    {
+        const char *pRun = pData;
+        while (pRun < pEnd && !g_slogEscape[(uint8_t)*pRun]) pRun++;
+
+        slog_write_raw(pWriter, pData, (size_t)(pRun - pData));
+        if (pRun == pEnd) break;
+
+        uint8_t nChar = (uint8_t)*pRun;
+        char cEscape = g_slogEscape[nChar];
+
+        if (cEscape == 'u')
+        {
+            char sCode[6] = { '\\', 'u', '0', '0', sHex[nChar >> 4], sHex[nChar & 15] };
+            slog_write_token(pWriter, sCode, sizeof(sCode));
+        }
+        else
+        {
+            char sCode[2] = { '\\', cEscape };
+            slog_write_token(pWriter, sCode, sizeof(sCode));
+        }
+
+        pData = pRun + 1;
+    }
+}
+
+static void slog_write_uint(slog_writer_t *pWriter, uint64_t nValue, uint8_t nNegative)
+{
+    char sDigits[24];
+    size_t nPos = sizeof(sDigits);
+
+    do
+    {
+        sDigits[--nPos] = (char)('0' + nValue % 10);
+        nValue /= 10;
+    }
+    while (nValue);
+
+    if (nNegative) sDigits[--nPos] = '-';
+    slog_write_token(pWriter, sDigits + nPos, sizeof(sDigits) - nPos);
+}
+
+static void slog_write_string(slog_writer_t *pWriter, slog_format_t eFormat, const char *pValue, size_t nLength)
+{
+    uint8_t nQuote = eFormat == SLOG_FORMAT_JSON || !nLength;
+    size_t i;
+
+    /* logfmt values are quoted only when they can not be parsed otherwise */
+    for (i = 0; i < nLength && !nQuote; i++)
+    {
+        char cChar = pValue[i];
+        if (cChar == ' ' || cChar == '=' || g_slogEscape[(uint8_t)cChar]) nQuote = 1;
+    }
+
+    if (!nQuote)
+    {
+        slog_write_raw(pWriter, pValue, nLength);
+        return;
+    }
+
+    slog_write_token(pWriter, "\"", 1);
+    if (pWriter->nFull) return;
+
+    slog_write_escaped(pWriter, pValue, nLength);
+    slog_write_close(pWriter, "\"", 1);
 }
 
-void slog_destroy()
+static void slog_write_key(slog_writer_t *pWriter, slog_format_t eFormat, const char *pKey, uint8_t nFirst)
 {
-    slog_sync_lock(&g_slog);
-    slog_close_file(&g_slog.logFile);
-    memset(&g_slog.config, 0, sizeof(g_slog.config));
+    if (eFormat == SLOG_FORMAT_JSON)
+    {
+        if (!nFirst) slog_write_token(pWriter, ",", 1);
+        slog_write_token(pWriter, "\"", 1);
+        slog_write_escaped(pWriter, pKey, strlen(pKey));
+        slog_write_token(pWriter, "\":", 2);
+        return;
+    }
+
+    if (!nFirst) slog_write_token(pWriter, " ", 1);
+
+    /* logfmt keys can not be quoted, the characters which would break the pair become '_' */
+    while (*pKey && !pWriter->nFull)
+    {
+        const char *pRun = pKey;
+        while (*pRun && *pRun != ' ' && *pRun != '=' && !g_slogEscape[(uint8_t)*pRun]) pRun++;
 
-    g_slog.config.pCallbackCtx = NULL;
-    g_slog.config.logCallback = NULL;
+        slog_write_raw(pWriter, pKey, (size_t)(pRun - pKey));
+        if (!*pRun) break;
+
+        slog_write_token(pWriter, "_", 1);
+        pKey = pRun + 1;
+    }
+
+    slog_write_token(pWriter, "=", 1);
+}
 
-    g_slog.logFile.sFilePath[0] = SLOG_NUL;
-    g_slog.logFile.nCurrYear = 0;
-    g_slog.logFile.nCurrMonth = 0;
-    g_slog.logFile.nCurrDay = 0;
-    g_nSlogInit = 0;
+static void slog_write_field(slog_writer_t *pWriter, slog_format_t eFormat, const slog_kv_t *pField, uint8_t nFirst)
+{
+    if (pWriter->nFull || pField->pKey == NULL) return;
+    slog_write_key(pWriter, eFormat, pField->pKey, nFirst);
 
-    slog_sync_unlock(&g_slog);
-    slog_sync_destroy(&g_slog);
+    switch (pField->eType)
+    {
+        case SLOG_KV_STR:
+        {
+            const char *pValue = pField->value.pStr != NULL ? pField->value.pStr : SLOG_EMPTY;
+            slog_write_string(pWriter, eFormat, pValue, strlen(pValue));
+            break;
+        }
+        case SLOG_KV_INT:
+        {
+            int64_t nValue = pField->value.nInt;
+            uint64_t nAbs = nValue < 0 ? 0 - (uint64_t)nValue : (uint64_t)nValue;
+            slog_write_uint(pWriter, nAbs, nValue < 0);
+            break;
+        }
+        case SLOG_KV_UINT:
+            slog_write_uint(pWriter, pField->value.nUint, 0);
+            break;
+        case SLOG_KV_BOOL:
+            if (pField->value.nUint) slog_write_token(pWriter, "true", 4);
+            else slog_write_token(pWriter, "false", 5);
+            break;
+        case SLOG_KV_FLOAT:
+        {
+            double fValue = pField->value.fFloat;
+            char sValue[32];
+
+            /* JSON has no representation for NaN and infinity */
+            if (eFormat == SLOG_FORMAT_JSON && (fValue != fValue || fValue - fValue != 0))
+            {
+                slog_write_token(pWriter, "null", 4);
+                break;
+            }
+
+            int nLength = snprintf(sValue, sizeof(sValue), "%.15g", fValue);
+            if (nLength > 0) slog_write_token(pWriter, sValue, (size_t)nLength);
+            break;
+        }
+        default:
+            slog_write_token(pWriter, "null", 4);
+            break;
+    }
+}
+
+static void slog_write_date(char *pOut, uint32_t nValue, int nDigits)
+{
+    while (nDigits--)
+    {
+        pOut[nDigits] = (char)('0' + nValue % 10);
+        nValue /= 10;
+    }
+}
+
+/* Two digits at a time for the integer conversions of the built-in formatter */
+static const char g_slogDigits[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/* Conversion specification accepted by the built-in formatter */
+typedef struct slog_conv {
+    uint8_t nLeft;
+    uint8_t nZero;
+    char cSign;
+    char cLength;
+    uint8_t nDouble;
+    int nWidth;
+    int nPrec;
+    char cConv;
+} slog_conv_t;
+
+/* Output of the formatter, the length keeps counting past the end like vsnprintf() */
+typedef struct slog_fmt {
+    char *pOut;
+    size_t nSize;
+    size_t nLength;
+} slog_fmt_t;
+
+static void slog_fmt_put(slog_fmt_t *pFmt, const char *pData, size_t nLength)
+{
+    if (pFmt->nLength < pFmt->nSize)
+    {
+        size_t nCopy = pFmt->nSize - pFmt->nLength;
+        memcpy(pFmt->pOut + pFmt->nLength, pData, nCopy < nLength ? nCopy : nLength);
+    }
+
+    pFmt->nLength += nLength;
+}
+
+static void slog_fmt_fill(slog_fmt_t *pFmt, char cFill, size_t nCount)
+{
+    if (pFmt->nLength < pFmt->nSize)
+    {
+        size_t nCopy = pFmt->nSize - pFmt->nLength;
+        memset(pFmt->pOut + pFmt->nLength, cFill, nCopy < nCount ? nCopy : nCount);
+    }
+
+    pFmt->nLength += nCount;
+}
+
+/* Digits are written backwards from pEnd, returns the first one */
+static char* slog_fmt_decimal(char *pEnd, uint64_t nValue)
+{
+    while (nValue >= 100)
+    {
+        size_t nPair = (size_t)(nValue % 100) * 2;
+        nValue /= 100;
+        pEnd -= 2;
+        memcpy(pEnd, &g_slogDigits[nPair], 2);
+    }
+
+    if (nValue >= 10)
+    {
+        pEnd -= 2;
+        memcpy(pEnd, &g_slogDigits[nValue * 2], 2);
+    }
+    else *--pEnd = (char)('0' + nValue);
+
+    return pEnd;
+}
+
+static char* slog_fmt_digits(char *pEnd, uint64_t nValue, char cConv)
+{
+    const char *pHex = cConv == 'X' ? "0123456789ABCDEF" : "0123456789abcdef";
+    if (cConv != 'x' && cConv != 'X' && cConv != 'o') return slog_fmt_decimal(pEnd, nValue);
+
+    uint8_t nShift = cConv == 'o' ? 3 : 4;
+    uint64_t nMask = cConv == 'o' ? 7 : 15;
+
+    do
+    {
+        *--pEnd = pHex[nValue & nMask];
+        nValue >>= nShift;
+    }
+    while (nValue);
+
+    return pEnd;
+}
+
+/* Sign, zero padding up to the precision or width, then the width padding */
+static void slog_fmt_integer(slog_fmt_t *pFmt, const slog_conv_t *pConv, uint64_t nValue, uint8_t nNegative)
+{
+    char sDigits[32];
+    char *pEnd = sDigits + sizeof(sDigits);
+    char *pStart = pEnd;
+
+    /* Zero with zero precision has no digits at all */
+    if (nValue || pConv->nPrec != 0) pStart = slog_fmt_digits(pEnd, nValue, pConv->cConv);
+
+    size_t nDigits = (size_t)(pEnd - pStart);
+    size_t nSign = (nNegative || pConv->cSign) ? 1 : 0;
+    size_t nZeros = pConv->nPrec > 0 && (size_t)pConv->nPrec > nDigits ? (size_t)pConv->nPrec - nDigits : 0;
+    size_t nTotal = nSign + nZeros + nDigits;
+    size_t nPad = pConv->nWidth > 0 && (size_t)pConv->nWidth > nTotal ? (size_t)pConv->nWidth - nTotal : 0;
+
+    if (pConv->nZero && !pConv->nLeft && pConv->nPrec < 0)
+    {
+        nZeros += nPad;
+        nPad = 0;
+    }
+
+    if (!pConv->nLeft) slog_fmt_fill(pFmt, ' ', nPad);
+    if (nSign) slog_fmt_fill(pFmt, nNegative ? '-' : pConv->cSign, 1);
+
+    slog_fmt_fill(pFmt, '0', nZeros);
+    slog_fmt_put(pFmt, pStart, nDigits);
+    if (pConv->nLeft) slog_fmt_fill(pFmt, ' ', nPad);
+}
+
+static void slog_fmt_text(slog_fmt_t *pFmt, const slog_conv_t *pConv, const char *pText, size_t nLength)
+{
+    size_t nPad = pConv->nWidth > 0 && (size_t)pConv->nWidth > nLength ? (size_t)pConv->nWidth - nLength : 0;
+    if (!pConv->nLeft) slog_fmt_fill(pFmt, ' ', nPad);
+    slog_fmt_put(pFmt, pText, nLength);
+    if (pConv->nLeft) slog_fmt_fill(pFmt, ' ', nPad);
+}
+
+/* Returns the end of the specification or NULL if it is left to the libc */
+static const char* slog_fmt_parse(const char *pPos, slog_conv_t *pConv, va_list *pArgs)
+{
+    memset(pConv, 0, sizeof(slog_conv_t));
+    pConv->nPrec = -1;
+
+    for (;; pPos++)
+    {
+        if (*pPos == '-') pConv->nLeft = 1;
+        else if (*pPos == '0') pConv->nZero = 1;
+        else if (*pPos == '+') pConv->cSign = '+';
+        else if (*pPos == ' ') { if (pConv->cSign != '+') pConv->cSign = ' '; }
+        else break;
+    }
+
+    if (*pPos == '*')
+    {
+        pConv->nWidth = va_arg(*pArgs, int);
+        if (pConv->nWidth < 0)
+        {
+            /* Negative width is taken as the '-' flag */
+            if (pConv->nWidth == INT_MIN) return NULL;
+            pConv->nWidth = -pConv->nWidth;
+            pConv->nLeft = 1;
+        }
+
+        pPos++;
+    }
+    else
+    {
+        while (*pPos >= '0' && *pPos <= '9')
+        {
+            if (pConv->nWidth > SLOG_MESSAGE_MAX) return NULL;
+            pConv->nWidth = pConv->nWidth * 10 + (*pPos++ - '0');
+        }
+    }
+
+    if (*pPos == '.')
+    {
+        pPos++;
+        pConv->nPrec = 0;
+
+        if (*pPos == '*')
+        {
+            pConv->nPrec = va_arg(*pArgs, int);
+            if (pConv->nPrec < 0) pConv->nPrec = -1;
+            pPos++;
+        }
+        else
+        {
+            while (*pPos >= '0' && *pPos <= '9')
+            {
+                if (pConv->nPrec > SLOG_MESSAGE_MAX) return NULL;
+                pConv->nPrec = pConv->nPrec * 10 + (*pPos++ - '0');
+            }
+        }
+    }
+
+    if (*pPos == 'h' || *pPos == 'l' || *pPos == 'z' || *pPos == 'j' || *pPos == 't')
+    {
+        pConv->cLength = *pPos++;
+        if ((pConv->cLength == 'h' || pConv->cLength == 'l') && *pPos == pConv->cLength)
+        {
+            pConv->nDouble = 1;
+            pPos++;
+        }
+    }
+
+    pConv->cConv = *pPos;
+    if (pConv->cConv == SLOG_NUL || strchr("diuxXocsp", pConv->cConv) == NULL) return NULL;
+
+    return pPos + 1;
+}
+
+static uint64_t slog_fmt_unsigned(const slog_conv_t *pConv, va_list *pArgs)
+{
+    switch (pConv->cLength)
+    {
+        case 'h': return pConv->nDouble ? (unsigned char)va_arg(*pArgs, unsigned int) : (unsigned short)va_arg(*pArgs, unsigned int);
+        case 'l': return pConv->nDouble ? (uint64_t)va_arg(*pArgs, unsigned long long) : (uint64_t)va_arg(*pArgs, unsigned long);
+        case 'z': return (uint64_t)va_arg(*pArgs, size_t);
+        case 'j': return (uint64_t)va_arg(*pArgs, uintmax_t);
+        case 't': return (uint64_t)(size_t)va_arg(*pArgs, ptrdiff_t);
+        default: break;
+    }
+
+    return (uint64_t)va_arg(*pArgs, unsigned int);
+}
+
+static int64_t slog_fmt_signed(const slog_conv_t *pConv, va_list *pArgs)
+{
+    switch (pConv->cLength)
+    {
+        case 'h': return pConv->nDouble ? (signed char)va_arg(*pArgs, int) : (short)va_arg(*pArgs, int);
+        case 'l': return pConv->nDouble ? (int64_t)va_arg(*pArgs, long long) : (int64_t)va_arg(*pArgs, long);
+        case 'z': return (int64_t)(ptrdiff_t)va_arg(*pArgs, size_t);
+        case 'j': return (int64_t)va_arg(*pArgs, intmax_t);
+        case 't': return (int64_t)va_arg(*pArgs, ptrdiff_t);
+        default: break;
+    }
+
+    return (int64_t)va_arg(*pArgs, int);
+}
+
+/* Returns 0 if the conversion must be done by the libc */
+static uint8_t slog_fmt_convert(slog_fmt_t *pFmt, const slog_conv_t *pConv, va_list *pArgs)
+{
+    char cConv = pConv->cConv;
+
+    if (cConv == 'd' || cConv == 'i')
+    {
+        int64_t nValue = slog_fmt_signed(pConv, pArgs);
+        uint64_t nAbs = nValue < 0 ? (uint64_t)0 - (uint64_t)nValue : (uint64_t)nValue;
+        slog_fmt_integer(pFmt, pConv, nAbs, nValue < 0 ? 1 : 0);
+        return 1;
+    }
+
+    if (cConv == 'u' || cConv == 'x' || cConv == 'X' || cConv == 'o')
+    {
+        /* Sign flags apply to signed conversions only */
+        slog_conv_t conv = *pConv;
+        conv.cSign = SLOG_NUL;
+        slog_fmt_integer(pFmt, &conv, slog_fmt_unsigned(pConv, pArgs), 0);
+        return 1;
+    }
+
+    if (pConv->cLength) return 0;
+
+    if (cConv == 'c')
+    {
+        char cValue = (char)va_arg(*pArgs, int);
+        slog_fmt_text(pFmt, pConv, &cValue, 1);
+        return 1;
+    }
+
+    if (cConv == 's')
+    {
+        /* The text printed for NULL differs between the libc implementations */
+        const char *pValue = va_arg(*pArgs, const char*);
+        if (pValue == NULL) return 0;
+
+        size_t nLength = 0;
+        if (pConv->nPrec < 0) nLength = strlen(pValue);
+        else while (nLength < (size_t)pConv->nPrec && pValue[nLength]) nLength++;
+
+        slog_fmt_text(pFmt, pConv, pValue, nLength);
+        return 1;
+    }
+
+#ifdef __GLIBC__
+    /* Format of pointers is implementation defined, only glibc is replicated */
+    if (cConv == 'p' && !pConv->nZero && !pConv->cSign && pConv->nPrec < 0)
+    {
+        uintptr_t nValue = (uintptr_t)va_arg(*pArgs, void*);
+        if (!nValue)
+        {
+            slog_fmt_text(pFmt, pConv, "(nil)", 5);
+            return 1;
+        }
+
+        char sDigits[2 + sizeof(uintptr_t) * 2];
+        char *pEnd = sDigits + sizeof(sDigits);
+        char *pStart = slog_fmt_digits(pEnd, (uint64_t)nValue, 'x');
+
+        *--pStart = 'x';
+        *--pStart = '0';
+
+        slog_fmt_text(pFmt, pConv, pStart, (size_t)(pEnd - pStart));
+        return 1;
+    }
+#endif
+
+    return 0;
+}
+
+/* Same contract as vsnprintf(), integers and strings are formatted without the libc,
+ * anything else (floats, locale flags, wide characters) falls back to vsnprintf() */
+static int slog_vsnprintf(char *pOut, size_t nSize, const char *pFormat, va_list args)
+{
+    const char *pPos = pFormat;
+    va_list locArgs;
+    slog_fmt_t fmt;
+
+    fmt.pOut = pOut;
+    fmt.nSize = nSize ? nSize - 1 : 0;
+    fmt.nLength = 0;
+
+#ifdef va_copy
+    va_copy(locArgs, args);
+#else
+    memcpy(&locArgs, &args, sizeof(va_list));
+#endif
+
+    while (*pPos)
+    {
+        const char *pSpec = strchr(pPos, '%');
+        if (pSpec == NULL)
+        {
+            slog_fmt_put(&fmt, pPos, strlen(pPos));
+            break;
+        }
+
+        slog_fmt_put(&fmt, pPos, (size_t)(pSpec - pPos));
+
+        if (pSpec[1] == '%')
+        {
+            slog_fmt_fill(&fmt, '%', 1);
+            pPos = pSpec + 2;
+            continue;
+        }
+
+        slog_conv_t conv;
+        pPos = slog_fmt_parse(pSpec + 1, &conv, &locArgs);
+
+        if (pPos == NULL || !slog_fmt_convert(&fmt, &conv, &locArgs) || fmt.nLength > INT_MAX)
+        {
+            va_end(locArgs);
+            return vsnprintf(pOut, nSize, pFormat, args);
+        }
+    }
+
+    va_end(locArgs);
+    if (nSize) pOut[fmt.nLength < fmt.nSize ? fmt.nLength : fmt.nSize] = SLOG_NUL;
+    return (int)fmt.nLength;
+}
+
+/* One JSON object or logfmt line per message, the message is formatted by slog_vsnprintf() */
+static size_t slog_create_struct_line(const slog_context_t *pCtx, const slog_config_t *pCfg, char *pOut, size_t nSize, va_list args)
+{
+    slog_format_t eFormat = pCfg->eFormat;
+    char sMessage[SLOG_MESSAGE_MAX];
+
+    int nBytes = slog_vsnprintf(sMessage, sizeof(sMessage), pCtx->pFormat, args);
+    size_t nMsgLen = nBytes > 0 ? ((size_t)nBytes < sizeof(sMessage) ? (size_t)nBytes : sizeof(sMessage) - 1) : 0;
+
+    slog_writer_t writer;
+    writer.pOut = pOut;
+    writer.nSize = nSize - SLOG_STRUCT_RESERVE;
+    writer.nLimit = nSize - 1;
+    writer.nLength = 0;
+    writer.nFull = 0;
+
+    uint8_t nFirst = 1;
+    if (eFormat == SLOG_FORMAT_JSON) slog_write_token(&writer, "{", 1);
+
+    if (pCfg->eDateControl != SLOG_TIME_DISABLE)
+    {
+        /* RFC 3339 local time with its UTC offset, "Z" if the zone is UTC */
+        const slog_date_t *pDate = &pCtx->date;
+        char sTime[] = "0000-00-00T00:00:00.000+00:00";
+        size_t nTimeLen = sizeof(sTime) - 1;
+        int nOffset = pDate->nOffset;
+
+        slog_write_date(sTime, pDate->nYear, 4);
+        slog_write_date(sTime + 5, pDate->nMonth, 2);
+        slog_write_date(sTime + 8, pDate->nDay, 2);
+        slog_write_date(sTime + 11, pDate->nHour, 2);
+        slog_write_date(sTime + 14, pDate->nMin, 2);
+        slog_write_date(sTime + 17, pDate->nSec, 2);
+        slog_write_date(sTime + 20, pDate->nUsec, 3);
+
+        if (!nOffset)
+        {
+            sTime[23] = 'Z';
+            nTimeLen = 24;
+        }
+        else
+        {
+            if (nOffset < 0) sTime[23] = '-';
+            if (nOffset < 0) nOffset = -nOffset;
+            slog_write_date(sTime + 24, (uint32_t)(nOffset / 60), 2);
+            slog_write_date(sTime + 27, (uint32_t)(nOffset % 60), 2);
+        }
+
+        slog_write_key(&writer, eFormat, "time", nFirst);
+        slog_write_string(&writer, eFormat, sTime, nTimeLen);
+        nFirst = 0;
+    }
+
+    g_nSlogBodyOff = writer.nLength;
+
+    const char *pLevel = pCtx->pPrefixes->levels[slog_level_index(pCtx->eFlag)].pLevel;
+
+    slog_write_key(&writer, eFormat, "level", nFirst);
+    slog_write_string(&writer, eFormat, pLevel, strlen(pLevel));
+
+    if (pCfg->nTraceTid)
+    {
+        const slog_thread_info_t *pThread = pCtx->nTid ? NULL : slog_thread_get();
+        slog_write_key(&writer, eFormat, "tid", 0);
+        slog_write_uint(&writer, pThread != NULL ? pThread->nTid : pCtx->nTid, 0);
+
+        if (pThread != NULL && pThread->sName[0] != SLOG_NUL)
+        {
+            slog_write_key(&writer, eFormat, "thread", 0);
+            slog_write_string(&writer, eFormat, pThread->sName, strlen(pThread->sName));
+        }
+    }
+
+    const slog_fields_t *pFields = pCtx->pFields;
+    if (pFields != NULL && pFields->pFile != NULL)
+    {
+        slog_write_key(&writer, eFormat, "file", 0);
+        slog_write_string(&writer, eFormat, pFields->pFile, strlen(pFields->pFile));
+        slog_write_key(&writer, eFormat, "line", 0);
+        slog_write_uint(&writer, (uint64_t)pFields->nLine, 0);
+    }
+
+    slog_write_key(&writer, eFormat, "msg", 0);
+    slog_write_string(&writer, eFormat, sMessage, nMsgLen);
+
+    size_t i;
+    for (i = 0; pFields != NULL && i < pFields->nCount; i++)
+        slog_write_field(&writer, eFormat, &pFields->pList[i], 0);
+
+    if (eFormat == SLOG_FORMAT_JSON) slog_write_close(&writer, "}", 1);
+    slog_write_close(&writer, SLOG_NEWLINE, 1);
+
+    pOut[writer.nLength] = SLOG_NUL;
+    return writer.nLength;
+}
+
+/* Fields of the key-value calls are appended to the text line in logfmt style */
+static size_t slog_append_fields(const slog_fields_t *pFields, char *pOut, size_t nLength, size_t nSize)
+{
+    slog_writer_t writer;
+    writer.pOut = pOut;
+    writer.nSize = nSize;
+    writer.nLimit = nSize;
+    writer.nLength = nLength;
+    writer.nFull = nLength >= nSize;
+
+    size_t i;
+    for (i = 0; i < pFields->nCount; i++)
+    {
+        slog_write_token(&writer, " ", 1);
+        slog_write_field(&writer, SLOG_FORMAT_LOGFMT, &pFields->pList[i], 1);
+    }
+
+    return writer.nLength;
+}
+
+/* Format the whole output line, the buffer must be at least SLOG_LINE_MAX bytes */
+static size_t slog_create_line(const slog_context_t *pCtx, const slog_config_t *pCfg, char *pOut, size_t nSize, va_list args)
+{
+    if (pCfg->eFormat != SLOG_FORMAT_TEXT)
+        return slog_create_struct_line(pCtx, pCfg, pOut, nSize, args);
+
+    size_t nLength = slog_create_head(pCtx, pCfg, pOut);
+    int nBytes = slog_vsnprintf(pOut + nLength, SLOG_MESSAGE_MAX, pCtx->pFormat, args);
+    if (nBytes >= SLOG_MESSAGE_MAX) g_nSlogTruncated = 1;
+
+    if (nBytes > 0) nLength += (size_t)nBytes < SLOG_MESSAGE_MAX ? (size_t)nBytes : SLOG_MESSAGE_MAX - 1;
+    else pOut[nLength] = SLOG_NUL;
+
+    if (pCtx->pFields != NULL)
+        nLength = slog_append_fields(pCtx->pFields, pOut, nLength, nSize - SLOG_COLOR_MAX);
+
+    nLength += slog_create_tail(pCtx, pOut + nLength);
+    return nLength;
+}
+
+/* Join the line around an already formatted message, allocate if it does not fit in the buffer */
+static char* slog_create_heap_line(const slog_context_t *pCtx, const slog_config_t *pCfg,
+    const char *pMessage, char *pOut, size_t nSize, size_t *pLength)
+{
+    char sHead[SLOG_INFO_MAX + SLOG_NAME_MAX];
+    char sTail[SLOG_COLOR_MAX];
+
+    size_t nHeadLen = slog_create_head(pCtx, pCfg, sHead);
+    size_t nTailLen = slog_create_tail(pCtx, sTail);
+    size_t nMsgLen = strlen(pMessage);
+    size_t nLength = nHeadLen + nMsgLen + nTailLen;
+
+    if (nLength >= nSize)
+    {
+        pOut = (char*)malloc(nLength + 1);
+        if (pOut == NULL) return NULL;
+    }
+
+    memcpy(pOut, sHead, nHeadLen);
+    memcpy(pOut + nHeadLen, pMessage, nMsgLen);
+    memcpy(pOut + nHeadLen + nMsgLen, sTail, nTailLen);
+    pOut[nLength] = SLOG_NUL;
+
+    *pLength = nLength;
+    return pOut;
+}
+
+/* Format into the buffer if the message fits, otherwise allocate the whole line */
+static char* slog_format_line(const slog_context_t *pCtx, const slog_config_t *pCfg, char *pOut, size_t *pLength, va_list args)
+{
+    /* Structured lines and lines with fields are limited to the line buffer */
+    if (pCfg->eFormat != SLOG_FORMAT_TEXT || pCtx->pFields != NULL)
+    {
+        if (pOut == NULL) pOut = (char*)malloc(SLOG_LINE_MAX);
+        if (pOut == NULL) return NULL;
+
+        *pLength = slog_create_line(pCtx, pCfg, pOut, SLOG_LINE_MAX, args);
+        return pOut;
+    }
+
+    if (pOut != NULL)
+    {
+        va_list locArgs;
+#ifdef va_copy
+        va_copy(locArgs, args);
+#else
+        memcpy(&locArgs, &args, sizeof(va_list));
+#endif
+
+        size_t nHeadLen = slog_create_head(pCtx, pCfg, pOut);
+        size_t nAvail = SLOG_LINE_MAX - nHeadLen - SLOG_COLOR_MAX;
+        int nBytes = slog_vsnprintf(pOut + nHeadLen, nAvail, pCtx->pFormat, locArgs);
+        va_end(locArgs);
+
+        if (nBytes >= 0 && (size_t)nBytes < nAvail)
+        {
+            size_t nLength = nHeadLen + (size_t)nBytes;
+            *pLength = nLength + slog_create_tail(pCtx, pOut + nLength);
+            return pOut;
+        }
+
+        /* The first pass gave the exact size, format once more into the allocated line */
+        if (nBytes >= 0)
+        {
+            char *pLine = (char*)malloc(nHeadLen + (size_t)nBytes + SLOG_COLOR_MAX);
+            if (pLine == NULL) return NULL;
+
+            memcpy(pLine, pOut, nHeadLen);
+            slog_vsnprintf(pLine + nHeadLen, (size_t)nBytes + 1, pCtx->pFormat, args);
+
+            size_t nLength = nHeadLen + (size_t)nBytes;
+            *pLength = nLength + slog_create_tail(pCtx, pLine + nLength);
+            return pLine;
+        }
+    }
+
+    char *pMessage = NULL;
+#ifdef _WIN32
+    slog_vasprintf(&pMessage, pCtx->pFormat, args);
+#else
+    if (vasprintf(&pMessage, pCtx->pFormat, args) < 0) pMessage = NULL;
+#endif
+
+    if (pMessage == NULL) return NULL;
+    char *pLine = slog_create_heap_line(pCtx, pCfg, pMessage, NULL, 0, pLength);
+
+    free(pMessage);
+    return pLine;
+}
+
+static void slog_repeat_flush(slog_t *pSlog);
+
+static slog_thread_ret_t SLOG_THREAD_API slog_flusher_worker(void *pArg)
+{
+    slog_t *pSlog = (slog_t*)pArg;
+    slog_flusher_t *pFlusher = pSlog->pFlusher;
+    slog_repeat_t *pRepeat = &pSlog->repeat;
+    slog_file_t *pFile = &pSlog->logFile;
+    uint32_t nWaitMs = SLOG_FLUSH_DELAY;
+
+    for (;;)
+    {
+        slog_mutex_lock(&pFlusher->mutex);
+        if (!slog_atomic_get(&pFlusher->nStop))
+            slog_cond_wait(&pFlusher->cond, &pFlusher->mutex, nWaitMs);
+        slog_mutex_unlock(&pFlusher->mutex);
+
+        if (slog_atomic_get(&pFlusher->nStop)) break;
+        slog_sync_lock(pSlog);
+
+        uint64_t nNow = slog_time_ms();
+        nWaitMs = pSlog->config.nFlushDelay ? pSlog->config.nFlushDelay : SLOG_FLUSH_DELAY;
+
+        if (pRepeat->nCount)
+        {
+            if (nNow >= pRepeat->nDeadline) slog_repeat_flush(pSlog);
+            else if (pRepeat->nDeadline - nNow < nWaitMs) nWaitMs = (uint32_t)(pRepeat->nDeadline - nNow);
+        }
+
+        if (pFile->nBufferUsed)
+        {
+            if (nNow >= pFile->nDeadline)
+            {
+                slog_flush_buffer(pFile);
+#ifdef _WIN32
+                if (!pSlog->config.nKeepOpen) slog_close_file(pFile);
+#endif
+            }
+            else if (pFile->nDeadline - nNow < nWaitMs)
+            {
+                nWaitMs = (uint32_t)(pFile->nDeadline - nNow);
+            }
+        }
+
+        slog_sync_unlock(pSlog);
+    }
+
+    return (slog_thread_ret_t)0;
+}
+
+static void slog_flusher_start(slog_t *pSlog)
+{
+    slog_flusher_t *pFlusher = (slog_flusher_t*)calloc(1, sizeof(slog_flusher_t));
+    if (pFlusher == NULL) return;
+
+    slog_mutex_init(&pFlusher->mutex);
+    slog_cond_init(&pFlusher->cond);
+    pSlog->pFlusher = pFlusher;
+
+    if (!slog_thread_create(&pFlusher->thread, slog_flusher_worker, pSlog))
+    {
+        printf("<%s:%d> %s: [ERROR] Can not start flusher thread: %d\n",
+            __FILE__, __LINE__, __func__, errno);
+
+        slog_cond_destroy(&pFlusher->cond);
+        slog_mutex_destroy(&pFlusher->mutex);
+        pSlog->pFlusher = NULL;
+        free(pFlusher);
+    }
+}
+
+/* Must be called without holding the lock, the flusher thread takes it */
+static void slog_flusher_stop(slog_t *pSlog)
+{
+    slog_flusher_t *pFlusher = pSlog->pFlusher;
+    if (pFlusher == NULL) return;
+
+    slog_mutex_lock(&pFlusher->mutex);
+    slog_atomic_set(&pFlusher->nStop, 1);
+    slog_cond_signal(&pFlusher->cond, 0);
+    slog_mutex_unlock(&pFlusher->mutex);
+
+    slog_thread_join(&pFlusher->thread);
+    slog_cond_destroy(&pFlusher->cond);
+    slog_mutex_destroy(&pFlusher->mutex);
+    pSlog->pFlusher = NULL;
+    free(pFlusher);
+}
+
+/* Append the line to the file buffer, returns 0 if the line must be written directly */
+static uint8_t slog_buffer_line(slog_t *pSlog, slog_flag_t eFlag, const char *pLine, size_t nLength)
+{
+    slog_config_t *pCfg = &pSlog->config;
+    slog_file_t *pFile = &pSlog->logFile;
+    uint64_t nNow = slog_time_ms();
+
+    if (pFile->nBufferSize != pCfg->nFileBuffer)
+    {
+        slog_flush_buffer(pFile);
+        slog_free_buffer(pFile);
+
+        pFile->pBuffer = (char*)malloc(pCfg->nFileBuffer);
+        if (pFile->pBuffer == NULL) return 0;
+        pFile->nBufferSize = pCfg->nFileBuffer;
+    }
+
+    /* Deadline can only be guaranteed with the lock, the thread can not flush without it */
+    if (pSlog->pFlusher == NULL && pSlog->nTdSafe) slog_flusher_start(pSlog);
+    if (pFile->nBufferUsed + nLength > pFile->nBufferSize) slog_flush_buffer(pFile);
+    if (nLength >= pFile->nBufferSize) return 0;
+
+    if (!pFile->nBufferUsed) pFile->nDeadline = nNow + pCfg->nFlushDelay;
+    memcpy(pFile->pBuffer + pFile->nBufferUsed, pLine, nLength);
+    pFile->nBufferUsed += nLength;
+
+    /* Fatal lines must reach the file before the application goes down */
+    if (eFlag == SLOG_FATAL || nNow >= pFile->nDeadline) slog_flush_buffer(pFile);
+    return 1;
+}
+
+/* Remove the ANSI color sequences for the outputs that do not support them */
+static size_t slog_strip_colors(const char *pLine, size_t nLength, char *pOut)
+{
+    const char *pEnd = pLine + nLength;
+    char *pDst = pOut;
+
+    while (pLine < pEnd)
+    {
+        const char *pEsc = (const char*)memchr(pLine, '\x1B', pEnd - pLine);
+        size_t nChunk = (size_t)((pEsc != NULL ? pEsc : pEnd) - pLine);
+
+        memcpy(pDst, pLine, nChunk);
+        pDst += nChunk;
+        pLine += nChunk;
+        if (pEsc == NULL) break;
+
+        const char *pSeq = pEsc + 1;
+        if (pSeq < pEnd && *pSeq == '[')
+        {
+            pSeq++;
+            while (pSeq < pEnd && ((*pSeq >= '0' && *pSeq <= '9') || *pSeq == ';')) pSeq++;
+
+            if (pSeq < pEnd && *pSeq == 'm')
+            {
+                pLine = pSeq + 1;
+                continue;
+            }
+        }
+
+        *pDst++ = *pLine++;
+    }
+
+    *pDst = SLOG_NUL;
+    return (size_t)(pDst - pOut);
+}
+
+/* Returns 0 if the line was not written completely */
+static uint8_t slog_write_fd(int nFd, const char *pLine, size_t nLength)
+{
+    while (nLength > 0)
+    {
+#ifdef _WIN32
+        int nWritten = _write(nFd, pLine, (unsigned int)nLength);
+#else
+        ssize_t nWritten = write(nFd, pLine, nLength);
+#endif
+        if (nWritten < 0 && errno == EINTR) continue;
+        if (nWritten <= 0) return 0;
+
+        pLine += nWritten;
+        nLength -= (size_t)nWritten;
+    }
+
+    return 1;
+}
+
+static void slog_ring_put(char *pRing, size_t nSize, size_t *pPos, const char *pLine, size_t nLength)
+{
+    /* Only the end of a line longer than the ring can be kept */
+    if (nLength > nSize)
+    {
+        pLine += nLength - nSize;
+        nLength = nSize;
+    }
+
+    size_t nFirst = nSize - *pPos;
+    if (nFirst > nLength) nFirst = nLength;
+
+    memcpy(pRing + *pPos, pLine, nFirst);
+    memcpy(pRing, pLine + nFirst, nLength - nFirst);
+    *pPos = (*pPos + nLength) % nSize;
+}
+
+static void slog_write_ring(slog_sink_slot_t *pSlot, const char *pLine, size_t nLength)
+{
+    pSlot->nRingTotal += nLength;
+    slog_ring_put(pSlot->pRing, pSlot->sink.nRingSize, &pSlot->nRingPos, pLine, nLength);
+}
+
+static void slog_write_sink(slog_sink_slot_t *pSlot, slog_flag_t eFlag, const char *pLine, size_t nLength)
+{
+    const slog_sink_t *pSink = &pSlot->sink;
+    pSlot->nBytes += nLength;
+
+    switch (pSink->eType)
+    {
+        case SLOG_SINK_STREAM:
+            if (fwrite(pLine, 1, nLength, pSink->pStream) != nLength) pSlot->nErrors++;
+            if (pSink->nFlush) fflush(pSink->pStream);
+            break;
+        case SLOG_SINK_FD:
+            if (!slog_write_fd(pSink->nFd, pLine, nLength)) pSlot->nErrors++;
+            break;
+        case SLOG_SINK_CALLBACK:
+            pSink->callback(pLine, nLength, eFlag, pSink->pContext);
+            break;
+        case SLOG_SINK_RING:
+            slog_write_ring(pSlot, pLine, nLength);
+            break;
+        default:
+            break;
+    }
+}
+
+/* Every sink gets the same line, color sequences are stripped once for all plain sinks */
+static void slog_display_sinks(slog_t *pSlog, slog_flag_t eFlag, const char *pLine, size_t nLength)
+{
+    uint8_t nColored = pSlog->config.eColorFormat != SLOG_COLORING_DISABLE ? 1 : 0;
+    const char *pPlain = NULL;
+    char *pAlloc = NULL;
+    size_t nPlainLen = 0;
+    char sPlain[SLOG_LINE_MAX];
+    int i;
+
+    for (i = 0; i < SLOG_SINKS_MAX; i++)
+    {
+        slog_sink_slot_t *pSlot = &pSlog->sinks[i];
+        if (!pSlot->nUsed || !SLOG_FLAGS_CHECK(pSlot->sink.nFlags, eFlag)) continue;
+
+        if (pSlot->sink.nColors || !nColored)
+        {
+            slog_write_sink(pSlot, eFlag, pLine, nLength);
+            continue;
+        }
+
+        if (pPlain == NULL)
+        {
+            char *pBuffer = sPlain;
+            if (nLength >= sizeof(sPlain))
+            {
+                pAlloc = (char*)malloc(nLength + 1);
+                if (pAlloc == NULL) break;
+                pBuffer = pAlloc;
+            }
+
+            nPlainLen = slog_strip_colors(pLine, nLength, pBuffer);
+            pPlain = pBuffer;
+        }
+
+        slog_write_sink(pSlot, eFlag, pPlain, nPlainLen);
+    }
+
+    free(pAlloc);
+}
+
+static void slog_free_sinks(slog_t *pSlog)
+{
+    int i;
+
+    for (i = 0; i < SLOG_SINKS_MAX; i++)
+    {
+        slog_sink_slot_t *pSlot = &pSlog->sinks[i];
+        if (pSlot->pRing != NULL) free(pSlot->pRing);
+        memset(pSlot, 0, sizeof(slog_sink_slot_t));
+    }
+
+    pSlog->nSinkCount = 0;
+}
+
+/* Deliver a fully formatted line to the outputs, must be called with the lock held */
+static void slog_write_line(slog_t *pSlog, slog_flag_t eFlag, const slog_date_t *pDate, const char *pLine, size_t nLength)
+{
+    slog_config_t *pCfg = &pSlog->config;
+    slog_file_t *pFile = &pSlog->logFile;
+    uint8_t nIndex = slog_level_index(eFlag);
+    int nCbVal = 1;
+
+    if (nIndex < SLOG_LEVEL_COUNT) pSlog->counters.nLines[nIndex]++;
+
+    if (pSlog->nSinkCount && nLength > 0)
+        slog_display_sinks(pSlog, eFlag, pLine, nLength);
+
+    if (pCfg->logCallback != NULL && nLength > 0)
+    {
+        SLOG_PROFILE_START(nProfile);
+        nCbVal = pCfg->logCallback(pLine, nLength, eFlag, pCfg->pCallbackCtx);
+        if (nCbVal < 0) pSlog->counters.nRejected++;
+
+#ifdef SLOG_PROFILE
+        pSlog->nProfileCallback = SLOG_PROFILE_END(pSlog, SLOG_PHASE_CALLBACK, nProfile);
+#endif
+    }
+
+    if (pCfg->nToScreen && nCbVal > 0)
+    {
+        pSlog->counters.nScreenBytes += fwrite(pLine, 1, nLength, stdout);
+        if (pCfg->nFlush) fflush(stdout);
+    }
+
+    if (!pCfg->nToFile || nCbVal < 0) return;
+    if (!slog_check_file(pFile, pCfg, pDate)) return;
+
+#ifndef _WIN32
+    /* Mapped file stays open regardless of nKeepOpen, remapping per line would be much slower */
+    if (pFile->pMap != NULL && slog_map_line(pFile, pLine, nLength))
+    {
+        pFile->nWritten += nLength;
+        return;
+    }
+#endif
+
+    if (pCfg->nFileBuffer && !pCfg->nFlush &&
+        slog_buffer_line(pSlog, eFlag, pLine, nLength))
+    {
+        pFile->nFileSize += nLength;
+        pFile->nWritten += nLength;
+
+#ifdef _WIN32
+        /* Without keep open the file stays open only while the buffer has data */
+        if (!pCfg->nKeepOpen && !pFile->nBufferUsed) slog_close_file(pFile);
+#endif
+        return;
+    }
+
+    slog_flush_buffer(pFile);
+    size_t nWritten = fwrite(pLine, 1, nLength, pFile->pHandle);
+    if (nWritten != nLength) pFile->nErrors++;
+
+    pFile->nFileSize += nLength;
+    pFile->nWritten += nWritten;
+
+    if (pCfg->nFlush) fflush(pFile->pHandle);
+#ifdef _WIN32
+    /* Windows can not move a file we hold open, POSIX caches the handle instead */
+    if (!pCfg->nKeepOpen) slog_close_file(pFile);
+#endif
+}
+
+static size_t slog_create_notice(const slog_context_t *pCtx, const slog_config_t *pCfg, char *pOut, size_t nSize, ...)
+{
+    va_list args;
+    va_start(args, nSize);
+    size_t nLength = slog_create_line(pCtx, pCfg, pOut, nSize, args);
+    va_end(args);
+    return nLength;
+}
+
+/* Display the number of collapsed repeats, called with the lock held.
+ * The notice carries the time and thread of the last repeat, not of the flushing thread */
+static void slog_repeat_flush(slog_t *pSlog)
+{
+    slog_repeat_t *pRepeat = &pSlog->repeat;
+    if (!pRepeat->nCount) return;
+
+    slog_clock_t clock;
+    clock.date = pRepeat->date;
+    slog_clock_render(&clock);
+
+    slog_context_t ctx;
+    ctx.pPrefixes = &pSlog->prefixes;
+    ctx.pFields = NULL;
+    ctx.pClock = &clock;
+    ctx.pFormat = "Last message repeated %zu times";
+    ctx.eFlag = pRepeat->eFlag;
+    ctx.date = pRepeat->date;
+    ctx.nNewLine = 1;
+    ctx.nTid = pRepeat->nTid;
+
+    char sLine[SLOG_LINE_MAX];
+    size_t nLength = slog_create_notice(&ctx, &pSlog->config, sLine, sizeof(sLine), pRepeat->nCount);
+
+    pRepeat->nCount = 0;
+    slog_write_line(pSlog, ctx.eFlag, &ctx.date, sLine, nLength);
+}
+
+/* Same level and text as the previous line, the timestamp does not matter */
+static uint8_t slog_repeat_check(slog_t *pSlog, slog_flag_t eFlag, const slog_date_t *pDate, size_t nTid, const char *pBody, size_t nLength)
+{
+    slog_repeat_t *pRepeat = &pSlog->repeat;
+
+    if (pRepeat->pBody != NULL &&
+        pRepeat->eFlag == eFlag &&
+        pRepeat->nLength == nLength &&
+        !memcmp(pRepeat->pBody, pBody, nLength))
+    {
+        /* Without the lock nobody could display the count on time */
+        if (!pRepeat->nCount)
+        {
+            pRepeat->nDeadline = slog_time_ms() + SLOG_REPEAT_DELAY;
+            if (pSlog->pFlusher == NULL && pSlog->nTdSafe) slog_flusher_start(pSlog);
+        }
+
+        /* Lines of the calling thread have no thread id, it is resolved only when traced */
+        if (!nTid && pSlog->config.nTraceTid) nTid = slog_thread_get()->nTid;
+
+        pSlog->counters.nCollapsed++;
+        pRepeat->date = *pDate;
+        pRepeat->nTid = nTid;
+        pRepeat->nCount++;
+        return 1;
+    }
+
+    slog_repeat_flush(pSlog);
+
+    if (nLength > pRepeat->nSize)
+    {
+        size_t nSize = pRepeat->nSize ? pRepeat->nSize * 2 : SLOG_INFO_MAX;
+        while (nSize < nLength) nSize *= 2;
+
+        char *pBuffer = (char*)realloc(pRepeat->pBody, nSize);
+        if (pBuffer == NULL)
+        {
+            free(pRepeat->pBody);
+            pRepeat->pBody = NULL;
+            pRepeat->nSize = 0;
+            return 0;
+        }
+
+        pRepeat->pBody = pBuffer;
+        pRepeat->nSize = nSize;
+    }
+
+    memcpy(pRepeat->pBody, pBody, nLength);
+    pRepeat->nLength = nLength;
+    pRepeat->eFlag = eFlag;
+    return 0;
+}
+
+static void slog_repeat_free(slog_t *pSlog)
+{
+    slog_repeat_t *pRepeat = &pSlog->repeat;
+    free(pRepeat->pBody);
+    pRepeat->pBody = NULL;
+    pRepeat->nLength = 0;
+    pRepeat->nCount = 0;
+    pRepeat->nSize = 0;
+}
+
+/* Everything before nBodyOff (colors, thread id, timestamp) is ignored by the collapsing */
+static void slog_display_line(slog_t *pSlog, slog_flag_t eFlag, const slog_date_t *pDate, size_t nTid, const char *pLine, size_t nLength, size_t nBodyOff)
+{
+    if (pSlog->config.nCollapse && nLength > nBodyOff &&
+        slog_repeat_check(pSlog, eFlag, pDate, nTid, pLine + nBodyOff, nLength - nBodyOff)) return;
+
+#ifdef SLOG_PROFILE
+    /* Output time without the callback, it has its own histogram */
+    uint64_t nStart = slog_time_ns();
+    pSlog->nProfileCallback = 0;
+    slog_write_line(pSlog, eFlag, pDate, pLine, nLength);
+    slog_profile_add(pSlog, SLOG_PHASE_OUTPUT, slog_time_ns() - nStart - pSlog->nProfileCallback);
+#else
+    slog_write_line(pSlog, eFlag, pDate, pLine, nLength);
+#endif
+}
+
+/* Called by the logging thread before the output, the lock is not shared with the outputs */
+static void slog_record_line(slog_t *pSlog, const slog_config_t *pCfg, slog_flag_t eFlag, const char *pLine, size_t nLength)
+{
+    slog_recorder_t *pRecorder = &pSlog->recorder;
+    if (!(slog_atomic_peek(&pRecorder->nFlags) & (size_t)eFlag) || !nLength) return;
+
+    char sPlain[SLOG_LINE_MAX];
+    char *pAlloc = NULL;
+
+    /* The dump is a plain text file */
+    if (pCfg->eColorFormat != SLOG_COLORING_DISABLE)
+    {
+        char *pBuffer = sPlain;
+        if (nLength >= sizeof(sPlain)) pBuffer = pAlloc = (char*)malloc(nLength + 1);
+
+        if (pBuffer != NULL)
+        {
+            nLength = slog_strip_colors(pLine, nLength, pBuffer);
+            pLine = pBuffer;
+        }
+    }
+
+    slog_mutex_lock(&pRecorder->mutex);
+
+    if (pRecorder->pRing != NULL)
+    {
+        slog_ring_put(pRecorder->pRing, pRecorder->nSize, &pRecorder->nPos, pLine, nLength);
+        pRecorder->nTotal += nLength;
+    }
+
+    slog_mutex_unlock(&pRecorder->mutex);
+    free(pAlloc);
+}
+
+/* Lines of the levels filtered from the outputs are formatted only for the recorder */
+static void slog_record_args(slog_t *pSlog, const slog_context_t *pCtx, const slog_config_t *pCfg, va_list args)
+{
+    char sLine[SLOG_LINE_MAX];
+    SLOG_PROFILE_START(nProfile);
+    size_t nLength = slog_create_line(pCtx, pCfg, sLine, sizeof(sLine), args);
+    SLOG_PROFILE_END(pSlog, SLOG_PHASE_FORMAT, nProfile);
+    slog_record_line(pSlog, pCfg, pCtx->eFlag, sLine, nLength);
+}
+
+static int slog_recorder_open(const char *pPath)
+{
+#ifdef _WIN32
+    return _open(pPath, _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    return open(pPath, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+#endif
+}
+
+static void slog_recorder_close(int nFd)
+{
+#ifdef _WIN32
+    _close(nFd);
+#else
+    close(nFd);
+#endif
+}
+
+/* Async-signal-safe, only open(), write(), close() and the string functions are used */
+static uint8_t slog_recorder_dump(const slog_recorder_t *pRecorder, const char *pPath, const char *pReason)
+{
+    const char *pRing = pRecorder->pRing;
+    uint64_t nTotal = pRecorder->nTotal;
+    size_t nSize = pRecorder->nSize;
+    size_t nPos = pRecorder->nPos;
+    if (pRing == NULL || pPath == NULL || !pPath[0]) return 0;
+
+    int nFd = slog_recorder_open(pPath);
+    if (nFd < 0) return 0;
+
+    slog_write_fd(nFd, SLOG_RECORDER_HEAD, strlen(SLOG_RECORDER_HEAD));
+    slog_write_fd(nFd, pReason, strlen(pReason));
+    slog_write_fd(nFd, SLOG_RECORDER_TAIL, strlen(SLOG_RECORDER_TAIL));
+
+    if (nTotal <= nSize) slog_write_fd(nFd, pRing, (size_t)nTotal);
+    else
+    {
+        /* The oldest line was partly overwritten, the dump starts with the next one */
+        const char *pOldest = pRing + nPos;
+        const char *pEnd = (const char*)memchr(pOldest, '\n', nSize - nPos);
+
+        if (pEnd != NULL)
+        {
+            pEnd++;
+            slog_write_fd(nFd, pEnd, (size_t)(pRing + nSize - pEnd));
+            slog_write_fd(nFd, pRing, nPos);
+        }
+        else if ((pEnd = (const char*)memchr(pRing, '\n', nPos)) != NULL)
+        {
+            pEnd++;
+            slog_write_fd(nFd, pEnd, (size_t)(pRing + nPos - pEnd));
+        }
+    }
+
+    slog_recorder_close(nFd);
+    return 1;
+}
+
+static void slog_recorder_fatal(slog_t *pSlog)
+{
+    slog_recorder_t *pRecorder = &pSlog->recorder;
+    if (!slog_atomic_peek(&pRecorder->nFlags)) return;
+
+    slog_mutex_lock(&pRecorder->mutex);
+    slog_recorder_dump(pRecorder, pRecorder->sPath, "fatal");
+    slog_mutex_unlock(&pRecorder->mutex);
+}
+
+static void slog_recorder_release(slog_recorder_t *pRecorder)
+{
+    free(pRecorder->pRing);
+    pRecorder->pRing = NULL;
+    pRecorder->nTotal = 0;
+    pRecorder->nSize = 0;
+    pRecorder->nPos = 0;
+}
+
+static void slog_recorder_free(slog_recorder_t *pRecorder)
+{
+    slog_recorder_release(pRecorder);
+    pRecorder->sPath[0] = SLOG_NUL;
+}
+
+static uint8_t slog_async_ready(slog_async_t *pAsync)
+{
+    size_t nPos = slog_atomic_get(&pAsync->nDequeuePos);
+    slog_slot_t *pSlot = &pAsync->pSlots[nPos & pAsync->nMask];
+    return slog_atomic_get(&pSlot->nSequence) == nPos + 1 ? 1 : 0;
+}
+
+/* Wake up the writer thread if it went to sleep on an empty queue */
+static void slog_async_notify(slog_async_t *pAsync)
+{
+    slog_atomic_fence();
+    if (!slog_atomic_get(&pAsync->nSleeping)) return;
+
+    slog_mutex_lock(&pAsync->mutex);
+    slog_cond_signal(&pAsync->writerCond, 0);
+    slog_mutex_unlock(&pAsync->mutex);
+}
+
+/* Wake up blocked producers and slog_flush_sync() callers */
+static void slog_async_wakeup(slog_async_t *pAsync)
+{
+    slog_atomic_fence();
+    if (!slog_atomic_get(&pAsync->nWaiting)) return;
+
+    slog_mutex_lock(&pAsync->mutex);
+    slog_cond_signal(&pAsync->waiterCond, 1);
+    slog_mutex_unlock(&pAsync->mutex);
+}
+
+static void slog_async_wait(slog_async_t *pAsync, slog_slot_t *pSlot, size_t nPos)
+{
+    slog_mutex_lock(&pAsync->mutex);
+    slog_atomic_add(&pAsync->nWaiting, 1);
+    slog_atomic_fence();
+
+    if ((intptr_t)(slog_atomic_get(&pSlot->nSequence) - nPos) < 0)
+    {
+        slog_cond_signal(&pAsync->writerCond, 0);
+        slog_cond_wait(&pAsync->waiterCond, &pAsync->mutex, SLOG_ASYNC_WAIT_MS);
+    }
+
+    slog_atomic_add(&pAsync->nWaiting, (size_t)-1);
+    slog_mutex_unlock(&pAsync->mutex);
+}
+
+/* Take the oldest published slot, returns NULL if the queue is empty */
+static slog_slot_t* slog_async_take(slog_async_t *pAsync, size_t *pPos)
+{
+    for (;;)
+    {
+        size_t nPos = slog_atomic_peek(&pAsync->nDequeuePos);
+        slog_slot_t *pSlot = &pAsync->pSlots[nPos & pAsync->nMask];
+        intptr_t nDiff = (intptr_t)(slog_atomic_get(&pSlot->nSequence) - (nPos + 1));
+
+        if (nDiff < 0) return NULL;
+        if (nDiff > 0) continue;
+
+        if (slog_atomic_cas(&pAsync->nDequeuePos, nPos, nPos + 1))
+        {
+            *pPos = nPos;
+            return pSlot;
+        }
+    }
+}
+
+static void slog_async_release(slog_async_t *pAsync, slog_slot_t *pSlot, size_t nPos)
+{
+    if (pSlot->pHeap != NULL)
+    {
+        free(pSlot->pHeap);
+        pSlot->pHeap = NULL;
+    }
+
+    slog_atomic_set(&pSlot->nSequence, nPos + pAsync->nMask + 1);
+    slog_atomic_add(&pAsync->nProcessed, 1);
+}
+
+/* Reserve a slot for the next message according to the overflow policy */
+static slog_slot_t* slog_async_claim(slog_async_t *pAsync)
+{
+    for (;;)
+    {
+        size_t nPos = slog_atomic_peek(&pAsync->nEnqueuePos);
+        slog_slot_t *pSlot = &pAsync->pSlots[nPos & pAsync->nMask];
+        intptr_t nDiff = (intptr_t)(slog_atomic_get(&pSlot->nSequence) - nPos);
+
+        if (nDiff == 0)
+        {
+            if (slog_atomic_cas(&pAsync->nEnqueuePos, nPos, nPos + 1)) return pSlot;
+            continue;
+        }
+
+        /* Another producer already took this position */
+        if (nDiff > 0) continue;
+
+        /* The writer thread can not wait for itself, so it drops when the queue is full */
+        if (pAsync->eOverflow == SLOG_OVERFLOW_DROP_NEWEST || g_nSlogWriter)
+        {
+            slog_atomic_add(&pAsync->nDropped, 1);
+            return NULL;
+        }
+        else if (pAsync->eOverflow == SLOG_OVERFLOW_DROP_OLDEST)
+        {
+            size_t nOldPos = 0;
+            slog_slot_t *pOldest = slog_async_take(pAsync, &nOldPos);
+
+            if (pOldest != NULL)
+            {
+                slog_async_release(pAsync, pOldest, nOldPos);
+                slog_atomic_add(&pAsync->nDropped, 1);
+            }
+            else
+            {
+                /* The oldest slot is still being filled or written */
+                slog_thread_yield();
+            }
+        }
+        else
+        {
+            slog_async_wait(pAsync, pSlot, nPos);
+        }
+    }
+}
+
+static void slog_async_publish(slog_async_t *pAsync, slog_slot_t *pSlot)
+{
+    size_t nSequence = slog_atomic_peek(&pSlot->nSequence);
+    slog_atomic_set(&pSlot->nSequence, nSequence + 1);
+    slog_async_notify(pAsync);
+}
+
+static size_t slog_async_drain(slog_t *pSlog, slog_async_t *pAsync)
+{
+    slog_slot_t *pSlot = NULL;
+    size_t nPos = 0, nCount = 0;
+
+    slog_sync_lock(pSlog);
+
+    while (nCount < SLOG_ASYNC_BATCH &&
+          (pSlot = slog_async_take(pAsync, &nPos)) != NULL)
+    {
+        const char *pLine = pSlot->pHeap != NULL ? pSlot->pHeap : pSlot->sLine;
+        slog_display_line(pSlog, pSlot->eFlag, &pSlot->date, pSlot->nTid, pLine, pSlot->nLength, pSlot->nBodyOff);
+        slog_async_release(pAsync, pSlot, nPos);
+        nCount++;
+    }
+
+    slog_sync_unlock(pSlog);
+    return nCount;
+}
+
+static slog_thread_ret_t SLOG_THREAD_API slog_async_worker(void *pArg)
+{
+    /* The queue is passed directly, it is published only after the thread has started */
+    slog_async_t *pAsync = (slog_async_t*)pArg;
+    slog_t *pSlog = pAsync->pSlog;
+    g_nSlogWriter = 1;
+
+    for (;;)
+    {
+        if (slog_async_drain(pSlog, pAsync))
+        {
+            slog_async_wakeup(pAsync);
+            continue;
+        }
+
+        /* Exit only when every claimed slot has been published and written */
+        if (slog_atomic_get(&pAsync->nStop) &&
+            slog_atomic_get(&pAsync->nDequeuePos) ==
+            slog_atomic_get(&pAsync->nEnqueuePos)) break;
+
+        slog_mutex_lock(&pAsync->mutex);
+        slog_atomic_set(&pAsync->nSleeping, 1);
+        slog_atomic_fence();
+
+        if (!slog_async_ready(pAsync) && !slog_atomic_get(&pAsync->nStop))
+            slog_cond_wait(&pAsync->writerCond, &pAsync->mutex, SLOG_ASYNC_IDLE_MS);
+
+        slog_atomic_set(&pAsync->nSleeping, 0);
+        slog_mutex_unlock(&pAsync->mutex);
+    }
+
+    slog_async_wakeup(pAsync);
+    return (slog_thread_ret_t)0;
+}
+
+/* Pin the queue of the async mode, NULL if the instance is synchronous or being stopped */
+static slog_async_t* slog_async_enter(slog_t *pSlog)
+{
+    if (!slog_atomic_peek(&pSlog->nAsync)) return NULL;
+
+    /* Pairs with the fence of slog_async_stop(), either the stop sees the user or the user sees 0 */
+    slog_atomic_add(&pSlog->nAsyncUsers, 1);
+    slog_atomic_fence();
+
+    slog_async_t *pAsync = (slog_async_t*)slog_atomic_get(&pSlog->nAsync);
+    if (pAsync == NULL) slog_atomic_add(&pSlog->nAsyncUsers, (size_t)-1);
+    return pAsync;
+}
+
+static void slog_async_leave(slog_t *pSlog)
+{
+    slog_atomic_add(&pSlog->nAsyncUsers, (size_t)-1);
+}
+
+static void slog_async_free(slog_async_t *pAsync)
+{
+    slog_cond_destroy(&pAsync->writerCond);
+    slog_cond_destroy(&pAsync->waiterCond);
+    slog_mutex_destroy(&pAsync->mutex);
+    free(pAsync->pSlots);
+    free(pAsync);
+}
+
+static uint8_t slog_async_start(slog_t *pSlog, size_t nQueueSize, slog_overflow_t eOverflow)
+{
+    size_t i, nSlots = 2;
+    while (nSlots < nQueueSize) nSlots <<= 1;
+
+    slog_async_t *pAsync = (slog_async_t*)calloc(1, sizeof(slog_async_t));
+    if (pAsync != NULL) pAsync->pSlots = (slog_slot_t*)malloc(nSlots * sizeof(slog_slot_t));
+
+    if (pAsync == NULL || pAsync->pSlots == NULL)
+    {
+        printf("<%s:%d> %s: [ERROR] Can not allocate async queue: %d\n",
+            __FILE__, __LINE__, __func__, errno);
+
+        free(pAsync);
+        return 0;
+    }
+
+    for (i = 0; i < nSlots; i++)
+    {
+        pAsync->pSlots[i].nSequence = i;
+        pAsync->pSlots[i].pHeap = NULL;
+    }
+
+    pAsync->eOverflow = eOverflow;
+    pAsync->nMask = nSlots - 1;
+    pAsync->pSlog = pSlog;
+
+    slog_mutex_init(&pAsync->mutex);
+    slog_cond_init(&pAsync->writerCond);
+    slog_cond_init(&pAsync->waiterCond);
+
+    if (!slog_thread_create(&pAsync->thread, slog_async_worker, pAsync))
+    {
+        printf("<%s:%d> %s: [ERROR] Can not start writer thread: %d\n",
+            __FILE__, __LINE__, __func__, errno);
+
+        slog_async_free(pAsync);
+        return 0;
+    }
+
+    slog_atomic_set(&pSlog->nAsync, (size_t)pAsync);
+    return 1;
+}
+
+/* Let the writer drain everything that was queued and wait for it to exit */
+static void slog_async_stop(slog_t *pSlog)
+{
+    slog_async_t *pAsync = (slog_async_t*)slog_atomic_get(&pSlog->nAsync);
+    if (pAsync == NULL) return;
+
+    /* New messages will go through the synchronous path from now on,
+     * the callers which already hold the queue are still written */
+    slog_atomic_set(&pSlog->nAsync, 0);
+    slog_atomic_fence();
+    while (slog_atomic_get(&pSlog->nAsyncUsers)) slog_thread_yield();
+    slog_atomic_set(&pAsync->nStop, 1);
+
+    slog_mutex_lock(&pAsync->mutex);
+    slog_cond_signal(&pAsync->writerCond, 0);
+    slog_mutex_unlock(&pAsync->mutex);
+
+    slog_thread_join(&pAsync->thread);
+    slog_async_free(pAsync);
+}
+
+static void slog_display_async(slog_async_t *pAsync, const slog_context_t *pCtx, const slog_config_t *pCfg, va_list args)
+{
+    slog_slot_t *pSlot = slog_async_claim(pAsync);
+    if (pSlot == NULL) return;
+
+    pSlot->eFlag = pCtx->eFlag;
+    pSlot->date = pCtx->date;
+    pSlot->nTid = pCfg->nTraceTid ? slog_thread_get()->nTid : 0;
+    SLOG_PROFILE_START(nProfile);
+
+    /* Slots have a fixed size, growing lines are allocated like in the heap mode */
+    if (!pCfg->nUseHeap && !pCfg->nGrowBuffer)
+    {
+        pSlot->nLength = slog_create_line(pCtx, pCfg, pSlot->sLine, sizeof(pSlot->sLine), args);
+        pSlot->nBodyOff = g_nSlogBodyOff;
+        SLOG_PROFILE_END(pAsync->pSlog, SLOG_PHASE_FORMAT, nProfile);
+        slog_record_line(pAsync->pSlog, pCfg, pCtx->eFlag, pSlot->sLine, pSlot->nLength);
+        slog_async_publish(pAsync, pSlot);
+        return;
+    }
+
+    /* Only messages that do not fit in the slot are allocated */
+    char *pLine = slog_format_line(pCtx, pCfg, pSlot->sLine, &pSlot->nLength, args);
+    pSlot->nBodyOff = g_nSlogBodyOff;
+    SLOG_PROFILE_END(pAsync->pSlog, SLOG_PHASE_FORMAT, nProfile);
+
+    if (pLine == NULL)
+    {
+        printf("<%s:%d> %s<error>%s %s: Can not allocate memory for input: errno(%d)\n",
+            __FILE__, __LINE__, SLOG_COLOR_RED, SLOG_COLOR_RESET, __func__, errno);
+
+        pSlot->nLength = 0;
+    }
+    else
+    {
+        slog_record_line(pAsync->pSlog, pCfg, pCtx->eFlag, pLine, pSlot->nLength);
+        if (pLine != pSlot->sLine) pSlot->pHeap = pLine;
+    }
+
+    slog_async_publish(pAsync, pSlot);
+}
+
+/* Thread buffer is used when the message fits, the heap only for the larger ones */
+static void slog_display_heap(slog_t *pSlog, const slog_context_t *pCtx, const slog_config_t *pCfg, va_list args)
+{
+    uint8_t nBusy = g_nSlogLineBusy;
+    char *pBuffer = nBusy ? NULL : g_slogLine;
+    size_t nLength = 0;
+
+    /* Note: args is closed by the caller, closing it twice is undefined */
+    g_nSlogLineBusy = 1;
+    SLOG_PROFILE_START(nProfile);
+    char *pLine = slog_format_line(pCtx, pCfg, pBuffer, &nLength, args);
+    size_t nBodyOff = g_nSlogBodyOff;
+    SLOG_PROFILE_END(pSlog, SLOG_PHASE_FORMAT, nProfile);
+
+    if (pLine == NULL)
+    {
+        printf("<%s:%d> %s<error>%s %s: Can not allocate memory for input: errno(%d)\n", 
+            __FILE__, __LINE__, SLOG_COLOR_RED, SLOG_COLOR_RESET, __func__, errno);
+
+        g_nSlogLineBusy = nBusy;
+        return;
+    }
+
+    slog_record_line(pSlog, pCfg, pCtx->eFlag, pLine, nLength);
+    slog_sync_lock(pSlog);
+    slog_display_line(pSlog, pCtx->eFlag, &pCtx->date, pCtx->nTid, pLine, nLength, nBodyOff);
+    slog_sync_unlock(pSlog);
+
+    if (pLine != pBuffer) free(pLine);
+    g_nSlogLineBusy = nBusy;
+}
+
+#ifdef _WIN32
+static DWORD g_nSlogGrowKey = FLS_OUT_OF_INDEXES;
+
+static void NTAPI slog_grow_release(void *pLine)
+{
+    free(pLine);
+}
+
+static BOOL CALLBACK slog_grow_key_init(PINIT_ONCE pOnce, PVOID pParam, PVOID *pContext)
+{
+    (void)pOnce;
+    (void)pParam;
+    (void)pContext;
+    g_nSlogGrowKey = FlsAlloc(slog_grow_release);
+    return TRUE;
+}
+#else
+static pthread_key_t g_slogGrowKey;
+
+static void slog_grow_key_init(void)
+{
+    pthread_key_create(&g_slogGrowKey, free);
+}
+#endif
+
+/* Thread local variables have no destructors, the key frees the buffer when the thread exits */
+static void slog_grow_register(char *pLine)
+{
+#ifdef _WIN32
+    static INIT_ONCE growOnce = INIT_ONCE_STATIC_INIT;
+    InitOnceExecuteOnce(&growOnce, slog_grow_key_init, NULL, NULL);
+    if (g_nSlogGrowKey != FLS_OUT_OF_INDEXES) FlsSetValue(g_nSlogGrowKey, pLine);
+#else
+    static pthread_once_t growOnce = PTHREAD_ONCE_INIT;
+    pthread_once(&growOnce, slog_grow_key_init);
+    pthread_setspecific(g_slogGrowKey, pLine);
+#endif
+}
+
+/* Replace the thread buffer with a twice larger one until the line fits, the head is kept */
+static char* slog_grow_line(slog_t *pSlog, const char *pHead, size_t nHeadLen, size_t nRequired)
+{
+    size_t nSize = g_nSlogGrowSize ? g_nSlogGrowSize : SLOG_LINE_MAX;
+    while (nSize < nRequired) nSize *= 2;
+
+    char *pLine = (char*)malloc(nSize);
+    if (pLine == NULL) return NULL;
+
+    memcpy(pLine, pHead, nHeadLen);
+    slog_grow_register(pLine);
+    free(g_pSlogGrowLine);
+
+    g_pSlogGrowLine = pLine;
+    g_nSlogGrowSize = nSize;
+    slog_atomic_add(&pSlog->nGrowths, 1);
+    return pLine;
+}
+
+/* Long messages grow the thread buffer once, the next ones are formatted in a single pass */
+static void slog_display_grow(slog_t *pSlog, const slog_context_t *pCtx, const slog_config_t *pCfg, va_list args)
+{
+    char *pLine = g_pSlogGrowLine != NULL ? g_pSlogGrowLine : g_slogLine;
+    size_t nSize = g_pSlogGrowLine != NULL ? g_nSlogGrowSize : SLOG_LINE_MAX;
+    va_list locArgs;
+
+#ifdef va_copy
+    va_copy(locArgs, args);
+#else
+    memcpy(&locArgs, &args, sizeof(va_list));
+#endif
+
+    SLOG_PROFILE_START(nProfile);
+    size_t nHeadLen = slog_create_head(pCtx, pCfg, pLine);
+    size_t nAvail = nSize - nHeadLen - SLOG_COLOR_MAX;
+    int nBytes = slog_vsnprintf(pLine + nHeadLen, nAvail, pCtx->pFormat, locArgs);
+    va_end(locArgs);
+
+    if (nBytes < 0)
+    {
+        pLine[nHeadLen] = SLOG_NUL;
+        nBytes = 0;
+    }
+    else if ((size_t)nBytes >= nAvail)
+    {
+        pLine = slog_grow_line(pSlog, pLine, nHeadLen, nHeadLen + (size_t)nBytes + SLOG_COLOR_MAX);
+        if (pLine == NULL)
+        {
+            printf("<%s:%d> %s<error>%s %s: Can not allocate memory for input: errno(%d)\n",
+                __FILE__, __LINE__, SLOG_COLOR_RED, SLOG_COLOR_RESET, __func__, errno);
+
+            return;
+        }
+
+        slog_vsnprintf(pLine + nHeadLen, (size_t)nBytes + 1, pCtx->pFormat, args);
+    }
+
+    size_t nLength = nHeadLen + (size_t)nBytes;
+    nLength += slog_create_tail(pCtx, pLine + nLength);
+    SLOG_PROFILE_END(pSlog, SLOG_PHASE_FORMAT, nProfile);
+    slog_record_line(pSlog, pCfg, pCtx->eFlag, pLine, nLength);
+
+    slog_sync_lock(pSlog);
+    slog_display_line(pSlog, pCtx->eFlag, &pCtx->date, pCtx->nTid, pLine, nLength, nHeadLen);
+    slog_sync_unlock(pSlog);
+}
+
+/* Format without holding the lock, only the output itself is serialized */
+static void slog_display_stack(slog_t *pSlog, const slog_context_t *pCtx, const slog_config_t *pCfg, char *pLine, va_list args)
+{
+    SLOG_PROFILE_START(nProfile);
+    size_t nLength = slog_create_line(pCtx, pCfg, pLine, SLOG_LINE_MAX, args);
+    size_t nBodyOff = g_nSlogBodyOff;
+    SLOG_PROFILE_END(pSlog, SLOG_PHASE_FORMAT, nProfile);
+    slog_record_line(pSlog, pCfg, pCtx->eFlag, pLine, nLength);
+
+    slog_sync_lock(pSlog);
+    slog_display_line(pSlog, pCtx->eFlag, &pCtx->date, pCtx->nTid, pLine, nLength, nBodyOff);
+    slog_sync_unlock(pSlog);
+}
+
+/* Log callback can log again while the thread buffer is still in use */
+static void slog_display_nested(slog_t *pSlog, const slog_context_t *pCtx, const slog_config_t *pCfg, va_list args)
+{
+    char sLine[SLOG_LINE_MAX];
+    slog_display_stack(pSlog, pCtx, pCfg, sLine, args);
+}
+
+/* Threads are spread over the stripes in the order of their first counted call */
+static slog_stripe_t* slog_stripe_get(slog_t *pSlog)
+{
+    if (!g_nSlogStripe) g_nSlogStripe = (uint8_t)(slog_atomic_add(&g_nSlogStripes, 1) % SLOG_STATS_STRIPES) + 1;
+    return &pSlog->stripes[g_nSlogStripe - 1];
+}
+
+/* Counting is optional, the level check is the whole cost of a disabled call */
+static void slog_stats_filtered(slog_t *pSlog, slog_flag_t eFlag)
+{
+    if (!slog_atomic_peek(&pSlog->nCountFiltered)) return;
+
+    uint8_t nIndex = slog_level_index(eFlag);
+    if (nIndex < SLOG_LEVEL_COUNT) slog_atomic_add(&slog_stripe_get(pSlog)->nFiltered[nIndex], 1);
+}
+
+/* xorshift64*, seeded by the address of the thread local state */
+static uint32_t slog_random(void)
+{
+    uint64_t nState = g_nSlogRandom;
+    if (!nState) nState = ((uint64_t)(size_t)&g_nSlogRandom ^ slog_time_us()) * 0x9E3779B97F4A7C15ULL | 1;
+
+    nState ^= nState >> 12;
+    nState ^= nState << 25;
+    nState ^= nState >> 27;
+    g_nSlogRandom = nState;
+
+    return (uint32_t)((nState * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+/* Threads logging to more instances than the table holds restart the counter of the evicted one */
+static uint32_t* slog_sample_counter(const slog_t *pSlog, uint8_t nIndex)
+{
+    slog_sample_counts_t *pCounts = NULL;
+    uint8_t i;
+
+    for (i = 0; i < SLOG_SNAPSHOT_MAX; i++)
+    {
+        if (g_slogSampleCounts[i].pOwner == pSlog)
+            return &g_slogSampleCounts[i].counts[nIndex];
+    }
+
+    pCounts = &g_slogSampleCounts[g_nSlogSampleNext];
+    g_nSlogSampleNext = (g_nSlogSampleNext + 1) % SLOG_SNAPSHOT_MAX;
+    memset(pCounts->counts, 0, sizeof(pCounts->counts));
+    pCounts->pOwner = pSlog;
+
+    return &pCounts->counts[nIndex];
+}
+
+/* Counters are per thread and instance, so 1-in-N is exact for every thread and needs no shared state */
+static uint8_t slog_sample_keep(slog_t *pSlog, slog_flag_t eFlag)
+{
+    uint8_t nIndex = slog_level_index(eFlag);
+    if (nIndex >= SLOG_LEVEL_COUNT) return 1;
+
+    slog_sample_t *pSample = &pSlog->samples[nIndex];
+    size_t nEvery = slog_atomic_peek(&pSample->nEvery);
+    size_t nRate = slog_atomic_peek(&pSample->nRate);
+    uint8_t nKeep = 1;
+
+    if (nEvery > 1)
+    {
+        uint32_t *pCount = slog_sample_counter(pSlog, nIndex);
+        nKeep = (!*pCount || *pCount >= nEvery) ? 1 : 0;
+        *pCount = nKeep ? (uint32_t)nEvery - 1 : *pCount - 1;
+    }
+    else if (nRate) nKeep = (size_t)slog_random() < nRate - 1 ? 1 : 0;
+
+    if (!nKeep) slog_atomic_add(&pSample->nDropped, 1);
+    return nKeep;
+}
+
+static void slog_display_args(slog_t *pSlog, const slog_fields_t *pFields, slog_flag_t eFlag, uint8_t nNewLine, const char *pFormat, va_list args)
+{
+    /* Sampled out lines are only counted, or recorded if the recorder wants them */
+    uint8_t nOutput = (slog_atomic_peek(&pSlog->nOutputs) & (size_t)eFlag) ? 1 : 0;
+    if (nOutput && (slog_atomic_peek(&pSlog->nSampling) & (size_t)eFlag)) nOutput = slog_sample_keep(pSlog, eFlag);
+    if (!nOutput && !(slog_atomic_peek(&pSlog->recorder.nFlags) & (size_t)eFlag)) return;
+    SLOG_PROFILE_START(nProfile);
+
+    const slog_snapshot_t *pSnapshot = slog_config_snapshot(pSlog);
+    const slog_config_t *pCfg = &pSnapshot->config;
+    slog_clock_t *pClock = &g_slogClock;
+    slog_async_t *pAsync = NULL;
+    slog_context_t ctx;
+
+    slog_clock_read(pClock, pCfg->nCoarseTime);
+    ctx.date = pClock->date;
+    ctx.pClock = pClock;
+
+    ctx.pPrefixes = &pSnapshot->prefixes;
+    ctx.eFlag = eFlag;
+    ctx.pFormat = pFormat;
+    ctx.nNewLine = nNewLine;
+    ctx.pFields = pFields;
+    ctx.nTid = 0;
+
+    /* Structured lines and lines with fields are limited to the line buffer in every mode */
+    uint8_t nGrow = pCfg->nGrowBuffer && pCfg->eFormat == SLOG_FORMAT_TEXT && pFields == NULL;
+
+    if (!nOutput) slog_record_args(pSlog, &ctx, pCfg, args);
+    else if ((pAsync = slog_async_enter(pSlog)) != NULL)
+    {
+        slog_display_async(pAsync, &ctx, pCfg, args);
+        slog_async_leave(pSlog);
+    }
+    else if (pCfg->nUseHeap || (nGrow && g_nSlogLineBusy)) slog_display_heap(pSlog, &ctx, pCfg, args);
+    else if (g_nSlogLineBusy) slog_display_nested(pSlog, &ctx, pCfg, args);
+    else
+    {
+        g_nSlogLineBusy = 1;
+        if (nGrow) slog_display_grow(pSlog, &ctx, pCfg, args);
+        else slog_display_stack(pSlog, &ctx, pCfg, g_slogLine, args);
+        g_nSlogLineBusy = 0;
+    }
+
+    /* Set by the formatting of this line, the async and nested paths included */
+    if (g_nSlogTruncated)
+    {
+        g_nSlogTruncated = 0;
+        slog_atomic_add(&slog_stripe_get(pSlog)->nTruncated, 1);
+    }
+
+    if (eFlag == SLOG_FATAL) slog_recorder_fatal(pSlog);
+    SLOG_PROFILE_END(pSlog, SLOG_PHASE_TOTAL, nProfile);
+}
+
+void slog_display_ex(slog_t *pSlog, slog_flag_t eFlag, uint8_t nNewLine, const char *pFormat, ...)
+{
+    /* Filtered out calls must not pay for the lock or the clock */
+    size_t nActive = slog_atomic_peek(&pSlog->nActive);
+    if (!SLOG_FLAGS_CHECK(nActive, eFlag))
+    {
+        slog_stats_filtered(pSlog, eFlag);
+        return;
+    }
+
+    va_list args;
+    va_start(args, pFormat);
+    slog_display_args(pSlog, NULL, eFlag, nNewLine, pFormat, args);
+    va_end(args);
+}
+
+uint8_t slog_limit_every(slog_limit_t *pLimit, size_t nEvery)
+{
+    size_t nCall = slog_atomic_add(&pLimit->nCalls, 1);
+    return (nEvery <= 1 || nCall % nEvery == 0) ? 1 : 0;
+}
+
+/* Token bucket kept as the time its next token is due (GCRA), updated with a single CAS */
+uint8_t slog_limit_rate(slog_limit_t *pLimit, uint32_t nPerSec)
+{
+    if (!nPerSec) return 1;
+
+    size_t nInterval = nPerSec < 1000000 ? 1000000 / nPerSec : 1;
+    size_t nBurst = nInterval * (nPerSec - 1);
+    size_t nNow = (size_t)slog_time_us();
+
+    for (;;)
+    {
+        size_t nNext = slog_atomic_get(&pLimit->nNext);
+        size_t nBase = (!nNext || (intptr_t)(nNext - nNow) < 0) ? nNow : nNext;
+
+        if (nBase - nNow > nBurst)
+        {
+            slog_atomic_add(&pLimit->nSuppressed, 1);
+            return 0;
+        }
+
+        if (slog_atomic_cas(&pLimit->nNext, nNext, nBase + nInterval)) return 1;
+    }
+}
+
+static void slog_limited_display_args(slog_t *pSlog, slog_limit_t *pLimit, slog_flag_t eFlag, const char *pFormat, va_list args)
+{
+    /* Dropped lines are reported once, before the next displayed one */
+    size_t nSuppressed = slog_atomic_get(&pLimit->nSuppressed);
+    if (nSuppressed)
+    {
+        slog_atomic_add(&pLimit->nSuppressed, (size_t)0 - nSuppressed);
+        slog_atomic_add(&pSlog->nSuppressed, nSuppressed);
+        slog_display_ex(pSlog, eFlag, 1, "Suppressed %zu messages from %s:%d",
+            nSuppressed, pLimit->pFile, pLimit->nLine);
+    }
+
+    slog_display_args(pSlog, NULL, eFlag, 1, pFormat, args);
+}
+
+void slog_limited_display_ex(slog_t *pSlog, slog_limit_t *pLimit, slog_flag_t eFlag, const char *pFormat, ...)
+{
+    va_list args;
+    va_start(args, pFormat);
+    slog_limited_display_args(pSlog, pLimit, eFlag, pFormat, args);
+    va_end(args);
+}
+
+/* Parse one conversion specification, pSpec points right after the '%' */
+static const char* slog_parse_spec(const char *pSpec, slog_spec_t *pOut)
+{
+    const char *pPos = pSpec;
+    pOut->eType = SLOG_ARG_INVALID;
+    pOut->nWidthArg = 0;
+    pOut->nPrecArg = 0;
+
+    if (*pPos == '%')
+    {
+        pOut->eType = SLOG_ARG_PERCENT;
+        return pPos + 1;
+    }
+
+    while (*pPos && strchr("-+ #0'", *pPos) != NULL) pPos++;
+    if (*pPos == '*') { pOut->nWidthArg = 1; pPos++; }
+    else while (*pPos >= '0' && *pPos <= '9') pPos++;
+
+    if (*pPos == '.')
+    {
+        pPos++;
+        if (*pPos == '*') { pOut->nPrecArg = 1; pPos++; }
+        else while (*pPos >= '0' && *pPos <= '9') pPos++;
+    }
+
+    char cLength = SLOG_NUL;
+    uint8_t nDouble = 0;
+
+    if (*pPos && strchr("hlLzjt", *pPos) != NULL)
+    {
+        cLength = *pPos++;
+        if ((cLength == 'h' || cLength == 'l') && *pPos == cLength)
+        {
+            nDouble = 1;
+            pPos++;
+        }
+    }
+
+    char cConv = *pPos;
+    if (cConv == SLOG_NUL) return pPos;
+
+    if (strchr("diouxXc", cConv) != NULL)
+    {
+        if (cConv == 'c' && cLength == 'l') return pPos + 1;
+        else if (cLength == 'l') pOut->eType = nDouble ? SLOG_ARG_LLONG : SLOG_ARG_LONG;
+        else if (cLength == 'L') pOut->eType = SLOG_ARG_LLONG;
+        else if (cLength == 'z') pOut->eType = SLOG_ARG_SIZE;
+        else if (cLength == 'j') pOut->eType = SLOG_ARG_INTMAX;
+        else if (cLength == 't') pOut->eType = SLOG_ARG_PTRDIFF;
+        else pOut->eType = SLOG_ARG_INT;
+    }
+    else if (strchr("fFeEgGaA", cConv) != NULL)
+        pOut->eType = cLength == 'L' ? SLOG_ARG_LDOUBLE : SLOG_ARG_DOUBLE;
+    else if (cConv == 's' && cLength == SLOG_NUL)
+        pOut->eType = SLOG_ARG_STR;
+    else if (cConv == 'p')
+        pOut->eType = SLOG_ARG_PTR;
+
+    return pPos + 1;
+}
+
+/* Returns the number of arguments or -1 if the format can not be recorded */
+static int slog_parse_types(const char *pFormat, uint8_t *pTypes, size_t nMax)
+{
+    const char *pPos = pFormat;
+    size_t nCount = 0;
+
+    while ((pPos = strchr(pPos, '%')) != NULL)
+    {
+        slog_spec_t spec;
+        pPos = slog_parse_spec(pPos + 1, &spec);
+
+        if (spec.eType == SLOG_ARG_PERCENT) continue;
+        if (spec.eType == SLOG_ARG_INVALID) return -1;
+        if (nCount + spec.nWidthArg + spec.nPrecArg + 1 > nMax) return -1;
+
+        if (spec.nWidthArg) pTypes[nCount++] = SLOG_ARG_INT;
+        if (spec.nPrecArg) pTypes[nCount++] = SLOG_ARG_INT;
+        pTypes[nCount++] = (uint8_t)spec.eType;
+    }
+
+    return (int)nCount;
+}
+
+static void slog_site_register(slog_site_t *pSite, const char *pFormat)
+{
+    if (!slog_atomic_cas(&pSite->nBusy, 0, 1))
+    {
+        /* Another thread is parsing the format */
+        while (!slog_atomic_get(&pSite->nId)) slog_thread_yield();
+        return;
+    }
+
+    int nArgs = slog_parse_types(pFormat, pSite->aTypes, SLOG_BINARY_ARGS_MAX);
+    pSite->nText = nArgs < 0 ? 1 : 0;
+    pSite->nArgs = nArgs < 0 ? 0 : (uint8_t)nArgs;
+    slog_atomic_set(&pSite->nId, slog_atomic_add(&g_nSlogSiteId, 1) + 1);
+}
+
+static uint8_t* slog_record_put(uint8_t *pOut, const void *pData, size_t nSize)
+{
+    memcpy(pOut, pData, nSize);
+    return pOut + nSize;
+}
+
+static uint8_t* slog_record_header(uint8_t *pOut, slog_record_t eType, size_t nSize)
+{
+    uint32_t nLength = (uint32_t)nSize;
+    *pOut++ = (uint8_t)eType;
+    return slog_record_put(pOut, &nLength, sizeof(nLength));
+}
+
+static void slog_binary_write(slog_binary_t *pBinary, slog_record_t eType, const void *pData, size_t nSize)
+{
+    uint8_t header[SLOG_RECORD_HEADER];
+    slog_record_header(header, eType, nSize);
+    fwrite(header, 1, sizeof(header), pBinary->pHandle);
+    if (nSize) fwrite(pData, 1, nSize, pBinary->pHandle);
+}
+
+/* Record the configuration used by the decoder to rebuild the line prefix */
+static void slog_binary_config(slog_t *pSlog, slog_binary_t *pBinary)
+{
+    const slog_config_t *pCfg = &pSlog->config;
+    uint8_t record[SLOG_NAME_MAX + 4];
+    size_t nSepLen = strlen(pCfg->sSeparator);
+
+    record[0] = (uint8_t)pCfg->eDateControl;
+    record[1] = (uint8_t)pCfg->eColorFormat;
+    record[2] = pCfg->nTraceTid;
+    record[3] = pCfg->nIndent;
+    memcpy(record + 4, pCfg->sSeparator, nSepLen);
+
+    slog_binary_write(pBinary, SLOG_RECORD_CONFIG, record, nSepLen + 4);
+    pBinary->nGeneration = slog_atomic_peek(&pSlog->nGeneration);
+}
+
+static void slog_binary_define(slog_binary_t *pBinary, const slog_site_t *pSite, const char *pFormat)
+{
+    size_t nId = pSite->nId;
+
+    if (nId >= pBinary->nDefined)
+    {
+        size_t nSize = nId + 64;
+        uint8_t *pDefined = (uint8_t*)realloc(pBinary->pDefined, nSize);
+
+        if (pDefined != NULL)
+        {
+            memset(pDefined + pBinary->nDefined, 0, nSize - pBinary->nDefined);
+            pBinary->pDefined = pDefined;
+            pBinary->nDefined = nSize;
+        }
+    }
+
+    /* Without the table the format is just defined again */
+    if (nId < pBinary->nDefined && pBinary->pDefined[nId]) return;
+    if (nId < pBinary->nDefined) pBinary->pDefined[nId] = 1;
+
+    uint8_t header[SLOG_RECORD_HEADER];
+    size_t nFileLen = pSite->pFile != NULL ? strlen(pSite->pFile) : 0;
+    size_t nFormatLen = strlen(pFormat);
+    uint32_t nRecId = (uint32_t)nId;
+    uint32_t nLine = (uint32_t)pSite->nLine;
+    uint16_t nFileLen16 = (uint16_t)(nFileLen < UINT16_MAX ? nFileLen : UINT16_MAX);
+    uint8_t fields[10];
+
+    slog_record_header(header, SLOG_RECORD_FORMAT, sizeof(fields) + nFileLen16 + nFormatLen);
+    memcpy(fields, &nRecId, 4);
+    memcpy(fields + 4, &nLine, 4);
+    memcpy(fields + 8, &nFileLen16, 2);
+
+    fwrite(header, 1, sizeof(header), pBinary->pHandle);
+    fwrite(fields, 1, sizeof(fields), pBinary->pHandle);
+    if (nFileLen16) fwrite(pSite->pFile, 1, nFileLen16, pBinary->pHandle);
+    fwrite(pFormat, 1, nFormatLen, pBinary->pHandle);
+}
+
+/* Copy the raw arguments, strings are stored with their length */
+static size_t slog_binary_args(const slog_site_t *pSite, uint8_t *pOut, size_t nSize, va_list args)
+{
+    uint8_t *pPos = pOut;
+    uint8_t i;
+
+    for (i = 0; i < pSite->nArgs; i++)
+    {
+        uint64_t nValue = 0;
+        double fValue = 0;
+
+        switch (pSite->aTypes[i])
+        {
+            case SLOG_ARG_INT: nValue = (uint64_t)(int64_t)va_arg(args, int); break;
+            case SLOG_ARG_LONG: nValue = (uint64_t)(int64_t)va_arg(args, long); break;
+            case SLOG_ARG_LLONG: nValue = (uint64_t)va_arg(args, long long); break;
+            case SLOG_ARG_SIZE: nValue = (uint64_t)va_arg(args, size_t); break;
+            case SLOG_ARG_INTMAX: nValue = (uint64_t)va_arg(args, intmax_t); break;
+            case SLOG_ARG_PTRDIFF: nValue = (uint64_t)va_arg(args, ptrdiff_t); break;
+            case SLOG_ARG_PTR: nValue = (uint64_t)(uintptr_t)va_arg(args, void*); break;
+            case SLOG_ARG_DOUBLE: fValue = va_arg(args, double); break;
+            case SLOG_ARG_LDOUBLE: fValue = (double)va_arg(args, long double); break;
+            case SLOG_ARG_STR:
+            {
+                const char *pStr = va_arg(args, const char*);
+                if (pStr == NULL) pStr = "(null)";
+
+                /* Leave room for the remaining fixed size arguments */
+                size_t nReserved = (size_t)(pSite->nArgs - i) * sizeof(uint64_t);
+                size_t nAvail = nSize - (size_t)(pPos - pOut) - nReserved;
+                size_t nStrLen = strlen(pStr);
+                if (nStrLen > nAvail) nStrLen = nAvail;
+
+                uint32_t nLength = (uint32_t)nStrLen;
+                pPos = slog_record_put(pPos, &nLength, sizeof(nLength));
+                pPos = slog_record_put(pPos, pStr, nStrLen);
+                continue;
+            }
+            default:
+                break;
+        }
+
+        if (pSite->aTypes[i] == SLOG_ARG_DOUBLE ||
+            pSite->aTypes[i] == SLOG_ARG_LDOUBLE)
+            pPos = slog_record_put(pPos, &fValue, sizeof(fValue));
+        else pPos = slog_record_put(pPos, &nValue, sizeof(nValue));
+    }
+
+    return (size_t)(pPos - pOut);
+}
+
+static void slog_kv_display_args(slog_t *pSlog, const slog_fields_t *pFields, slog_flag_t eFlag, const char *pFormat, ...)
+{
+    va_list args;
+    va_start(args, pFormat);
+    slog_display_args(pSlog, pFields, eFlag, 1, pFormat, args);
+    va_end(args);
+}
+
+void slog_kv_display_ex(slog_t *pSlog, slog_flag_t eFlag, const char *pFile, int nLine, const char *pMessage, const slog_kv_t *pFields, size_t nCount)
+{
+    size_t nActive = slog_atomic_peek(&pSlog->nActive);
+    if (!SLOG_FLAGS_CHECK(nActive, eFlag))
+    {
+        slog_stats_filtered(pSlog, eFlag);
+        return;
+    }
+
+    slog_fields_t fields;
+    fields.pFile = pFile;
+    fields.nLine = nLine;
+    fields.pList = pFields;
+    fields.nCount = nCount;
+
+    /* Message is not a format string, it is passed through "%s" */
+    slog_kv_display_args(pSlog, &fields, eFlag, "%s", pMessage != NULL ? pMessage : SLOG_EMPTY);
+}
+
+static void slog_binary_display_args(slog_t *pSlog, slog_site_t *pSite, slog_flag_t eFlag, const char *pFormat, va_list args)
+{
+    if (!slog_atomic_get(&pSite->nId)) slog_site_register(pSite, pFormat);
+
+    /* Formats with unsupported conversions are displayed as usual,
+     * the levels filtered from the outputs go to the recorder as text */
+    if (pSite->nText || pSlog->pBinary == NULL ||
+        !(slog_atomic_peek(&pSlog->nOutputs) & (size_t)eFlag))
+    {
+        slog_display_args(pSlog, NULL, eFlag, 1, pFormat, args);
+        return;
+    }
+
+    if ((slog_atomic_peek(&pSlog->nSampling) & (size_t)eFlag) && !slog_sample_keep(pSlog, eFlag)) return;
+
+    const slog_snapshot_t *pSnapshot = slog_config_snapshot(pSlog);
+    const slog_config_t *pCfg = &pSnapshot->config;
+    slog_clock_t *pClock = &g_slogClock;
+    slog_clock_read(pClock, pCfg->nCoarseTime);
+
+    /* The ring holds text lines, so the recorded levels are also formatted */
+    if (slog_atomic_peek(&pSlog->recorder.nFlags) & (size_t)eFlag)
+    {
+        slog_context_t ctx;
+        ctx.pPrefixes = &pSnapshot->prefixes;
+        ctx.pFields = NULL;
+        ctx.pClock = pClock;
+        ctx.pFormat = pFormat;
+        ctx.eFlag = eFlag;
+        ctx.date = pClock->date;
+        ctx.nNewLine = 1;
+        ctx.nTid = 0;
+
+        va_list locArgs;
+#ifdef va_copy
+        va_copy(locArgs, args);
+#else
+        memcpy(&locArgs, &args, sizeof(va_list));
+#endif
+        slog_record_args(pSlog, &ctx, pCfg, locArgs);
+        va_end(locArgs);
+    }
+
+    const slog_date_t *pDate = &pClock->date;
+    uint8_t record[SLOG_RECORD_HEADER + SLOG_MESSAGE_MAX];
+    uint8_t *pPos = record + SLOG_RECORD_HEADER;
+
+    uint32_t nId = (uint32_t)pSite->nId;
+    uint64_t nTid = pCfg->nTraceTid ? (uint64_t)slog_thread_get()->nTid : 0;
+
+    pPos = slog_record_put(pPos, &nId, sizeof(nId));
+    *pPos++ = (uint8_t)eFlag;
+    *pPos++ = 1;
+    pPos = slog_record_put(pPos, &pDate->nYear, sizeof(pDate->nYear));
+    *pPos++ = pDate->nMonth;
+    *pPos++ = pDate->nDay;
+    *pPos++ = pDate->nHour;
+    *pPos++ = pDate->nMin;
+    *pPos++ = pDate->nSec;
+    pPos = slog_record_put(pPos, &pDate->nUsec, sizeof(pDate->nUsec));
+    pPos = slog_record_put(pPos, &nTid, sizeof(nTid));
+
+    size_t nFixed = (size_t)(pPos - record);
+    pPos += slog_binary_args(pSite, pPos, sizeof(record) - nFixed, args);
+
+    size_t nLength = (size_t)(pPos - record);
+    slog_record_header(record, SLOG_RECORD_LINE, nLength - SLOG_RECORD_HEADER);
+
+    slog_sync_lock(pSlog);
+    slog_binary_t *pBinary = pSlog->pBinary;
+
+    if (pBinary != NULL)
+    {
+        if (pBinary->nGeneration != slog_atomic_peek(&pSlog->nGeneration))
+            slog_binary_config(pSlog, pBinary);
+
+        slog_binary_define(pBinary, pSite, pFormat);
+        fwrite(record, 1, nLength, pBinary->pHandle);
+        if (eFlag == SLOG_FATAL) fflush(pBinary->pHandle);
+
+        uint8_t nIndex = slog_level_index(eFlag);
+        if (nIndex < SLOG_LEVEL_COUNT) pSlog->counters.nLines[nIndex]++;
+    }
+
+    slog_sync_unlock(pSlog);
+    if (eFlag == SLOG_FATAL) slog_recorder_fatal(pSlog);
+}
+
+void slog_binary_display_ex(slog_t *pSlog, slog_site_t *pSite, slog_flag_t eFlag, const char *pFormat, ...)
+{
+    size_t nActive = slog_atomic_peek(&pSlog->nActive);
+    if (!SLOG_FLAGS_CHECK(nActive, eFlag))
+    {
+        slog_stats_filtered(pSlog, eFlag);
+        return;
+    }
+
+    va_list args;
+    va_start(args, pFormat);
+    slog_binary_display_args(pSlog, pSite, eFlag, pFormat, args);
+    va_end(args);
+}
+
+static void slog_binary_free(slog_binary_t *pBinary)
+{
+    if (pBinary == NULL) return;
+    if (pBinary->pHandle != NULL) fclose(pBinary->pHandle);
+    free(pBinary->pDefined);
+    free(pBinary);
+}
+
+uint8_t slog_binary_open_ex(slog_t *pSlog, const char *pFilePath)
+{
+    if (pFilePath == NULL) return 0;
+
+    slog_binary_t *pBinary = (slog_binary_t*)calloc(1, sizeof(slog_binary_t));
+    if (pBinary == NULL) return 0;
+
+    pBinary->pHandle = fopen(pFilePath, "ab");
+    if (pBinary->pHandle == NULL)
+    {
+        printf("<%s:%d> %s: [ERROR] Failed to open binary file: %s (%s)\n",
+            __FILE__, __LINE__, __func__, pFilePath, strerror(errno));
+
+        free(pBinary);
+        return 0;
+    }
+
+    setvbuf(pBinary->pHandle, NULL, _IOFBF, SLOG_FILE_BUFFER_SIZE);
+    fseek(pBinary->pHandle, 0, SEEK_END);
+
+    if (ftell(pBinary->pHandle) == 0)
+    {
+        uint32_t nOrder = SLOG_BINARY_ORDER;
+        fwrite(SLOG_BINARY_MAGIC, 1, sizeof(SLOG_BINARY_MAGIC) - 1, pBinary->pHandle);
+        fwrite(&nOrder, 1, sizeof(nOrder), pBinary->pHandle);
+    }
+
+    /* Format identifiers are valid only within one session */
+    slog_binary_write(pBinary, SLOG_RECORD_SESSION, NULL, 0);
+
+    slog_sync_lock(pSlog);
+    slog_binary_free(pSlog->pBinary);
+    pSlog->pBinary = pBinary;
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+
+    return 1;
+}
+
+void slog_binary_close_ex(slog_t *pSlog)
+{
+    slog_sync_lock(pSlog);
+    slog_binary_free(pSlog->pBinary);
+    pSlog->pBinary = NULL;
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+}
+
+static uint8_t slog_record_get(const uint8_t *pData, size_t nSize, size_t *pOffset, void *pOut, size_t nLength)
+{
+    if (*pOffset + nLength > nSize) return 0;
+    memcpy(pOut, pData + *pOffset, nLength);
+    *pOffset += nLength;
+    return 1;
+}
+
+/* Format one recorded value with its own specification */
+static int slog_binary_value(char *pOut, size_t nSize, const char *pSpec, slog_arg_t eType,
+    const uint8_t *pArgs, size_t nArgsLen, size_t *pOffset)
+{
+    uint64_t nValue = 0;
+    double fValue = 0;
+
+    if (eType == SLOG_ARG_STR)
+    {
+        uint32_t nLength = 0;
+        char sValue[SLOG_MESSAGE_MAX];
+
+        if (!slog_record_get(pArgs, nArgsLen, pOffset, &nLength, sizeof(nLength))) return -1;
+        if (nLength >= sizeof(sValue) || *pOffset + nLength > nArgsLen) return -1;
+
+        memcpy(sValue, pArgs + *pOffset, nLength);
+        sValue[nLength] = SLOG_NUL;
+        *pOffset += nLength;
+
+        return snprintf(pOut, nSize, pSpec, sValue);
+    }
+
+    if (eType == SLOG_ARG_DOUBLE || eType == SLOG_ARG_LDOUBLE)
+    {
+        if (!slog_record_get(pArgs, nArgsLen, pOffset, &fValue, sizeof(fValue))) return -1;
+        if (eType == SLOG_ARG_DOUBLE) return snprintf(pOut, nSize, pSpec, fValue);
+        return snprintf(pOut, nSize, pSpec, (long double)fValue);
+    }
+
+    if (!slog_record_get(pArgs, nArgsLen, pOffset, &nValue, sizeof(nValue))) return -1;
+
+    switch (eType)
+    {
+        case SLOG_ARG_INT: return snprintf(pOut, nSize, pSpec, (int)nValue);
+        case SLOG_ARG_LONG: return snprintf(pOut, nSize, pSpec, (long)nValue);
+        case SLOG_ARG_LLONG: return snprintf(pOut, nSize, pSpec, (long long)nValue);
+        case SLOG_ARG_SIZE: return snprintf(pOut, nSize, pSpec, (size_t)nValue);
+        case SLOG_ARG_INTMAX: return snprintf(pOut, nSize, pSpec, (intmax_t)nValue);
+        case SLOG_ARG_PTRDIFF: return snprintf(pOut, nSize, pSpec, (ptrdiff_t)nValue);
+        case SLOG_ARG_PTR: return snprintf(pOut, nSize, pSpec, (void*)(uintptr_t)nValue);
+        default: return -1;
+    }
+}
+
+/* Rebuild the message the same way vsnprintf() would have formatted it */
+static size_t slog_binary_message(const char *pFormat, const uint8_t *pArgs, size_t nArgsLen, char *pOut, size_t nSize)
+{
+    const char *pPos = pFormat;
+    size_t nOffset = 0;
+    size_t nLength = 0;
+
+    while (*pPos && nLength < nSize - 1)
+    {
+        if (*pPos != '%')
+        {
+            pOut[nLength++] = *pPos++;
+            continue;
+        }
+
+        slog_spec_t spec;
+        const char *pEnd = slog_parse_spec(pPos + 1, &spec);
+
+        if (spec.eType == SLOG_ARG_PERCENT)
+        {
+            pOut[nLength++] = '%';
+            pPos = pEnd;
+            continue;
+        }
+
+        int32_t nWidth = 0, nPrec = 0;
+        uint64_t nValue = 0;
+
+        if (spec.eType == SLOG_ARG_INVALID || pEnd - pPos > SLOG_TAG_MAX) break;
+        if (spec.nWidthArg && slog_record_get(pArgs, nArgsLen, &nOffset, &nValue, sizeof(nValue))) nWidth = (int32_t)nValue;
+        if (spec.nPrecArg && slog_record_get(pArgs, nArgsLen, &nOffset, &nValue, sizeof(nValue))) nPrec = (int32_t)nValue;
+
+        /* Replace '*' with the recorded width and precision */
+        char sSpec[SLOG_TAG_MAX * 2];
+        size_t nSpecLen = 0;
+        uint8_t nDot = 0;
+
+        for (; pPos < pEnd; pPos++)
+        {
+            if (*pPos == '.') nDot = 1;
+            if (*pPos != '*')
+            {
+                sSpec[nSpecLen++] = *pPos;
+                continue;
+            }
+
+            /* Negative precision is taken as if it was omitted */
+            if (nDot && nPrec < 0) nSpecLen--;
+            else nSpecLen += (size_t)snprintf(sSpec + nSpecLen, sizeof(sSpec) - nSpecLen, "%d", nDot ? nPrec : nWidth);
+        }
+
+        sSpec[nSpecLen] = SLOG_NUL;
+        int nBytes = slog_binary_value(pOut + nLength, nSize - nLength, sSpec, spec.eType, pArgs, nArgsLen, &nOffset);
+        if (nBytes < 0) break;
+
+        nLength += (size_t)nBytes < nSize - nLength ? (size_t)nBytes : nSize - nLength - 1;
+    }
+
+    pOut[nLength] = SLOG_NUL;
+    return nLength;
+}
+
+static void slog_decode_line(FILE *pOutput, const slog_config_t *pCfg, const slog_prefixes_t *pPrefixes, slog_clock_t *pClock,
+    char **ppFormats, size_t nFormats, const uint8_t *pRecord, size_t nSize)
+{
+    slog_context_t ctx;
+    slog_date_t date;
+    uint32_t nId = 0;
+    uint64_t nTid = 0;
+    size_t nOffset = 0;
+    uint8_t fields[7];
+
+    if (!slog_record_get(pRecord, nSize, &nOffset, &nId, sizeof(nId)) ||
+        !slog_record_get(pRecord, nSize, &nOffset, fields, 2) ||
+        !slog_record_get(pRecord, nSize, &nOffset, &date.nYear, sizeof(date.nYear)) ||
+        !slog_record_get(pRecord, nSize, &nOffset, fields + 2, 5) ||
+        !slog_record_get(pRecord, nSize, &nOffset, &date.nUsec, sizeof(date.nUsec)) ||
+        !slog_record_get(pRecord, nSize, &nOffset, &nTid, sizeof(nTid))) return;
+
+    if (nId >= nFormats || ppFormats[nId] == NULL) return;
+
+    date.nMonth = fields[2];
+    date.nDay = fields[3];
+    date.nHour = fields[4];
+    date.nMin = fields[5];
+    date.nSec = fields[6];
+    date.nOffset = 0; /* The text prefix of the decoded lines has no zone */
+
+    uint64_t nSecond = ((((((uint64_t)date.nYear * 13 + date.nMonth) * 32 +
+        date.nDay) * 24 + date.nHour) * 60 + date.nMin) * 60) + date.nSec;
+
+    if (nSecond != pClock->nSecond)
+    {
+        pClock->date = date;
+        pClock->nSecond = nSecond;
+        slog_clock_render(pClock);
+    }
+
+    ctx.pPrefixes = pPrefixes;
+    ctx.pClock = pClock;
+    ctx.pFormat = ppFormats[nId];
+    ctx.eFlag = (slog_flag_t)fields[0];
+    ctx.nNewLine = fields[1];
+    ctx.nTid = (size_t)nTid;
+    ctx.pFields = NULL;
+    ctx.date = date;
+
+    char sLine[SLOG_LINE_MAX];
+    size_t nLength = slog_create_head(&ctx, pCfg, sLine);
+    nLength += slog_binary_message(ctx.pFormat, pRecord + nOffset, nSize - nOffset, sLine + nLength, SLOG_MESSAGE_MAX);
+    nLength += slog_create_tail(&ctx, sLine + nLength);
+    fwrite(sLine, 1, nLength, pOutput);
+}
+
+static void slog_decode_format(char ***pppFormats, size_t *pFormats, const uint8_t *pRecord, size_t nSize)
+{
+    uint32_t nId = 0, nLine = 0;
+    uint16_t nFileLen = 0;
+    size_t nOffset = 0;
+
+    if (!slog_record_get(pRecord, nSize, &nOffset, &nId, sizeof(nId)) ||
+        !slog_record_get(pRecord, nSize, &nOffset, &nLine, sizeof(nLine)) ||
+        !slog_record_get(pRecord, nSize, &nOffset, &nFileLen, sizeof(nFileLen)) ||
+        nOffset + nFileLen > nSize) return;
+
+    nOffset += nFileLen;
+    if (nId >= *pFormats)
+    {
+        size_t nCount = (size_t)nId + 64;
+        char **ppFormats = (char**)realloc(*pppFormats, nCount * sizeof(char*));
+        if (ppFormats == NULL) return;
+
+        memset(ppFormats + *pFormats, 0, (nCount - *pFormats) * sizeof(char*));
+        *pppFormats = ppFormats;
+        *pFormats = nCount;
+    }
+
+    char *pFormat = (char*)malloc(nSize - nOffset + 1);
+    if (pFormat == NULL) return;
+
+    memcpy(pFormat, pRecord + nOffset, nSize - nOffset);
+    pFormat[nSize - nOffset] = SLOG_NUL;
+
+    free((*pppFormats)[nId]);
+    (*pppFormats)[nId] = pFormat;
+}
+
+static void slog_decode_config(slog_config_t *pCfg, const uint8_t *pRecord, size_t nSize)
+{
+    if (nSize < 4) return;
+    size_t nSepLen = nSize - 4;
+    if (nSepLen >= sizeof(pCfg->sSeparator)) nSepLen = sizeof(pCfg->sSeparator) - 1;
+
+    pCfg->eDateControl = (slog_date_ctrl_t)pRecord[0];
+    pCfg->eColorFormat = (slog_coloring_t)pRecord[1];
+    pCfg->nTraceTid = pRecord[2];
+    pCfg->nIndent = pRecord[3];
+
+    memcpy(pCfg->sSeparator, pRecord + 4, nSepLen);
+    pCfg->sSeparator[nSepLen] = SLOG_NUL;
+}
+
+int slog_binary_decode(const char *pFilePath, FILE *pOutput)
+{
+    FILE *pFile = fopen(pFilePath, "rb");
+    if (pFile == NULL)
+    {
+        printf("<%s:%d> %s: [ERROR] Failed to open binary file: %s (%s)\n",
+            __FILE__, __LINE__, __func__, pFilePath, strerror(errno));
+
+        return -1;
+    }
+
+    char sMagic[sizeof(SLOG_BINARY_MAGIC) - 1];
+    uint32_t nOrder = 0;
+
+    if (fread(sMagic, 1, sizeof(sMagic), pFile) != sizeof(sMagic) ||
+        fread(&nOrder, 1, sizeof(nOrder), pFile) != sizeof(nOrder) ||
+        memcmp(sMagic, SLOG_BINARY_MAGIC, sizeof(sMagic)) ||
+        nOrder != SLOG_BINARY_ORDER)
+    {
+        printf("<%s:%d> %s: [ERROR] Not a binary log of this platform: %s\n",
+            __FILE__, __LINE__, __func__, pFilePath);
+
+        fclose(pFile);
+        return -1;
+    }
+
+    slog_config_t config;
+    slog_clock_t clock;
+    memset(&config, 0, sizeof(config));
+    memset(&clock, 0, sizeof(clock));
+    config.eDateControl = SLOG_TIME_ONLY;
+    config.eColorFormat = SLOG_COLORING_TAG;
+    config.sSeparator[0] = ' ';
+
+    slog_prefixes_t prefixes;
+    slog_build_prefixes(&prefixes, &config);
+
+    char **ppFormats = NULL;
+    size_t nFormats = 0;
+    uint8_t *pRecord = NULL;
+    size_t nCapacity = 0;
+    int nLines = 0;
+    size_t i;
+
+    for (;;)
+    {
+        uint8_t header[SLOG_RECORD_HEADER];
+        uint32_t nSize = 0;
+
+        if (fread(header, 1, sizeof(header), pFile) != sizeof(header)) break;
+        memcpy(&nSize, header + 1, sizeof(nSize));
+
+        if (nSize > nCapacity)
+        {
+            uint8_t *pNew = (uint8_t*)realloc(pRecord, nSize);
+            if (pNew == NULL) break;
+            pRecord = pNew;
+            nCapacity = nSize;
+        }
+
+        /* Record cut off by a crash ends the log */
+        if (fread(pRecord, 1, nSize, pFile) != nSize) break;
+
+        switch ((slog_record_t)header[0])
+        {
+            case SLOG_RECORD_SESSION:
+                for (i = 0; i < nFormats; i++) { free(ppFormats[i]); ppFormats[i] = NULL; }
+                break;
+            case SLOG_RECORD_CONFIG:
+                slog_decode_config(&config, pRecord, nSize);
+                slog_build_prefixes(&prefixes, &config);
+                break;
+            case SLOG_RECORD_FORMAT:
+                slog_decode_format(&ppFormats, &nFormats, pRecord, nSize);
+                break;
+            case SLOG_RECORD_LINE:
+                slog_decode_line(pOutput, &config, &prefixes, &clock, ppFormats, nFormats, pRecord, nSize);
+                nLines++;
+                break;
+            default:
+                break;
+        }
+    }
+
+    for (i = 0; i < nFormats; i++) free(ppFormats[i]);
+    free(ppFormats);
+    free(pRecord);
+    fclose(pFile);
+
+    return nLines;
+}
+
+/* Logging macros call it before the arguments are evaluated, so the filtered calls are counted here */
+uint8_t slog_is_enabled_ex(slog_t *pSlog, slog_flag_t eFlag)
+{
+    size_t nActive = slog_atomic_peek(&pSlog->nActive);
+    if (SLOG_FLAGS_CHECK(nActive, eFlag)) return 1;
+
+    slog_stats_filtered(pSlog, eFlag);
+    return 0;
+}
+
+uint8_t slog_is_init_ex(slog_t *pSlog)
+{
+    return pSlog->nInit ? 1 : 0;
+}
+
+const char* slog_version(uint8_t nShort)
+{
+    return nShort ? g_slogVerShort : g_slogVerLong;
+}
+
+void slog_config_get_ex(slog_t *pSlog, slog_config_t *pCfg)
+{
+    slog_sync_lock(pSlog);
+    *pCfg = pSlog->config;
+    slog_sync_unlock(pSlog);
+}
+
+void slog_config_set_ex(slog_t *pSlog, slog_config_t *pCfg)
+{
+    slog_sync_lock(pSlog);
+    slog_config_t *pOldCfg = &pSlog->config;
+    slog_file_t *pFile = &pSlog->logFile;
+
+    /* Pending repeats are reported with the configuration they were counted with */
+    slog_repeat_flush(pSlog);
+
+    if (!pCfg->nToFile ||
+        pOldCfg->nMapFile != pCfg->nMapFile ||
+        pOldCfg->nMaxFileSize != pCfg->nMaxFileSize ||
+        pOldCfg->nKeepOpen != pCfg->nKeepOpen ||
+        strncmp(pOldCfg->sFilePath, pCfg->sFilePath, sizeof(pOldCfg->sFilePath)) ||
+        strncmp(pOldCfg->sFileName, pCfg->sFileName, sizeof(pOldCfg->sFileName)))
+    {
+        slog_close_file(pFile); /* Log function will open it again if required */
+        pFile->sFilePath[0] = SLOG_NUL;
+    }
+
+    pSlog->config = *pCfg;
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+}
+
+void slog_enable_ex(slog_t *pSlog, slog_flag_t eFlag)
+{
+    slog_sync_lock(pSlog);
+    slog_config_t *pCfg = &pSlog->config;
+
+    if (eFlag == SLOG_FLAGS_ALL) pCfg->nFlags = SLOG_FLAGS_ALL;
+    else if (!SLOG_FLAGS_CHECK(pCfg->nFlags, eFlag)) pCfg->nFlags |= eFlag;
+
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+}
+
+void slog_disable_ex(slog_t *pSlog, slog_flag_t eFlag)
+{
+    slog_sync_lock(pSlog);
+    slog_config_t *pCfg = &pSlog->config;
+
+    if (eFlag == SLOG_FLAGS_ALL) pCfg->nFlags = 0;
+    else if (SLOG_FLAGS_CHECK(pCfg->nFlags, eFlag)) pCfg->nFlags &= ~eFlag;
+
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+}
+
+static void slog_separator_args(slog_t *pSlog, const char *pFormat, va_list args)
+{
+    slog_sync_lock(pSlog);
+    slog_config_t *pCfg = &pSlog->config;
+
+    if (vsnprintf(pCfg->sSeparator, sizeof(pCfg->sSeparator), pFormat, args) <= 0)
+    {
+        pCfg->sSeparator[0] = ' ';
+        pCfg->sSeparator[1] = '\0';
+    }
+
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+}
+
+void slog_separator_set_ex(slog_t *pSlog, const char *pFormat, ...)
+{
+    va_list args;
+    va_start(args, pFormat);
+    slog_separator_args(pSlog, pFormat, args);
+    va_end(args);
+}
+
+void slog_callback_set_ex(slog_t *pSlog, slog_cb_t callback, void *pContext)
+{
+    slog_sync_lock(pSlog);
+    slog_config_t *pCfg = &pSlog->config;
+    pCfg->pCallbackCtx = pContext;
+    pCfg->logCallback = callback;
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+}
+
+size_t slog_get_full_path_ex(slog_t *pSlog, char *pFilePath, size_t nSize)
+{
+    if (pFilePath == NULL || !nSize) return 0;
+    slog_sync_lock(pSlog);
+
+    slog_file_t *pFile = &pSlog->logFile;
+    int nLength = snprintf(pFilePath, nSize, "%s", pFile->sFilePath);
+
+    /* snprintf() returns the length it wanted to write, clamp it to the buffer */
+    if (nLength < 0) nLength = 0;
+    else if ((size_t)nLength >= nSize) nLength = (int)nSize - 1;
+    pFilePath[nLength] = SLOG_NUL;
+
+    slog_sync_unlock(pSlog);
+    return (size_t)nLength;
+}
+
+size_t slog_path_set_ex(slog_t *pSlog, const char *pPath)
+{
+    if (pPath == NULL) return 0;
+    slog_sync_lock(pSlog);
+
+    slog_config_t *pCfg = &pSlog->config;
+    slog_file_t *pFile = &pSlog->logFile;
+
+    if (strncmp(pCfg->sFilePath, pPath, sizeof(pCfg->sFilePath)))
+    {
+        slog_close_file(pFile); /* Log function will open it again if required */
+        pFile->sFilePath[0] = SLOG_NUL;
+    }
+
+    int nLength = snprintf(pCfg->sFilePath, sizeof(pCfg->sFilePath), "%s", pPath);
+    if (nLength < 0) nLength = 0;
+    else if ((size_t)nLength >= sizeof(pCfg->sFilePath)) nLength = (int)sizeof(pCfg->sFilePath) - 1;
+
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+    return (size_t)nLength;
+}
+
+size_t slog_name_set_ex(slog_t *pSlog, const char *pName)
+{
+    if (pName == NULL) return 0;
+    slog_sync_lock(pSlog);
+
+    slog_config_t *pCfg = &pSlog->config;
+    slog_file_t *pFile = &pSlog->logFile;
+
+    if (strncmp(pCfg->sFileName, pName, sizeof(pCfg->sFileName)))
+    {
+        slog_close_file(pFile); /* Log function will open it again if required */
+        pFile->sFilePath[0] = SLOG_NUL;
+    }
+
+    int nLength = snprintf(pCfg->sFileName, sizeof(pCfg->sFileName), "%s", pName);
+    if (nLength < 0) nLength = 0;
+    else if ((size_t)nLength >= sizeof(pCfg->sFileName)) nLength = (int)sizeof(pCfg->sFileName) - 1;
+
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+    return (size_t)nLength;
+}
+
+void slog_color_format_set_ex(slog_t *pSlog, slog_coloring_t eFmt)
+{
+    slog_sync_lock(pSlog);
+    pSlog->config.eColorFormat = eFmt;
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+}
+
+void slog_date_format_set_ex(slog_t *pSlog, slog_date_ctrl_t eFmt)
+{
+    slog_sync_lock(pSlog);
+    pSlog->config.eDateControl = eFmt;
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+}
+
+void slog_format_set_ex(slog_t *pSlog, slog_format_t eFormat)
+{
+    slog_sync_lock(pSlog);
+    pSlog->config.eFormat = eFormat;
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+}
+
+void slog_screen_set_ex(slog_t *pSlog, uint8_t nEnable)
+{
+    slog_sync_lock(pSlog);
+    pSlog->config.nToScreen = nEnable;
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+}
+
+void slog_file_set_ex(slog_t *pSlog, uint8_t nEnable)
+{
+    slog_sync_lock(pSlog);
+
+    if (!nEnable) slog_close_file(&pSlog->logFile);
+    pSlog->config.nToFile = nEnable;
+
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+}
+
+void slog_flush_set_ex(slog_t *pSlog, uint8_t nEnable)
+{
+    slog_sync_lock(pSlog);
+    pSlog->config.nFlush = nEnable;
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+}
+
+void slog_indent_set_ex(slog_t *pSlog, uint8_t nEnable)
+{
+    slog_sync_lock(pSlog);
+    pSlog->config.nIndent = nEnable;
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+}
+
+void slog_trace_tid_set_ex(slog_t *pSlog, uint8_t nEnable)
+{
+    slog_sync_lock(pSlog);
+    pSlog->config.nTraceTid = nEnable;
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+}
+
+void slog_use_heap_set_ex(slog_t *pSlog, uint8_t nEnable)
+{
+    slog_sync_lock(pSlog);
+    pSlog->config.nUseHeap = nEnable;
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+}
+
+void slog_grow_buffer_set_ex(slog_t *pSlog, uint8_t nEnable)
+{
+    slog_sync_lock(pSlog);
+    pSlog->config.nGrowBuffer = nEnable;
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+}
+
+void slog_coarse_time_set_ex(slog_t *pSlog, uint8_t nEnable)
+{
+    slog_sync_lock(pSlog);
+    pSlog->config.nCoarseTime = nEnable;
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+}
+
+void slog_file_buffer_set_ex(slog_t *pSlog, uint32_t nSize)
+{
+    slog_sync_lock(pSlog);
+    pSlog->config.nFileBuffer = nSize;
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+}
+
+void slog_flush_delay_set_ex(slog_t *pSlog, uint32_t nDelayMs)
+{
+    slog_sync_lock(pSlog);
+    pSlog->config.nFlushDelay = nDelayMs;
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+}
+
+void slog_reopen_check_set_ex(slog_t *pSlog, uint32_t nIntervalMs)
+{
+    slog_sync_lock(pSlog);
+    pSlog->config.nReopenCheck = nIntervalMs;
+    pSlog->logFile.nCheckAt = 0;
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+}
+
+void slog_map_file_set_ex(slog_t *pSlog, uint8_t nEnable)
+{
+    slog_sync_lock(pSlog);
+
+    /* Reopen the file in the requested mode with the next log */
+    if (pSlog->config.nMapFile != nEnable) slog_close_file(&pSlog->logFile);
+    pSlog->config.nMapFile = nEnable;
+
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+}
+
+void slog_max_file_size_set_ex(slog_t *pSlog, uint64_t nSize)
+{
+    slog_sync_lock(pSlog);
+
+    /* The size is measured again when the file is opened with the next log */
+    if (pSlog->config.nMaxFileSize != nSize) slog_close_file(&pSlog->logFile);
+    pSlog->config.nMaxFileSize = nSize;
+
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+}
+
+void slog_max_archives_set_ex(slog_t *pSlog, uint32_t nCount)
+{
+    slog_sync_lock(pSlog);
+    pSlog->config.nMaxArchives = nCount;
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+}
+
+void slog_max_total_size_set_ex(slog_t *pSlog, uint64_t nSize)
+{
+    slog_sync_lock(pSlog);
+    pSlog->config.nMaxTotalSize = nSize;
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+}
+
+void slog_collapse_set_ex(slog_t *pSlog, uint8_t nEnable)
+{
+    slog_sync_lock(pSlog);
+    if (!nEnable) slog_repeat_flush(pSlog);
+    pSlog->config.nCollapse = nEnable;
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+}
+
+void slog_compress_set_ex(slog_t *pSlog, slog_compress_t eCompress)
+{
+    slog_sync_lock(pSlog);
+    pSlog->config.eCompress = eCompress;
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+}
+
+void slog_flags_set_ex(slog_t *pSlog, uint16_t nFlags)
+{
+    slog_sync_lock(pSlog);
+    pSlog->config.nFlags = nFlags;
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+}
+
+uint16_t slog_flags_get_ex(slog_t *pSlog)
+{
+    slog_sync_lock(pSlog);
+    uint16_t nFlags = pSlog->config.nFlags;
+    slog_sync_unlock(pSlog);
+    return nFlags;
+}
+
+void slog_init_ex(slog_t *pSlog, const char* pName, uint16_t nFlags, uint8_t nTdSafe)
+{
+    /* Re-initialization switches back to the synchronous mode */
+    slog_async_stop(pSlog);
+    slog_flusher_stop(pSlog);
+
+    /* Re-initializing a live mutex is undefined behaviour, so recreate
+     * the lock only if this is the first init or the mode has changed */
+    if (!pSlog->nInit || pSlog->nTdSafe != nTdSafe)
+    {
+        if (pSlog->nInit) slog_sync_destroy(pSlog);
+        pSlog->nTdSafe = nTdSafe;
+        slog_sync_init(pSlog);
+    }
+
+    /* Recorder has its own lock, the filtered levels never take the output lock */
+    if (!pSlog->nInit) slog_mutex_init(&pSlog->recorder.mutex);
+    slog_mutex_lock(&pSlog->recorder.mutex);
+    slog_recorder_free(&pSlog->recorder);
+    slog_atomic_set(&pSlog->recorder.nFlags, 0);
+    slog_mutex_unlock(&pSlog->recorder.mutex);
+
+    slog_sync_lock(pSlog);
+
+    slog_config_t *pCfg = &pSlog->config;
+    slog_file_t *pFile = &pSlog->logFile;
+
+    /* Set up default values */
+    pCfg->eColorFormat = SLOG_COLORING_TAG;
+    pCfg->eDateControl = SLOG_TIME_ONLY;
+    pCfg->eFormat = SLOG_FORMAT_TEXT;
+    pCfg->pCallbackCtx = NULL;
+    pCfg->logCallback = NULL;
+    pCfg->sSeparator[0] = ' ';
+    pCfg->sSeparator[1] = '\0';
+    pCfg->sFilePath[0] = '.';
+    pCfg->sFilePath[1] = '\0';
+    pCfg->nKeepOpen = 1;
+    pCfg->nToScreen = 1;
+    pCfg->nTraceTid = 0;
+    pCfg->nUseHeap = 0;
+    pCfg->nGrowBuffer = 0;
+    pCfg->nToFile = 0;
+    pCfg->nIndent = 0;
+    pCfg->nRotate = 1;
+    pCfg->nFlush = 0;
+    pCfg->nCoarseTime = 0;
+    pCfg->nFileBuffer = 0;
+    pCfg->nFlushDelay = SLOG_FLUSH_DELAY;
+    pCfg->nReopenCheck = 0;
+    pCfg->nMapFile = 0;
+    pCfg->nCollapse = 0;
+    pCfg->nMaxFileSize = 0;
+    pCfg->nMaxArchives = 0;
+    pCfg->nMaxTotalSize = 0;
+    pCfg->eCompress = SLOG_COMPRESS_NONE;
+    pCfg->nFlags = nFlags;
+
+    const char *pFileName = (pName != NULL) ? pName : SLOG_NAME_DEFAULT;
+    snprintf(pCfg->sFileName, sizeof(pCfg->sFileName), "%s", pFileName);
+
+    /* Do not leak the handle if we are re-initialized */
+    slog_close_file(pFile);
+    slog_archiver_stop(pFile);
+    slog_free_buffer(pFile);
+    slog_free_sinks(pSlog);
+    slog_repeat_free(pSlog);
+    slog_binary_free(pSlog->pBinary);
+    pSlog->pBinary = NULL;
+
+    pFile->sFilePath[0] = SLOG_NUL;
+    pFile->nCurrDate = 0;
+    slog_atomic_set(&pFile->nReopen, 0);
+    pFile->nSegmentDate = 0;
+    pFile->nSegment = 0;
+    slog_atomic_set(&pSlog->nGrowths, 0);
+    slog_atomic_set(&pSlog->nSampling, 0);
+    slog_atomic_set(&pSlog->nSuppressed, 0);
+    slog_atomic_set(&pSlog->nCountFiltered, 0);
+    memset(&pSlog->counters, 0, sizeof(pSlog->counters));
+    memset(pSlog->stripes, 0, sizeof(pSlog->stripes));
+    slog_profile_reset_ex(pSlog);
+    pFile->nOpens = 0;
+    pFile->nRotations = 0;
+    pFile->nWritten = 0;
+    pFile->nErrors = 0;
+
+    uint8_t i;
+    for (i = 0; i < SLOG_LEVEL_COUNT; i++)
+    {
+        slog_atomic_set(&pSlog->samples[i].nEvery, 0);
+        slog_atomic_set(&pSlog->samples[i].nRate, 0);
+        slog_atomic_set(&pSlog->samples[i].nDropped, 0);
+    }
+
+#ifdef _WIN32
+    /* Enable color support */
+    DWORD dwMode = 0;
+    HANDLE hOutput = GetStdHandle(STD_OUTPUT_HANDLE);
+    GetConsoleMode(hOutput, &dwMode);
+    dwMode |= ENABLE_PROCESSED_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING;
+    SetConsoleMode(hOutput, dwMode);
+#endif
+
+    pSlog->nInit = 1;
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+}
+
+void slog_init_async_ex(slog_t *pSlog, const char* pName, uint16_t nFlags, size_t nQueueSize, slog_overflow_t eOverflow)
+{
+    /* Writer thread shares the configuration and file with callers */
+    slog_init_ex(pSlog, pName, nFlags, 1);
+    slog_async_start(pSlog, nQueueSize, eOverflow);
+}
+
+size_t slog_async_dropped_ex(slog_t *pSlog)
+{
+    slog_async_t *pAsync = slog_async_enter(pSlog);
+    if (pAsync == NULL) return 0;
+
+    size_t nDropped = slog_atomic_get(&pAsync->nDropped);
+    slog_async_leave(pSlog);
+    return nDropped;
+}
+
+size_t slog_buffer_grown_ex(slog_t *pSlog)
+{
+    return slog_atomic_get(&pSlog->nGrowths);
+}
+
+/* Called with the lock held, the mask lets the unsampled levels skip the check */
+static void slog_sample_update(slog_t *pSlog)
+{
+    size_t nMask = 0;
+    uint8_t i;
+
+    for (i = 0; i < SLOG_LEVEL_COUNT; i++)
+    {
+        slog_sample_t *pSample = &pSlog->samples[i];
+        if (slog_atomic_peek(&pSample->nEvery) > 1 ||
+            slog_atomic_peek(&pSample->nRate)) nMask |= (size_t)1 << i;
+    }
+
+    slog_atomic_set(&pSlog->nSampling, nMask);
+}
+
+static void slog_sample_store(slog_t *pSlog, uint16_t nFlags, size_t nEvery, size_t nRate)
+{
+    uint8_t i;
+    slog_sync_lock(pSlog);
+
+    for (i = 0; i < SLOG_LEVEL_COUNT; i++)
+    {
+        if (!(nFlags & (1 << i))) continue;
+        slog_atomic_set(&pSlog->samples[i].nEvery, nEvery);
+        slog_atomic_set(&pSlog->samples[i].nRate, nRate);
+    }
+
+    slog_sample_update(pSlog);
+    slog_sync_unlock(pSlog);
+}
+
+void slog_sample_set_ex(slog_t *pSlog, uint16_t nFlags, uint32_t nEvery)
+{
+    slog_sample_store(pSlog, nFlags, nEvery > 1 ? nEvery : 0, 0);
+}
+
+void slog_sample_rate_set_ex(slog_t *pSlog, uint16_t nFlags, double fRate)
+{
+    /* The threshold is stored plus one, so zero can mean disabled */
+    size_t nRate = 0;
+    if (fRate <= 0.0) nRate = 1;
+    else if (fRate < 1.0)
+    {
+        double fThreshold = fRate * 4294967296.0;
+        nRate = fThreshold < 4294967294.0 ? (size_t)fThreshold + 1 : (size_t)4294967295U;
+    }
+
+    slog_sample_store(pSlog, nFlags, 0, nRate);
+}
+
+size_t slog_sampled_out_ex(slog_t *pSlog, uint16_t nFlags)
+{
+    size_t nDropped = 0;
+    uint8_t i;
+
+    for (i = 0; i < SLOG_LEVEL_COUNT; i++)
+        if (nFlags & (1 << i)) nDropped += slog_atomic_get(&pSlog->samples[i].nDropped);
+
+    return nDropped;
+}
+
+uint8_t slog_recorder_set_ex(slog_t *pSlog, uint16_t nFlags, size_t nSize, const char *pPath)
+{
+    slog_recorder_t *pRecorder = &pSlog->recorder;
+    if (!pSlog->nInit) return 0;
+    if (!nFlags) nSize = 0;
+
+    char *pRing = NULL;
+    if (nSize)
+    {
+        pRing = (char*)malloc(nSize);
+        if (pRing == NULL)
+        {
+            printf("<%s:%d> %s: [ERROR] Can not allocate recorder: %d\n",
+                __FILE__, __LINE__, __func__, errno);
+
+            return 0;
+        }
+    }
+
+    /* Lines of the old levels may still arrive, they are dropped while the ring is NULL */
+    slog_mutex_lock(&pRecorder->mutex);
+    slog_recorder_release(pRecorder);
+    pRecorder->pRing = pRing;
+    pRecorder->nSize = nSize;
+    if (pPath != NULL) snprintf(pRecorder->sPath, sizeof(pRecorder->sPath), "%s", pPath);
+    slog_mutex_unlock(&pRecorder->mutex);
+
+    slog_sync_lock(pSlog);
+    slog_atomic_set(&pRecorder->nFlags, nSize ? nFlags : 0);
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+    return 1;
+}
+
+uint8_t slog_dump_recent_ex(slog_t *pSlog, const char *pPath)
+{
+    slog_recorder_t *pRecorder = &pSlog->recorder;
+    if (!pSlog->nInit) return 0;
+
+    slog_mutex_lock(&pRecorder->mutex);
+    uint8_t nDumped = slog_recorder_dump(pRecorder, pPath != NULL ? pPath : pRecorder->sPath, "request");
+    slog_mutex_unlock(&pRecorder->mutex);
+
+    return nDumped;
+}
+
+static const int g_nSlogCrashSignals[] = {
+    SIGSEGV, SIGABRT, SIGFPE, SIGILL,
+#ifdef SIGBUS
+    SIGBUS,
+#endif
+};
+
+#define SLOG_CRASH_SIGNALS (sizeof(g_nSlogCrashSignals) / sizeof(g_nSlogCrashSignals[0]))
+
+#ifndef _WIN32
+static struct sigaction g_slogCrashPrev[SLOG_CRASH_SIGNALS];
+#else
+typedef void (*slog_signal_cb_t)(int);
+static slog_signal_cb_t g_slogCrashPrev[SLOG_CRASH_SIGNALS];
+#endif
+
+/* Previous handlers are restored first, so a crash in the dump is not handled twice */
+static void slog_crash_restore(void)
+{
+    size_t i;
+
+    for (i = 0; i < SLOG_CRASH_SIGNALS; i++)
+    {
+#ifndef _WIN32
+        sigaction(g_nSlogCrashSignals[i], &g_slogCrashPrev[i], NULL);
+#else
+        signal(g_nSlogCrashSignals[i], g_slogCrashPrev[i]);
+#endif
+    }
+
+    g_pSlogCrash = NULL;
+}
+
+/* The ring is read without the lock, the interrupted thread may be holding it */
+static void slog_crash_handler(int nSignal)
+{
+    slog_t *pSlog = g_pSlogCrash;
+    slog_crash_restore();
+
+    if (pSlog != NULL) slog_recorder_dump(&pSlog->recorder, pSlog->recorder.sPath, "signal");
+    raise(nSignal);
+}
+
+void slog_crash_handler_set_ex(slog_t *pSlog, uint8_t nEnable)
+{
+    size_t i;
+
+    if (!nEnable)
+    {
+        if (g_pSlogCrash == pSlog) slog_crash_restore();
+        return;
+    }
+
+    /* Another instance takes over the installed handler */
+    if (g_pSlogCrash != NULL)
+    {
+        g_pSlogCrash = pSlog;
+        return;
+    }
+
+    g_pSlogCrash = pSlog;
+
+    for (i = 0; i < SLOG_CRASH_SIGNALS; i++)
+    {
+#ifndef _WIN32
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        sigemptyset(&action.sa_mask);
+        action.sa_handler = slog_crash_handler;
+        sigaction(g_nSlogCrashSignals[i], &action, &g_slogCrashPrev[i]);
+#else
+        g_slogCrashPrev[i] = signal(g_nSlogCrashSignals[i], slog_crash_handler);
+#endif
+    }
+}
+
+void slog_stats_get_ex(slog_t *pSlog, slog_stats_t *pStats)
+{
+    slog_counters_t *pCounters = &pSlog->counters;
+    slog_file_t *pFile = &pSlog->logFile;
+    uint8_t i, j;
+
+    memset(pStats, 0, sizeof(slog_stats_t));
+    slog_sync_lock(pSlog);
+
+    for (i = 0; i < SLOG_LEVEL_COUNT; i++)
+    {
+        pStats->nLines[i] = pCounters->nLines[i];
+        pStats->nSampled[i] = slog_atomic_get(&pSlog->samples[i].nDropped);
+    }
+
+    for (i = 0; i < SLOG_SINKS_MAX; i++)
+    {
+        pStats->nSinkBytes[i] = pSlog->sinks[i].nBytes;
+        pStats->nWriteErrors += pSlog->sinks[i].nErrors;
+    }
+
+    for (i = 0; i < SLOG_STATS_BUCKETS; i++)
+        pStats->nLockWaits[i] = pCounters->nLockWaits[i];
+
+    pStats->nScreenBytes = pCounters->nScreenBytes;
+    pStats->nFileBytes = pFile->nWritten;
+    pStats->nFileOpens = pFile->nOpens;
+    pStats->nRotations = pFile->nRotations;
+    pStats->nWriteErrors += pFile->nErrors;
+    pStats->nRejected = pCounters->nRejected;
+    pStats->nCollapsed = pCounters->nCollapsed;
+    pStats->nLockWaitNs = pCounters->nLockWaitNs;
+
+    slog_sync_unlock(pSlog);
+
+    for (i = 0; i < SLOG_STATS_STRIPES; i++)
+    {
+        slog_stripe_t *pStripe = &pSlog->stripes[i];
+        for (j = 0; j < SLOG_LEVEL_COUNT; j++)
+            pStats->nFiltered[j] += slog_atomic_get(&pStripe->nFiltered[j]);
+        pStats->nTruncated += slog_atomic_get(&pStripe->nTruncated);
+    }
+
+    pStats->nSuppressed = slog_atomic_get(&pSlog->nSuppressed);
+    pStats->nDropped = slog_async_dropped_ex(pSlog);
+    pStats->nGrowths = slog_atomic_get(&pSlog->nGrowths);
+}
+
+void slog_stats_filtered_set_ex(slog_t *pSlog, uint8_t nEnable)
+{
+    slog_atomic_set(&pSlog->nCountFiltered, nEnable ? 1 : 0);
+}
+
+#ifdef SLOG_PROFILE
+static const char* slog_profile_phase(slog_phase_t ePhase)
+{
+    switch (ePhase)
+    {
+        case SLOG_PHASE_TOTAL: return "total";
+        case SLOG_PHASE_FORMAT: return "format";
+        case SLOG_PHASE_WAIT: return "lock wait";
+        case SLOG_PHASE_HOLD: return "lock hold";
+        case SLOG_PHASE_OUTPUT: return "output";
+        case SLOG_PHASE_CALLBACK: return "callback";
+        default: break;
+    }
+
+    return "unknown";
+}
+
+/* Percentile distribution in the format of HdrHistogram, the remaining tail is halved on every line */
+static void slog_profile_print(FILE *pOutput, slog_phase_t ePhase, slog_histogram_t *pHist)
+{
+    size_t counts[SLOG_PROFILE_BUCKETS];
+    size_t nMax = slog_atomic_get(&pHist->nMax);
+    size_t nCount = 0, nTotal = 0;
+    double fSum = 0.0, fTail = 1.0;
+    uint32_t i, nBucket = 0;
+
+    /* Buckets are copied first, the counts may change while we print */
+    for (i = 0; i < SLOG_PROFILE_BUCKETS; i++)
+    {
+        counts[i] = slog_atomic_get(&pHist->buckets[i]);
+        if (!counts[i]) continue;
+
+        uint64_t nLow = i ? slog_profile_value(i - 1) + 1 : 0;
+        fSum += (double)counts[i] * ((double)nLow + (double)slog_profile_value(i)) / 2.0;
+        nCount += counts[i];
+    }
+
+    fprintf(pOutput, "# %s (ns)\n", slog_profile_phase(ePhase));
+    if (!nCount)
+    {
+        fprintf(pOutput, "#[No samples]\n\n");
+        return;
+    }
+
+    fprintf(pOutput, "%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+
+    for (;;)
+    {
+        double fPercentile = 1.0 - fTail;
+        size_t nTarget = (size_t)(fPercentile * (double)nCount);
+        if ((double)nTarget < fPercentile * (double)nCount || !nTarget) nTarget++;
+
+        while (nTotal < nTarget) nTotal += counts[nBucket++];
+        uint64_t nValue = slog_profile_value(nBucket - 1);
+        if (nValue > nMax) nValue = nMax;
+
+        if (nTotal >= nCount)
+        {
+            fprintf(pOutput, "%12llu %14.12f %10zu\n", (unsigned long long)nValue, 1.0, nTotal);
+            break;
+        }
+
+        fprintf(pOutput, "%12llu %14.12f %10zu %14.2f\n", (unsigned long long)nValue, fPercentile, nTotal, 1.0 / fTail);
+        fTail /= 2.0;
+    }
+
+    fprintf(pOutput, "#[Mean = %.1f, Max = %zu, Total count = %zu]\n\n", fSum / (double)nCount, nMax, nCount);
+}
+#endif
+
+uint8_t slog_profile_dump_ex(slog_t *pSlog, FILE *pOutput)
+{
+#ifdef SLOG_PROFILE
+    int i;
+
+    for (i = 0; i < SLOG_PHASE_COUNT; i++)
+        slog_profile_print(pOutput, (slog_phase_t)i, &pSlog->profile[i]);
+
+    fflush(pOutput);
+    return 1;
+#else
+    (void)pSlog;
+    (void)pOutput;
+    return 0;
+#endif
+}
+
+void slog_profile_reset_ex(slog_t *pSlog)
+{
+#ifdef SLOG_PROFILE
+    int i, j;
+
+    for (i = 0; i < SLOG_PHASE_COUNT; i++)
+    {
+        slog_histogram_t *pHist = &pSlog->profile[i];
+        slog_atomic_set(&pHist->nCount, 0);
+        slog_atomic_set(&pHist->nMax, 0);
+
+        for (j = 0; j < SLOG_PROFILE_BUCKETS; j++)
+            slog_atomic_set(&pHist->buckets[j], 0);
+    }
+#else
+    (void)pSlog;
+#endif
+}
+
+/* Only sets the flag, the lock must not be taken here as we may be in a signal handler */
+void slog_reopen_ex(slog_t *pSlog)
+{
+    slog_atomic_set(&pSlog->logFile.nReopen, 1);
+}
+
+void slog_flush_sync_ex(slog_t *pSlog)
+{
+    slog_async_t *pAsync = g_nSlogWriter ? NULL : slog_async_enter(pSlog);
+
+    /* Writer thread (e.g. from the log callback) can not wait for itself */
+    if (pAsync != NULL)
+    {
+        size_t nTarget = slog_atomic_get(&pAsync->nEnqueuePos);
+        slog_mutex_lock(&pAsync->mutex);
+        slog_atomic_add(&pAsync->nWaiting, 1);
+
+        while ((intptr_t)(slog_atomic_get(&pAsync->nProcessed) - nTarget) < 0)
+        {
+            slog_cond_signal(&pAsync->writerCond, 0);
+            slog_cond_wait(&pAsync->waiterCond, &pAsync->mutex, SLOG_ASYNC_WAIT_MS);
+        }
+
+        slog_atomic_add(&pAsync->nWaiting, (size_t)-1);
+        slog_mutex_unlock(&pAsync->mutex);
+        slog_async_leave(pSlog);
+    }
+
+    slog_sync_lock(pSlog);
+    slog_repeat_flush(pSlog);
+    fflush(stdout);
+
+    slog_file_t *pFile = &pSlog->logFile;
+    slog_flush_buffer(pFile);
+    if (pFile->pHandle != NULL) fflush(pFile->pHandle);
+    if (pSlog->pBinary != NULL) fflush(pSlog->pBinary->pHandle);
+
+    int i;
+    for (i = 0; i < SLOG_SINKS_MAX; i++)
+    {
+        const slog_sink_slot_t *pSlot = &pSlog->sinks[i];
+        if (pSlot->nUsed && pSlot->sink.eType == SLOG_SINK_STREAM) fflush(pSlot->sink.pStream);
+    }
+
+    slog_sync_unlock(pSlog);
+}
+
+static uint8_t slog_sink_valid(const slog_sink_t *pSink)
+{
+    switch (pSink->eType)
+    {
+        case SLOG_SINK_STREAM: return pSink->pStream != NULL;
+        case SLOG_SINK_FD: return pSink->nFd >= 0;
+        case SLOG_SINK_CALLBACK: return pSink->callback != NULL;
+        case SLOG_SINK_RING: return pSink->nRingSize > 0;
+        default: return 0;
+    }
+}
+
+int slog_sink_add_ex(slog_t *pSlog, const slog_sink_t *pSink)
+{
+    if (pSink == NULL || !slog_sink_valid(pSink))
+    {
+        printf("<%s:%d> %s: [ERROR] Invalid sink configuration\n",
+            __FILE__, __LINE__, __func__);
+        return -1;
+    }
+
+    char *pRing = NULL;
+    if (pSink->eType == SLOG_SINK_RING)
+    {
+        pRing = (char*)malloc(pSink->nRingSize);
+        if (pRing == NULL)
+        {
+            printf("<%s:%d> %s: [ERROR] Failed to allocate ring buffer: %d\n",
+                __FILE__, __LINE__, __func__, errno);
+            return -1;
+        }
+    }
+
+    slog_sync_lock(pSlog);
+    int i;
+
+    for (i = 0; i < SLOG_SINKS_MAX; i++)
+    {
+        slog_sink_slot_t *pSlot = &pSlog->sinks[i];
+        if (pSlot->nUsed) continue;
+
+        pSlot->sink = *pSink;
+        pSlot->pRing = pRing;
+        pSlot->nRingTotal = 0;
+        pSlot->nRingPos = 0;
+        pSlot->nBytes = 0;
+        pSlot->nErrors = 0;
+        pSlot->nUsed = 1;
+
+        pSlog->nSinkCount++;
+        slog_config_update(pSlog);
+        slog_sync_unlock(pSlog);
+        return i;
+    }
+
+    slog_sync_unlock(pSlog);
+    free(pRing);
+
+    printf("<%s:%d> %s: [ERROR] Sink limit reached: %d\n",
+        __FILE__, __LINE__, __func__, SLOG_SINKS_MAX);
+
+    return -1;
+}
+
+uint8_t slog_sink_remove_ex(slog_t *pSlog, int nSinkId)
+{
+    if (nSinkId < 0 || nSinkId >= SLOG_SINKS_MAX) return 0;
+    slog_sync_lock(pSlog);
+
+    slog_sink_slot_t *pSlot = &pSlog->sinks[nSinkId];
+    uint8_t nUsed = pSlot->nUsed;
+
+    if (nUsed)
+    {
+        if (pSlot->pRing != NULL) free(pSlot->pRing);
+        memset(pSlot, 0, sizeof(slog_sink_slot_t));
+        pSlog->nSinkCount--;
+        slog_config_update(pSlog);
+    }
+
+    slog_sync_unlock(pSlog);
+    return nUsed;
+}
+
+void slog_sink_flags_set_ex(slog_t *pSlog, int nSinkId, uint16_t nFlags)
+{
+    if (nSinkId < 0 || nSinkId >= SLOG_SINKS_MAX) return;
+    slog_sync_lock(pSlog);
+
+    slog_sink_slot_t *pSlot = &pSlog->sinks[nSinkId];
+    if (pSlot->nUsed) pSlot->sink.nFlags = nFlags;
+
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+}
+
+size_t slog_sink_read_ex(slog_t *pSlog, int nSinkId, char *pOutput, size_t nSize)
+{
+    if (pOutput == NULL || !nSize) return 0;
+    pOutput[0] = SLOG_NUL;
+
+    if (nSinkId < 0 || nSinkId >= SLOG_SINKS_MAX) return 0;
+    slog_sync_lock(pSlog);
+
+    const slog_sink_slot_t *pSlot = &pSlog->sinks[nSinkId];
+    if (!pSlot->nUsed || pSlot->sink.eType != SLOG_SINK_RING)
+    {
+        slog_sync_unlock(pSlog);
+        return 0;
+    }
+
+    size_t nRingSize = pSlot->sink.nRingSize;
+    size_t nStored = pSlot->nRingTotal < nRingSize ? (size_t)pSlot->nRingTotal : nRingSize;
+    size_t nCopy = nStored < nSize - 1 ? nStored : nSize - 1;
+
+    /* Copy the most recent data, it ends right before the write position */
+    size_t nStart = (pSlot->nRingPos + nRingSize - nCopy) % nRingSize;
+    size_t nFirst = nRingSize - nStart < nCopy ? nRingSize - nStart : nCopy;
+
+    memcpy(pOutput, pSlot->pRing + nStart, nFirst);
+    memcpy(pOutput + nFirst, pSlot->pRing, nCopy - nFirst);
+    pOutput[nCopy] = SLOG_NUL;
+
+    uint8_t nPartial = pSlot->nRingTotal > nCopy ? 1 : 0;
+    slog_sync_unlock(pSlog);
+
+    /* The oldest line was overwritten or cut, start from the next complete one */
+    if (nPartial)
+    {
+        char *pNext = (char*)memchr(pOutput, '\n', nCopy);
+        if (pNext != NULL)
+        {
+            size_t nSkip = (size_t)(pNext - pOutput) + 1;
+            memmove(pOutput, pNext + 1, nCopy - nSkip + 1);
+            nCopy -= nSkip;
+        }
+    }
+
+    return nCopy;
+}
+
+void slog_destroy_ex(slog_t *pSlog)
+{
+    uint8_t nInit = pSlog->nInit;
+
+    /* Drain the queue before the outputs are closed */
+    slog_async_stop(pSlog);
+    slog_flusher_stop(pSlog);
+
+    slog_sync_lock(pSlog);
+    slog_repeat_flush(pSlog);
+    slog_repeat_free(pSlog);
+    slog_close_file(&pSlog->logFile);
+    slog_archiver_stop(&pSlog->logFile);
+    slog_free_buffer(&pSlog->logFile);
+    slog_free_sinks(pSlog);
+    slog_binary_free(pSlog->pBinary);
+    pSlog->pBinary = NULL;
+    memset(&pSlog->config, 0, sizeof(pSlog->config));
+
+    pSlog->config.pCallbackCtx = NULL;
+    pSlog->config.logCallback = NULL;
+
+    pSlog->logFile.sFilePath[0] = SLOG_NUL;
+    pSlog->logFile.nCurrDate = 0;
+    pSlog->logFile.nSegmentDate = 0;
+    pSlog->logFile.nSegment = 0;
+    pSlog->nInit = 0;
+
+    slog_atomic_set(&pSlog->recorder.nFlags, 0);
+    slog_config_update(pSlog);
+    slog_sync_unlock(pSlog);
+    slog_sync_destroy(pSlog);
+
+    if (g_pSlogCrash == pSlog) slog_crash_restore();
+    if (!nInit) return;
+
+    slog_recorder_free(&pSlog->recorder);
+    slog_mutex_destroy(&pSlog->recorder.mutex);
+}
+
+slog_t* slog_create(const char* pName, uint16_t nFlags, uint8_t nTdSafe)
+{
+    slog_t *pSlog = (slog_t*)calloc(1, sizeof(slog_t));
+    if (pSlog == NULL)
+    {
+        printf("<%s:%d> %s: [ERROR] Failed to allocate logger: %d\n",
+            __FILE__, __LINE__, __func__, errno);
+        return NULL;
+    }
+
+    slog_init_ex(pSlog, pName, nFlags, nTdSafe);
+    return pSlog;
+}
+
+void slog_free(slog_t *pSlog)
+{
+    if (pSlog == NULL) return;
+    slog_destroy_ex(pSlog);
+    free(pSlog);
+}
+
+/* Functions below operate on the default instance */
+
+void slog_display(slog_flag_t eFlag, uint8_t nNewLine, const char *pFormat, ...)
+{
+    size_t nActive = slog_atomic_peek(&g_slog.nActive);
+    if (!SLOG_FLAGS_CHECK(nActive, eFlag))
+    {
+        slog_stats_filtered(&g_slog, eFlag);
+        return;
+    }
+
+    va_list args;
+    va_start(args, pFormat);
+    slog_display_args(&g_slog, NULL, eFlag, nNewLine, pFormat, args);
+    va_end(args);
+}
+
+void slog_limited_display(slog_limit_t *pLimit, slog_flag_t eFlag, const char *pFormat, ...)
+{
+    va_list args;
+    va_start(args, pFormat);
+    slog_limited_display_args(&g_slog, pLimit, eFlag, pFormat, args);
+    va_end(args);
+}
+
+void slog_separator_set(const char *pFormat, ...)
+{
+    va_list args;
+    va_start(args, pFormat);
+    slog_separator_args(&g_slog, pFormat, args);
+    va_end(args);
+}
+
+void slog_init(const char* pName, uint16_t nFlags, uint8_t nTdSafe)
+{
+    slog_init_ex(&g_slog, pName, nFlags, nTdSafe);
+}
+
+void slog_init_async(const char* pName, uint16_t nFlags, size_t nQueueSize, slog_overflow_t eOverflow)
+{
+    slog_init_async_ex(&g_slog, pName, nFlags, nQueueSize, eOverflow);
+}
+
+void slog_destroy(void)
+{
+    slog_destroy_ex(&g_slog);
+}
+
+uint8_t slog_is_enabled(slog_flag_t eFlag)
+{
+    return slog_is_enabled_ex(&g_slog, eFlag);
+}
+
+uint8_t slog_is_init(void)
+{
+    return slog_is_init_ex(&g_slog);
+}
+
+void slog_config_get(slog_config_t *pCfg)
+{
+    slog_config_get_ex(&g_slog, pCfg);
+}
+
+void slog_config_set(slog_config_t *pCfg)
+{
+    slog_config_set_ex(&g_slog, pCfg);
+}
+
+void slog_enable(slog_flag_t eFlag)
+{
+    slog_enable_ex(&g_slog, eFlag);
+}
+
+void slog_disable(slog_flag_t eFlag)
+{
+    slog_disable_ex(&g_slog, eFlag);
+}
+
+void slog_callback_set(slog_cb_t callback, void *pContext)
+{
+    slog_callback_set_ex(&g_slog, callback, pContext);
+}
+
+size_t slog_get_full_path(char *pFilePath, size_t nSize)
+{
+    return slog_get_full_path_ex(&g_slog, pFilePath, nSize);
+}
+
+size_t slog_path_set(const char *pPath)
+{
+    return slog_path_set_ex(&g_slog, pPath);
+}
+
+size_t slog_name_set(const char *pName)
+{
+    return slog_name_set_ex(&g_slog, pName);
+}
+
+void slog_color_format_set(slog_coloring_t eFmt)
+{
+    slog_color_format_set_ex(&g_slog, eFmt);
+}
+
+void slog_date_format_set(slog_date_ctrl_t eFmt)
+{
+    slog_date_format_set_ex(&g_slog, eFmt);
+}
+
+void slog_format_set(slog_format_t eFormat)
+{
+    slog_format_set_ex(&g_slog, eFormat);
+}
+
+void slog_screen_set(uint8_t nEnable)
+{
+    slog_screen_set_ex(&g_slog, nEnable);
+}
+
+void slog_file_set(uint8_t nEnable)
+{
+    slog_file_set_ex(&g_slog, nEnable);
+}
+
+void slog_flush_set(uint8_t nEnable)
+{
+    slog_flush_set_ex(&g_slog, nEnable);
+}
+
+void slog_indent_set(uint8_t nEnable)
+{
+    slog_indent_set_ex(&g_slog, nEnable);
+}
+
+void slog_trace_tid_set(uint8_t nEnable)
+{
+    slog_trace_tid_set_ex(&g_slog, nEnable);
+}
+
+void slog_use_heap_set(uint8_t nEnable)
+{
+    slog_use_heap_set_ex(&g_slog, nEnable);
+}
+
+void slog_grow_buffer_set(uint8_t nEnable)
+{
+    slog_grow_buffer_set_ex(&g_slog, nEnable);
+}
+
+void slog_coarse_time_set(uint8_t nEnable)
+{
+    slog_coarse_time_set_ex(&g_slog, nEnable);
+}
+
+void slog_file_buffer_set(uint32_t nSize)
+{
+    slog_file_buffer_set_ex(&g_slog, nSize);
+}
+
+void slog_flush_delay_set(uint32_t nDelayMs)
+{
+    slog_flush_delay_set_ex(&g_slog, nDelayMs);
+}
+
+void slog_reopen_check_set(uint32_t nIntervalMs)
+{
+    slog_reopen_check_set_ex(&g_slog, nIntervalMs);
+}
+
+void slog_map_file_set(uint8_t nEnable)
+{
+    slog_map_file_set_ex(&g_slog, nEnable);
+}
+
+void slog_max_file_size_set(uint64_t nSize)
+{
+    slog_max_file_size_set_ex(&g_slog, nSize);
+}
+
+void slog_max_archives_set(uint32_t nCount)
+{
+    slog_max_archives_set_ex(&g_slog, nCount);
+}
+
+void slog_max_total_size_set(uint64_t nSize)
+{
+    slog_max_total_size_set_ex(&g_slog, nSize);
+}
+
+void slog_compress_set(slog_compress_t eCompress)
+{
+    slog_compress_set_ex(&g_slog, eCompress);
+}
+
+void slog_collapse_set(uint8_t nEnable)
+{
+    slog_collapse_set_ex(&g_slog, nEnable);
+}
+
+void slog_flags_set(uint16_t nFlags)
+{
+    slog_flags_set_ex(&g_slog, nFlags);
+}
+
+uint16_t slog_flags_get(void)
+{
+    return slog_flags_get_ex(&g_slog);
+}
+
+size_t slog_async_dropped(void)
+{
+    return slog_async_dropped_ex(&g_slog);
+}
+
+size_t slog_buffer_grown(void)
+{
+    return slog_buffer_grown_ex(&g_slog);
+}
+
+void slog_sample_set(uint16_t nFlags, uint32_t nEvery)
+{
+    slog_sample_set_ex(&g_slog, nFlags, nEvery);
+}
+
+void slog_sample_rate_set(uint16_t nFlags, double fRate)
+{
+    slog_sample_rate_set_ex(&g_slog, nFlags, fRate);
+}
+
+size_t slog_sampled_out(uint16_t nFlags)
+{
+    return slog_sampled_out_ex(&g_slog, nFlags);
+}
+
+uint8_t slog_recorder_set(uint16_t nFlags, size_t nSize, const char *pPath)
+{
+    return slog_recorder_set_ex(&g_slog, nFlags, nSize, pPath);
+}
+
+uint8_t slog_dump_recent(const char *pPath)
+{
+    return slog_dump_recent_ex(&g_slog, pPath);
+}
+
+void slog_crash_handler_set(uint8_t nEnable)
+{
+    slog_crash_handler_set_ex(&g_slog, nEnable);
+}
+
+void slog_stats_get(slog_stats_t *pStats)
+{
+    slog_stats_get_ex(&g_slog, pStats);
+}
+
+void slog_stats_filtered_set(uint8_t nEnable)
+{
+    slog_stats_filtered_set_ex(&g_slog, nEnable);
+}
+
+uint8_t slog_profile_dump(FILE *pOutput)
+{
+    return slog_profile_dump_ex(&g_slog, pOutput);
+}
+
+void slog_profile_reset(void)
+{
+    slog_profile_reset_ex(&g_slog);
+}
+
+void slog_flush_sync(void)
+{
+    slog_flush_sync_ex(&g_slog);
+}
+
+void slog_reopen(void)
+{
+    slog_reopen_ex(&g_slog);
+}
+
+void slog_thread_name_set(const char *pName)
+{
+    slog_thread_info_t *pThread = &g_slogThread;
+    slog_thread_get();
+
+    if (pName == NULL) pThread->sName[0] = SLOG_NUL;
+    else snprintf(pThread->sName, sizeof(pThread->sName), "%s", pName);
+
+    slog_thread_render(pThread);
+}
+
+int slog_sink_add(const slog_sink_t *pSink)
+{
+    return slog_sink_add_ex(&g_slog, pSink);
+}
+
+uint8_t slog_sink_remove(int nSinkId)
+{
+    return slog_sink_remove_ex(&g_slog, nSinkId);
+}
+
+void slog_sink_flags_set(int nSinkId, uint16_t nFlags)
+{
+    slog_sink_flags_set_ex(&g_slog, nSinkId, nFlags);
+}
+
+size_t slog_sink_read(int nSinkId, char *pOutput, size_t nSize)
+{
+    return slog_sink_read_ex(&g_slog, nSinkId, pOutput, nSize);
+}
+
+uint8_t slog_binary_open(const char *pFilePath)
+{
+    return slog_binary_open_ex(&g_slog, pFilePath);
+}
+
+void slog_binary_close(void)
+{
+    slog_binary_close_ex(&g_slog);
+}
+
+void slog_binary_display(slog_site_t *pSite, slog_flag_t eFlag, const char *pFormat, ...)
+{
+    size_t nActive = slog_atomic_peek(&g_slog.nActive);
+    if (!SLOG_FLAGS_CHECK(nActive, eFlag))
+    {
+        slog_stats_filtered(&g_slog, eFlag);
+        return;
+    }
+
+    va_list args;
+    va_start(args, pFormat);
+    slog_binary_display_args(&g_slog, pSite, eFlag, pFormat, args);
+    va_end(args);
+}
+
+void slog_kv_display(slog_flag_t eFlag, const char *pFile, int nLine, const char *pMessage, const slog_kv_t *pFields, size_t nCount)
+{
+    slog_kv_display_ex(&g_slog, eFlag, pFile, nLine, pMessage, pFields, nCount);
 }
@@ -30,6 +30,7 @@ extern "C" {
 #endif
 
 #include <inttypes.h>
+#include <stdio.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -64,6 +65,17 @@ extern "C" {
 #define SLOG_DATE_MAX           64
 #define SLOG_TAG_MAX            32
 #define SLOG_COLOR_MAX          16
+#define SLOG_THREAD_NAME_MAX    32
+
+#define SLOG_ASYNC_QUEUE_SIZE   256
+#define SLOG_FILE_BUFFER_SIZE   65536
+#define SLOG_FLUSH_DELAY        50
+#define SLOG_REPEAT_DELAY       1000
+#define SLOG_MMAP_CHUNK         (4 * 1024 * 1024)
+#define SLOG_SINKS_MAX          8
+#define SLOG_BINARY_ARGS_MAX    16
+#define SLOG_LEVEL_COUNT        8
+#define SLOG_STATS_BUCKETS      16
 
 #define SLOG_FLAGS_CHECK(c, f) (((c) & (f)) == (f))
 #define SLOG_FLAGS_ALL          255
@@ -83,6 +95,7 @@ typedef struct slog_date {
     uint8_t nMin;
     uint8_t nSec;
     uint16_t nUsec;
+    int16_t nOffset;    // Minutes east of UTC
 } slog_date_t;
 
 uint16_t slog_get_usec();
@@ -101,8 +114,18 @@ typedef enum
     SLOG_FATAL = (1 << 7)
 } slog_flag_t;
 
+#if defined(__GNUC__) || defined(__clang__)
+#define SLOG_PRINTF_ATTR(fmt, args) __attribute__((format(printf, fmt, args)))
+#else
+#define SLOG_PRINTF_ATTR(fmt, args)
+#endif
+
+/* pLog points to an internal buffer and is valid only until the callback returns */
 typedef int(*slog_cb_t)(const char *pLog, size_t nLength, slog_flag_t eFlag, void *pCtx);
 
+/* Opaque logger instance, the macros without the _ex suffix use the default one */
+typedef struct slog slog_t;
+
 /* Output coloring control flags */
 typedef enum
 {
@@ -118,25 +141,254 @@ typedef enum
     SLOG_DATE_FULL
 } slog_date_ctrl_t;
 
+/* Output line formats */
+typedef enum
+{
+    SLOG_FORMAT_TEXT = 0,
+    SLOG_FORMAT_JSON,
+    SLOG_FORMAT_LOGFMT
+} slog_format_t;
+
+/* Compression of the rotated segments, done by the archiver thread */
+typedef enum
+{
+    SLOG_COMPRESS_NONE = 0,
+    SLOG_COMPRESS_GZIP,
+    SLOG_COMPRESS_ZSTD
+} slog_compress_t;
+
+/* Typed fields of the key-value API */
+typedef enum
+{
+    SLOG_KV_STR = 0,
+    SLOG_KV_INT,
+    SLOG_KV_UINT,
+    SLOG_KV_FLOAT,
+    SLOG_KV_BOOL
+} slog_kv_type_t;
+
+typedef struct SLogKeyValue {
+    const char *pKey;
+    slog_kv_type_t eType;
+    union {
+        const char *pStr;
+        int64_t nInt;
+        uint64_t nUint;
+        double fFloat;
+    } value;
+} slog_kv_t;
+
+static inline slog_kv_t slog_kv_str(const char *pKey, const char *pValue)
+{
+    slog_kv_t kv;
+    kv.pKey = pKey;
+    kv.eType = SLOG_KV_STR;
+    kv.value.pStr = pValue;
+    return kv;
+}
+
+static inline slog_kv_t slog_kv_int(const char *pKey, int64_t nValue)
+{
+    slog_kv_t kv;
+    kv.pKey = pKey;
+    kv.eType = SLOG_KV_INT;
+    kv.value.nInt = nValue;
+    return kv;
+}
+
+static inline slog_kv_t slog_kv_uint(const char *pKey, uint64_t nValue)
+{
+    slog_kv_t kv;
+    kv.pKey = pKey;
+    kv.eType = SLOG_KV_UINT;
+    kv.value.nUint = nValue;
+    return kv;
+}
+
+static inline slog_kv_t slog_kv_float(const char *pKey, double fValue)
+{
+    slog_kv_t kv;
+    kv.pKey = pKey;
+    kv.eType = SLOG_KV_FLOAT;
+    kv.value.fFloat = fValue;
+    return kv;
+}
+
+static inline slog_kv_t slog_kv_bool(const char *pKey, uint8_t nValue)
+{
+    slog_kv_t kv;
+    kv.pKey = pKey;
+    kv.eType = SLOG_KV_BOOL;
+    kv.value.nUint = nValue;
+    return kv;
+}
+
+/* Async queue overflow policies */
+typedef enum
+{
+    SLOG_OVERFLOW_BLOCK = 0,
+    SLOG_OVERFLOW_DROP_NEWEST,
+    SLOG_OVERFLOW_DROP_OLDEST
+} slog_overflow_t;
+
+/* Additional output types */
+typedef enum
+{
+    SLOG_SINK_STREAM = 0,
+    SLOG_SINK_FD,
+    SLOG_SINK_CALLBACK,
+    SLOG_SINK_RING
+} slog_sink_type_t;
+
+/* Severity order of the flags used by the compile time level check */
+#define SLOG_SEVERITY(flag) (                   \
+    (flag) == SLOG_TRACE ? 0 :                  \
+    (flag) == SLOG_DEBUG ? 1 :                  \
+    (flag) == SLOG_WARN ? 3 :                   \
+    (flag) == SLOG_ERROR ? 4 :                  \
+    (flag) == SLOG_FATAL ? 5 : 2)
+
+/* Lowest level compiled into the call sites, e.g. -DSLOG_COMPILE_LEVEL=SLOG_WARN */
+#ifndef SLOG_COMPILE_LEVEL
+#define SLOG_COMPILE_LEVEL SLOG_TRACE
+#endif
+
+#define SLOG_COMPILE_CHECK(flag) \
+    (SLOG_SEVERITY(flag) >= SLOG_SEVERITY(SLOG_COMPILE_LEVEL))
+
+/* Arguments are not evaluated at all if the flag is disabled, call sites below
+ * SLOG_COMPILE_LEVEL are type checked but removed together with their strings */
+#define SLOG_DISPLAY(flag, nl, ...)                                     \
+    ((SLOG_COMPILE_CHECK(flag) && slog_is_enabled(flag)) ?              \
+        slog_display(flag, nl, __VA_ARGS__) : (void)0)
+
 /* Slog function definitions */
-#define slog(...) slog_display(SLOG_NOTAG, 1, __VA_ARGS__)
-#define slog_note(...) slog_display(SLOG_NOTE, 1, __VA_ARGS__)
-#define slog_info(...) slog_display(SLOG_INFO, 1, __VA_ARGS__)
-#define slog_warn(...) slog_display(SLOG_WARN, 1, __VA_ARGS__)
-#define slog_debug(...) slog_display(SLOG_DEBUG, 1, __VA_ARGS__)
-#define slog_error(...) slog_display(SLOG_ERROR, 1, __VA_ARGS__)
-#define slog_trace(...) slog_display(SLOG_TRACE, 1, SLOG_THROW_LOCATION __VA_ARGS__)
-#define slog_fatal(...) slog_display(SLOG_FATAL, 1, SLOG_THROW_LOCATION __VA_ARGS__)
+#define slog(...) SLOG_DISPLAY(SLOG_NOTAG, 1, __VA_ARGS__)
+#define slog_note(...) SLOG_DISPLAY(SLOG_NOTE, 1, __VA_ARGS__)
+#define slog_info(...) SLOG_DISPLAY(SLOG_INFO, 1, __VA_ARGS__)
+#define slog_warn(...) SLOG_DISPLAY(SLOG_WARN, 1, __VA_ARGS__)
+#define slog_debug(...) SLOG_DISPLAY(SLOG_DEBUG, 1, __VA_ARGS__)
+#define slog_error(...) SLOG_DISPLAY(SLOG_ERROR, 1, __VA_ARGS__)
+#define slog_trace(...) SLOG_DISPLAY(SLOG_TRACE, 1, SLOG_THROW_LOCATION __VA_ARGS__)
+#define slog_fatal(...) SLOG_DISPLAY(SLOG_FATAL, 1, SLOG_THROW_LOCATION __VA_ARGS__)
 
 /* No new line definitions */
-#define slog_wn(...) slog_display(SLOG_NOTAG, 0, __VA_ARGS__)
-#define slog_note_wn(...) slog_display(SLOG_NOTE, 0, __VA_ARGS__)
-#define slog_info_wn(...) slog_display(SLOG_INFO, 0, __VA_ARGS__)
-#define slog_warn_wn(...) slog_display(SLOG_WARN, 0, __VA_ARGS__)
-#define slog_debug_wn(...) slog_display(SLOG_DEBUG, 0, __VA_ARGS__)
-#define slog_error_wn(...) slog_display(SLOG_ERROR, 0, __VA_ARGS__)
-#define slog_trace_wn(...) slog_display(SLOG_TRACE, 0, SLOG_THROW_LOCATION __VA_ARGS__)
-#define slog_fatal_wn(...) slog_display(SLOG_FATAL, 0, SLOG_THROW_LOCATION __VA_ARGS__)
+#define slog_wn(...) SLOG_DISPLAY(SLOG_NOTAG, 0, __VA_ARGS__)
+#define slog_note_wn(...) SLOG_DISPLAY(SLOG_NOTE, 0, __VA_ARGS__)
+#define slog_info_wn(...) SLOG_DISPLAY(SLOG_INFO, 0, __VA_ARGS__)
+#define slog_warn_wn(...) SLOG_DISPLAY(SLOG_WARN, 0, __VA_ARGS__)
+#define slog_debug_wn(...) SLOG_DISPLAY(SLOG_DEBUG, 0, __VA_ARGS__)
+#define slog_error_wn(...) SLOG_DISPLAY(SLOG_ERROR, 0, __VA_ARGS__)
+#define slog_trace_wn(...) SLOG_DISPLAY(SLOG_TRACE, 0, SLOG_THROW_LOCATION __VA_ARGS__)
+#define slog_fatal_wn(...) SLOG_DISPLAY(SLOG_FATAL, 0, SLOG_THROW_LOCATION __VA_ARGS__)
+
+/* Logging to the specific instance created with slog_create() */
+#define SLOG_DISPLAY_EX(log, flag, nl, ...)                             \
+    ((SLOG_COMPILE_CHECK(flag) && slog_is_enabled_ex(log, flag)) ?      \
+        slog_display_ex(log, flag, nl, __VA_ARGS__) : (void)0)
+
+#define slog_ex(log, ...) SLOG_DISPLAY_EX(log, SLOG_NOTAG, 1, __VA_ARGS__)
+#define slog_note_ex(log, ...) SLOG_DISPLAY_EX(log, SLOG_NOTE, 1, __VA_ARGS__)
+#define slog_info_ex(log, ...) SLOG_DISPLAY_EX(log, SLOG_INFO, 1, __VA_ARGS__)
+#define slog_warn_ex(log, ...) SLOG_DISPLAY_EX(log, SLOG_WARN, 1, __VA_ARGS__)
+#define slog_debug_ex(log, ...) SLOG_DISPLAY_EX(log, SLOG_DEBUG, 1, __VA_ARGS__)
+#define slog_error_ex(log, ...) SLOG_DISPLAY_EX(log, SLOG_ERROR, 1, __VA_ARGS__)
+#define slog_trace_ex(log, ...) SLOG_DISPLAY_EX(log, SLOG_TRACE, 1, SLOG_THROW_LOCATION __VA_ARGS__)
+#define slog_fatal_ex(log, ...) SLOG_DISPLAY_EX(log, SLOG_FATAL, 1, SLOG_THROW_LOCATION __VA_ARGS__)
+
+/* Call site of the binary mode, the format is parsed and recorded only once */
+typedef struct SLogSite {
+    const char *pFile;                  // Source file of the call site
+    int nLine;                          // Source line of the call site
+    volatile size_t nId;                // Format identifier (0 - not registered yet)
+    volatile size_t nBusy;              // Registration in progress
+    uint8_t nText;                      // Format can not be recorded, display it as text
+    uint8_t nArgs;                      // Number of recorded arguments
+    uint8_t aTypes[SLOG_BINARY_ARGS_MAX];
+} slog_site_t;
+
+/* Binary mode records the raw arguments, slog-decode formats them offline */
+#define SLOG_BINARY_EX(log, flag, ...) do {                             \
+        static slog_site_t slogSite = { __FILE__, __LINE__, 0, 0, 0, 0, { 0 } }; \
+        if (SLOG_COMPILE_CHECK(flag) && slog_is_enabled_ex(log, flag))  \
+            slog_binary_display_ex(log, &slogSite, flag, __VA_ARGS__);  \
+    } while (0)
+
+#define SLOG_BINARY(flag, ...) do {                                     \
+        static slog_site_t slogSite = { __FILE__, __LINE__, 0, 0, 0, 0, { 0 } }; \
+        if (SLOG_COMPILE_CHECK(flag) && slog_is_enabled(flag))          \
+            slog_binary_display(&slogSite, flag, __VA_ARGS__);          \
+    } while (0)
+
+#define slog_bin(flag, ...) SLOG_BINARY(flag, __VA_ARGS__)
+#define slog_bin_ex(log, flag, ...) SLOG_BINARY_EX(log, flag, __VA_ARGS__)
+
+/* Message with typed fields, e.g. slog_kv(SLOG_INFO, "Done", slog_kv_int("ms", 5)) */
+#define SLOG_KV_EX(log, flag, msg, ...) do {                            \
+        if (SLOG_COMPILE_CHECK(flag) && slog_is_enabled_ex(log, flag))  \
+        {                                                               \
+            const slog_kv_t slogFields[] = { __VA_ARGS__ };             \
+            slog_kv_display_ex(log, flag, __FILE__, __LINE__, msg,      \
+                slogFields, sizeof(slogFields) / sizeof(slogFields[0])); \
+        }                                                               \
+    } while (0)
+
+#define SLOG_KV(flag, msg, ...) do {                                    \
+        if (SLOG_COMPILE_CHECK(flag) && slog_is_enabled(flag))          \
+        {                                                               \
+            const slog_kv_t slogFields[] = { __VA_ARGS__ };             \
+            slog_kv_display(flag, __FILE__, __LINE__, msg,              \
+                slogFields, sizeof(slogFields) / sizeof(slogFields[0])); \
+        }                                                               \
+    } while (0)
+
+#define slog_kv(flag, msg, ...) SLOG_KV(flag, msg, __VA_ARGS__)
+#define slog_kv_ex(log, flag, msg, ...) SLOG_KV_EX(log, flag, msg, __VA_ARGS__)
+
+/* Call site state of the limited macros, checked and updated without the logger lock */
+typedef struct SLogLimit {
+    const char *pFile;                  // Source file of the call site
+    int nLine;                          // Source line of the call site
+    volatile size_t nCalls;             // Calls counted by the every N check
+    volatile size_t nNext;              // Time when the next line is allowed (usec)
+    volatile size_t nSuppressed;        // Lines dropped by the rate limit since the last one
+} slog_limit_t;
+
+#define SLOG_LIMITED_EX(log, flag, check, ...) do {                     \
+        static slog_limit_t slogLimit = { __FILE__, __LINE__, 0, 0, 0 }; \
+        if (SLOG_COMPILE_CHECK(flag) && slog_is_enabled_ex(log, flag) && (check)) \
+            slog_limited_display_ex(log, &slogLimit, flag, __VA_ARGS__); \
+    } while (0)
+
+#define SLOG_LIMITED(flag, check, ...) do {                             \
+        static slog_limit_t slogLimit = { __FILE__, __LINE__, 0, 0, 0 }; \
+        if (SLOG_COMPILE_CHECK(flag) && slog_is_enabled(flag) && (check)) \
+            slog_limited_display(&slogLimit, flag, __VA_ARGS__);        \
+    } while (0)
+
+/* Only the 1st, (n+1)th, (2n+1)th... call of the site is displayed */
+#define slog_every_n(flag, n, ...) SLOG_LIMITED(flag, slog_limit_every(&slogLimit, n), __VA_ARGS__)
+#define slog_every_n_ex(log, flag, n, ...) SLOG_LIMITED_EX(log, flag, slog_limit_every(&slogLimit, n), __VA_ARGS__)
+
+/* At most rate lines per second with bursts of the same size, the next displayed line reports the dropped ones */
+#define slog_ratelimited(flag, rate, ...) SLOG_LIMITED(flag, slog_limit_rate(&slogLimit, rate), __VA_ARGS__)
+#define slog_ratelimited_ex(log, flag, rate, ...) SLOG_LIMITED_EX(log, flag, slog_limit_rate(&slogLimit, rate), __VA_ARGS__)
+
+#define slog_note_every_n(n, ...) slog_every_n(SLOG_NOTE, n, __VA_ARGS__)
+#define slog_info_every_n(n, ...) slog_every_n(SLOG_INFO, n, __VA_ARGS__)
+#define slog_warn_every_n(n, ...) slog_every_n(SLOG_WARN, n, __VA_ARGS__)
+#define slog_debug_every_n(n, ...) slog_every_n(SLOG_DEBUG, n, __VA_ARGS__)
+#define slog_error_every_n(n, ...) slog_every_n(SLOG_ERROR, n, __VA_ARGS__)
+#define slog_trace_every_n(n, ...) slog_every_n(SLOG_TRACE, n, SLOG_THROW_LOCATION __VA_ARGS__)
+#define slog_fatal_every_n(n, ...) slog_every_n(SLOG_FATAL, n, SLOG_THROW_LOCATION __VA_ARGS__)
+
+#define slog_note_ratelimited(rate, ...) slog_ratelimited(SLOG_NOTE, rate, __VA_ARGS__)
+#define slog_info_ratelimited(rate, ...) slog_ratelimited(SLOG_INFO, rate, __VA_ARGS__)
+#define slog_warn_ratelimited(rate, ...) slog_ratelimited(SLOG_WARN, rate, __VA_ARGS__)
+#define slog_debug_ratelimited(rate, ...) slog_ratelimited(SLOG_DEBUG, rate, __VA_ARGS__)
+#define slog_error_ratelimited(rate, ...) slog_ratelimited(SLOG_ERROR, rate, __VA_ARGS__)
+#define slog_trace_ratelimited(rate, ...) slog_ratelimited(SLOG_TRACE, rate, SLOG_THROW_LOCATION __VA_ARGS__)
+#define slog_fatal_ratelimited(rate, ...) slog_ratelimited(SLOG_FATAL, rate, SLOG_THROW_LOCATION __VA_ARGS__)
 
 /* Short name definitions */
 #define slogn(...) slog_note(__VA_ARGS__)
@@ -159,6 +411,8 @@ typedef enum
 typedef struct SLogConfig {
     slog_date_ctrl_t eDateControl;      // Display output with date format
     slog_coloring_t eColorFormat;       // Output color format control
+    slog_format_t eFormat;              // Text, JSON or logfmt lines
+    slog_compress_t eCompress;          // Compression of the rotated segments
     slog_cb_t logCallback;              // Log callback to collect logs
     void* pCallbackCtx;                 // Data pointer passed to log callback
 
@@ -166,22 +420,66 @@ typedef struct SLogConfig {
     uint8_t nTraceTid;                  // Trace thread ID and display in output
     uint8_t nToScreen;                  // Enable screen logging
     uint8_t nUseHeap;                   // Use dynamic allocation
+    uint8_t nGrowBuffer;                // Grow the thread buffer for long messages
     uint8_t nToFile;                    // Enable file logging
     uint8_t nIndent;                    // Enable indentations
     uint8_t nRotate;                    // Enable log rotation
     uint8_t nFlush;                     // Flush stdout after screen log
+    uint8_t nCoarseTime;                // Use coarse (faster, ~ms precision) clock
+    uint8_t nMapFile;                   // Write the log file through a memory mapping
+    uint8_t nCollapse;                  // Replace repeated lines with a "repeated N times" line
+    uint32_t nFileBuffer;               // Size of the file output buffer (0 - disabled)
+    uint32_t nFlushDelay;               // Max milliseconds a line stays in the file buffer
+    uint32_t nReopenCheck;              // Milliseconds between the log path inode checks (0 - disabled)
     uint16_t nFlags;                    // Allowed log level flags
+    uint32_t nMaxArchives;              // Max number of kept archives (0 - unlimited)
+    uint64_t nMaxFileSize;              // Rotate the file when it reaches this size (0 - disabled)
+    uint64_t nMaxTotalSize;             // Max total size of kept archives (0 - unlimited)
 
     char sSeparator[SLOG_NAME_MAX];     // Separator between info and log
     char sFileName[SLOG_NAME_MAX];      // Output file name for logs
     char sFilePath[SLOG_PATH_MAX];      // Output file path for logs
 } slog_config_t;
 
+typedef struct SLogSink {
+    slog_sink_type_t eType;             // Output type
+    uint16_t nFlags;                    // Log levels delivered to this sink
+    uint8_t nColors;                    // Keep color sequences in the output
+    uint8_t nFlush;                     // Flush the stream after every line
+
+    FILE *pStream;                      // Stream for SLOG_SINK_STREAM (stdout, stderr, file)
+    int nFd;                            // Descriptor or socket for SLOG_SINK_FD
+    slog_cb_t callback;                 // Callback for SLOG_SINK_CALLBACK
+    void *pContext;                     // Data pointer passed to the sink callback
+    size_t nRingSize;                   // Capacity in bytes for SLOG_SINK_RING
+} slog_sink_t;
+
+/* Counters of an instance, levels are indexed by their flag bit (SLOG_INFO is 2) */
+typedef struct SLogStats {
+    uint64_t nLines[SLOG_LEVEL_COUNT];      // Lines written to the outputs
+    uint64_t nFiltered[SLOG_LEVEL_COUNT];   // Calls of disabled levels, counted after slog_stats_filtered_set(1)
+    uint64_t nSampled[SLOG_LEVEL_COUNT];    // Lines dropped by the sampling
+    uint64_t nSinkBytes[SLOG_SINKS_MAX];    // Bytes written to each sink id
+    uint64_t nScreenBytes;                  // Bytes written to stdout
+    uint64_t nFileBytes;                    // Bytes written to the log file
+    uint64_t nFileOpens;                    // Opens of the log file, including the reopens
+    uint64_t nRotations;                    // Files moved by the date or size rotation
+    uint64_t nWriteErrors;                  // Failed writes to the log file and the sinks
+    uint64_t nRejected;                     // Lines the callback returned -1 for
+    uint64_t nTruncated;                    // Messages cut at SLOG_MESSAGE_MAX
+    uint64_t nCollapsed;                    // Repeated lines replaced by a count
+    uint64_t nSuppressed;                   // Lines dropped by the rate limits, added when reported
+    uint64_t nDropped;                      // Lines dropped by the full async queue
+    uint64_t nGrowths;                      // Growths of the thread line buffers
+    uint64_t nLockWaitNs;                   // Total time spent waiting for the logger lock
+    uint64_t nLockWaits[SLOG_STATS_BUCKETS]; // [0] not waited, [i] waited less than 2^(i-1) us
+} slog_stats_t;
+
 const char* slog_version(uint8_t nShort);
 void slog_config_get(slog_config_t *pCfg);
 void slog_config_set(slog_config_t *pCfg);
 
-void slog_separator_set(const char *pFormat, ...);
+void slog_separator_set(const char *pFormat, ...) SLOG_PRINTF_ATTR(1, 2);
 void slog_callback_set(slog_cb_t callback, void *pContext);
 size_t slog_get_full_path(char *pFilePath, size_t nSize);
 
@@ -191,6 +489,7 @@ size_t slog_name_set(const char *pName);
 
 void slog_color_format_set(slog_coloring_t eFmt);
 void slog_date_format_set(slog_date_ctrl_t eFmt);
+void slog_format_set(slog_format_t eFormat);
 
 void slog_screen_set(uint8_t nEnable);
 void slog_file_set(uint8_t nEnable);
@@ -198,6 +497,17 @@ void slog_flush_set(uint8_t nEnable);
 void slog_indent_set(uint8_t nEnable);
 void slog_trace_tid_set(uint8_t nEnable);
 void slog_use_heap_set(uint8_t nEnable);
+void slog_grow_buffer_set(uint8_t nEnable);
+void slog_coarse_time_set(uint8_t nEnable);
+void slog_file_buffer_set(uint32_t nSize);
+void slog_flush_delay_set(uint32_t nDelayMs);
+void slog_reopen_check_set(uint32_t nIntervalMs);
+void slog_map_file_set(uint8_t nEnable);
+void slog_max_file_size_set(uint64_t nSize);
+void slog_max_archives_set(uint32_t nCount);
+void slog_max_total_size_set(uint64_t nSize);
+void slog_compress_set(slog_compress_t eCompress);
+void slog_collapse_set(uint8_t nEnable);
 
 void slog_flags_set(uint16_t nFlags);
 uint16_t slog_flags_get(void);
@@ -206,9 +516,135 @@ void slog_enable(slog_flag_t eFlag);
 void slog_disable(slog_flag_t eFlag);
 
 uint8_t slog_is_init(void);
+uint8_t slog_is_enabled(slog_flag_t eFlag);
 void slog_init(const char* pName, uint16_t nFlags, uint8_t nTdSafe);
-void slog_display(slog_flag_t eFlag, uint8_t nNewLine, const char *pFormat, ...);
-void slog_destroy(); // Required only if (nTdSafe > 0 || nKeepOpen > 0)
+void slog_display(slog_flag_t eFlag, uint8_t nNewLine, const char *pFormat, ...) SLOG_PRINTF_ATTR(3, 4);
+void slog_destroy(); // Required only if (nTdSafe > 0 || nKeepOpen > 0 || async mode)
+
+/* Async mode: callers format into a queue slot and a writer thread does the output */
+void slog_init_async(const char* pName, uint16_t nFlags, size_t nQueueSize, slog_overflow_t eOverflow);
+size_t slog_async_dropped(void);
+size_t slog_buffer_grown(void);
+
+/* Sampling of the levels in nFlags, e.g. slog_sample_set(SLOG_DEBUG | SLOG_TRACE, 100) */
+void slog_sample_set(uint16_t nFlags, uint32_t nEvery);
+void slog_sample_rate_set(uint16_t nFlags, double fRate);
+size_t slog_sampled_out(uint16_t nFlags);
+void slog_flush_sync(void);
+
+/* Flight recorder: the last nSize bytes of the nFlags levels, dumped to pPath on fatal */
+uint8_t slog_recorder_set(uint16_t nFlags, size_t nSize, const char *pPath);
+uint8_t slog_dump_recent(const char *pPath); // NULL - use the recorder path
+void slog_crash_handler_set(uint8_t nEnable); // Dump on SIGSEGV, SIGABRT, SIGBUS, SIGFPE, SIGILL
+
+/* Runtime statistics, cheap enough to be scraped periodically */
+void slog_stats_get(slog_stats_t *pStats);
+void slog_stats_filtered_set(uint8_t nEnable);
+
+/* Latency histograms of the logging phases, collected only by builds with -DSLOG_PROFILE */
+uint8_t slog_profile_dump(FILE *pOutput);
+void slog_profile_reset(void);
+
+/* Async-signal-safe, the log file is reopened before the next line is written */
+void slog_reopen(void);
+
+/* Name of the calling thread, shown instead of its id by every instance (NULL - use id) */
+void slog_thread_name_set(const char *pName);
+
+/* Sinks receive the same formatted line, filtered by (nFlags & sink.nFlags) */
+int slog_sink_add(const slog_sink_t *pSink);
+uint8_t slog_sink_remove(int nSinkId);
+void slog_sink_flags_set(int nSinkId, uint16_t nFlags);
+size_t slog_sink_read(int nSinkId, char *pOutput, size_t nSize);
+
+/* Binary mode: lines logged with slog_bin() are recorded in the file until it is closed.
+ * They are counted in the stats and the recorded levels reach the flight recorder as text,
+ * but the screen, the log file, the sinks and the callback do not receive them */
+uint8_t slog_binary_open(const char *pFilePath);
+void slog_binary_close(void);
+void slog_binary_display(slog_site_t *pSite, slog_flag_t eFlag, const char *pFormat, ...) SLOG_PRINTF_ATTR(3, 4);
+int slog_binary_decode(const char *pFilePath, FILE *pOutput);
+
+uint8_t slog_limit_every(slog_limit_t *pLimit, size_t nEvery);
+uint8_t slog_limit_rate(slog_limit_t *pLimit, uint32_t nPerSec);
+void slog_limited_display(slog_limit_t *pLimit, slog_flag_t eFlag, const char *pFormat, ...) SLOG_PRINTF_ATTR(3, 4);
+
+void slog_kv_display(slog_flag_t eFlag, const char *pFile, int nLine, const char *pMessage, const slog_kv_t *pFields, size_t nCount);
+
+/* Independent instances, each one has its own configuration, file and lock */
+slog_t* slog_create(const char* pName, uint16_t nFlags, uint8_t nTdSafe);
+void slog_free(slog_t *pSlog);
+
+void slog_init_ex(slog_t *pSlog, const char* pName, uint16_t nFlags, uint8_t nTdSafe);
+void slog_init_async_ex(slog_t *pSlog, const char* pName, uint16_t nFlags, size_t nQueueSize, slog_overflow_t eOverflow);
+void slog_display_ex(slog_t *pSlog, slog_flag_t eFlag, uint8_t nNewLine, const char *pFormat, ...) SLOG_PRINTF_ATTR(4, 5);
+void slog_destroy_ex(slog_t *pSlog);
+
+void slog_config_get_ex(slog_t *pSlog, slog_config_t *pCfg);
+void slog_config_set_ex(slog_t *pSlog, slog_config_t *pCfg);
+
+void slog_separator_set_ex(slog_t *pSlog, const char *pFormat, ...) SLOG_PRINTF_ATTR(2, 3);
+void slog_callback_set_ex(slog_t *pSlog, slog_cb_t callback, void *pContext);
+size_t slog_get_full_path_ex(slog_t *pSlog, char *pFilePath, size_t nSize);
+
+size_t slog_path_set_ex(slog_t *pSlog, const char *pPath);
+size_t slog_name_set_ex(slog_t *pSlog, const char *pName);
+
+void slog_color_format_set_ex(slog_t *pSlog, slog_coloring_t eFmt);
+void slog_date_format_set_ex(slog_t *pSlog, slog_date_ctrl_t eFmt);
+void slog_format_set_ex(slog_t *pSlog, slog_format_t eFormat);
+
+void slog_screen_set_ex(slog_t *pSlog, uint8_t nEnable);
+void slog_file_set_ex(slog_t *pSlog, uint8_t nEnable);
+void slog_flush_set_ex(slog_t *pSlog, uint8_t nEnable);
+void slog_indent_set_ex(slog_t *pSlog, uint8_t nEnable);
+void slog_trace_tid_set_ex(slog_t *pSlog, uint8_t nEnable);
+void slog_use_heap_set_ex(slog_t *pSlog, uint8_t nEnable);
+void slog_grow_buffer_set_ex(slog_t *pSlog, uint8_t nEnable);
+void slog_coarse_time_set_ex(slog_t *pSlog, uint8_t nEnable);
+void slog_file_buffer_set_ex(slog_t *pSlog, uint32_t nSize);
+void slog_flush_delay_set_ex(slog_t *pSlog, uint32_t nDelayMs);
+void slog_reopen_check_set_ex(slog_t *pSlog, uint32_t nIntervalMs);
+void slog_map_file_set_ex(slog_t *pSlog, uint8_t nEnable);
+void slog_max_file_size_set_ex(slog_t *pSlog, uint64_t nSize);
+void slog_max_archives_set_ex(slog_t *pSlog, uint32_t nCount);
+void slog_max_total_size_set_ex(slog_t *pSlog, uint64_t nSize);
+void slog_compress_set_ex(slog_t *pSlog, slog_compress_t eCompress);
+void slog_collapse_set_ex(slog_t *pSlog, uint8_t nEnable);
+
+void slog_flags_set_ex(slog_t *pSlog, uint16_t nFlags);
+uint16_t slog_flags_get_ex(slog_t *pSlog);
+
+void slog_enable_ex(slog_t *pSlog, slog_flag_t eFlag);
+void slog_disable_ex(slog_t *pSlog, slog_flag_t eFlag);
+
+uint8_t slog_is_init_ex(slog_t *pSlog);
+uint8_t slog_is_enabled_ex(slog_t *pSlog, slog_flag_t eFlag);
+size_t slog_async_dropped_ex(slog_t *pSlog);
+size_t slog_buffer_grown_ex(slog_t *pSlog);
+void slog_sample_set_ex(slog_t *pSlog, uint16_t nFlags, uint32_t nEvery);
+void slog_sample_rate_set_ex(slog_t *pSlog, uint16_t nFlags, double fRate);
+size_t slog_sampled_out_ex(slog_t *pSlog, uint16_t nFlags);
+uint8_t slog_recorder_set_ex(slog_t *pSlog, uint16_t nFlags, size_t nSize, const char *pPath);
+uint8_t slog_dump_recent_ex(slog_t *pSlog, const char *pPath);
+void slog_crash_handler_set_ex(slog_t *pSlog, uint8_t nEnable);
+void slog_stats_get_ex(slog_t *pSlog, slog_stats_t *pStats);
+void slog_stats_filtered_set_ex(slog_t *pSlog, uint8_t nEnable);
+uint8_t slog_profile_dump_ex(slog_t *pSlog, FILE *pOutput);
+void slog_profile_reset_ex(slog_t *pSlog);
+void slog_flush_sync_ex(slog_t *pSlog);
+void slog_reopen_ex(slog_t *pSlog);
+
+uint8_t slog_binary_open_ex(slog_t *pSlog, const char *pFilePath);
+void slog_binary_close_ex(slog_t *pSlog);
+void slog_limited_display_ex(slog_t *pSlog, slog_limit_t *pLimit, slog_flag_t eFlag, const char *pFormat, ...) SLOG_PRINTF_ATTR(4, 5);
+void slog_kv_display_ex(slog_t *pSlog, slog_flag_t eFlag, const char *pFile, int nLine, const char *pMessage, const slog_kv_t *pFields, size_t nCount);
+void slog_binary_display_ex(slog_t *pSlog, slog_site_t *pSite, slog_flag_t eFlag, const char *pFormat, ...) SLOG_PRINTF_ATTR(4, 5);
+
+int slog_sink_add_ex(slog_t *pSlog, const slog_sink_t *pSink);
+uint8_t slog_sink_remove_ex(slog_t *pSlog, int nSinkId);
+void slog_sink_flags_set_ex(slog_t *pSlog, int nSinkId, uint16_t nFlags);
+size_t slog_sink_read_ex(slog_t *pSlog, int nSinkId, char *pOutput, size_t nSize);
 
 #ifdef __cplusplus
 }